@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace udb {
+// The settings of udb_bench, given as --name=value flags.
+struct BenchOptions {
+  // Entries in the database of the macro workloads.
+  int64_t num_ = 100000;
+
+  // Reads of the read workloads, num_ if negative.
+  int64_t reads_ = -1;
+
+  // Bytes of each key and value.
+  int keySize_ = 16;
+  int valueSize_ = 100;
+
+  // Bytes of the pages and of the buffer pool.
+  int pageSize_ = 4096;
+  int cacheSize_ = 8 << 20;
+
+  // Keep the adaptive hash index of the trees, see Options.
+  bool hashIndex_ = false;
+
+  // Writes committed by each transaction of the write workloads.
+  int batch_ = 1000;
+
+  // Reader threads of readwhilewriting, parallelscan and
+  // checkpointstress, and writer threads of checkpointstress.
+  int threads_ = 4;
+
+  // Directory of the database files, each workload creates and removes
+  // its own.
+  std::string dir_ = "/tmp/udb_bench";
+
+  // Seed of the random keys, the same seed gives the same keys.
+  uint64_t seed_ = 301;
+};
+
+extern BenchOptions gBenchOptions;
+
+// Register the benchmarks of the internals: varints, cells, page search
+// and key comparison.
+void RegisterMicroBenchmarks();
+
+// Register the db_bench-style workloads on whole databases.
+void RegisterDbBenchmarks();
+} // namespace udb
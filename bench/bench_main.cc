@@ -0,0 +1,128 @@
+#include "bench.h"
+
+#include <benchmark/benchmark.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#ifndef UDB_BENCH_BUILD_TYPE
+#define UDB_BENCH_BUILD_TYPE "unknown"
+#endif
+
+namespace udb {
+BenchOptions gBenchOptions;
+
+// Take the flag of the name from arg into value, return false if arg is
+// another flag.
+static bool ParseFlag(const char *arg, const char *name, std::string *value) {
+  size_t n = strlen(name);
+  if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, n) != 0 ||
+      arg[2 + n] != '=') {
+    return false;
+  }
+  *value = arg + 3 + n;
+  return true;
+}
+
+template <typename T>
+static bool ParseFlag(const char *arg, const char *name, T *value) {
+  std::string s;
+  if (!ParseFlag(arg, name, &s)) {
+    return false;
+  }
+  *value = static_cast<T>(strtoll(s.c_str(), nullptr, 10));
+  return true;
+}
+
+// Take the flags of udb_bench out of argv, leaving those of the benchmark
+// library.
+static void ParseFlags(int *argc, char **argv, bool *format) {
+  BenchOptions &o = gBenchOptions;
+  int n = 1;
+
+  for (int i = 1; i < *argc; ++i) {
+    const char *arg = argv[i];
+    if (ParseFlag(arg, "num", &o.num_) || ParseFlag(arg, "reads", &o.reads_) ||
+        ParseFlag(arg, "key_size", &o.keySize_) ||
+        ParseFlag(arg, "value_size", &o.valueSize_) ||
+        ParseFlag(arg, "page_size", &o.pageSize_) ||
+        ParseFlag(arg, "cache_size", &o.cacheSize_) ||
+        ParseFlag(arg, "hash_index", &o.hashIndex_) ||
+        ParseFlag(arg, "batch", &o.batch_) ||
+        ParseFlag(arg, "threads", &o.threads_) ||
+        ParseFlag(arg, "db", &o.dir_) || ParseFlag(arg, "seed", &o.seed_)) {
+      continue;
+    }
+    if (strncmp(arg, "--benchmark_format=", 19) == 0) {
+      *format = true;
+    }
+    argv[n++] = argv[i];
+  }
+  *argc = n;
+}
+
+// Keys are decimal numbers of keySize_ digits.
+static bool CheckOptions() {
+  BenchOptions &o = gBenchOptions;
+  double keys = 1;
+  for (int i = 0; i < o.keySize_ && keys <= o.num_; ++i) {
+    keys *= 10;
+  }
+  if (o.num_ <= 0 || keys <= o.num_) {
+    fprintf(stderr, "--num must be positive and fit in --key_size digits\n");
+    return false;
+  }
+  if (o.valueSize_ < 0 || o.batch_ <= 0 || o.threads_ <= 0) {
+    fprintf(stderr, "--value_size, --batch and --threads out of range\n");
+    return false;
+  }
+  if (o.reads_ < 0) {
+    o.reads_ = o.num_;
+  }
+  return true;
+}
+} // namespace udb
+
+int main(int argc, char **argv) {
+  using udb::gBenchOptions;
+  bool format = false;
+
+  udb::ParseFlags(&argc, argv, &format);
+  if (!udb::CheckOptions()) {
+    return 1;
+  }
+
+  // The results are JSON unless asked otherwise.
+  std::vector<char *> args(argv, argv + argc);
+  char json[] = "--benchmark_format=json";
+  if (!format) {
+    args.push_back(json);
+  }
+  argc = static_cast<int>(args.size());
+  benchmark::Initialize(&argc, args.data());
+  if (benchmark::ReportUnrecognizedArguments(argc, args.data())) {
+    return 1;
+  }
+
+  benchmark::AddCustomContext("udb_build_type", UDB_BENCH_BUILD_TYPE);
+  benchmark::AddCustomContext("num", std::to_string(gBenchOptions.num_));
+  benchmark::AddCustomContext("reads", std::to_string(gBenchOptions.reads_));
+  benchmark::AddCustomContext("key_size",
+                              std::to_string(gBenchOptions.keySize_));
+  benchmark::AddCustomContext("value_size",
+                              std::to_string(gBenchOptions.valueSize_));
+  benchmark::AddCustomContext("page_size",
+                              std::to_string(gBenchOptions.pageSize_));
+  benchmark::AddCustomContext("cache_size",
+                              std::to_string(gBenchOptions.cacheSize_));
+  benchmark::AddCustomContext("hash_index",
+                              std::to_string(gBenchOptions.hashIndex_));
+  benchmark::AddCustomContext("batch", std::to_string(gBenchOptions.batch_));
+
+  udb::RegisterMicroBenchmarks();
+  udb::RegisterDbBenchmarks();
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
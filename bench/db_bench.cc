@@ -0,0 +1,459 @@
+#include "bench.h"
+#include "udb.h"
+
+#include <algorithm>
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <random>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+namespace udb {
+namespace {
+// The keys and values of a workload, each stream of the seed draws other
+// random keys.
+class Generator {
+public:
+  explicit Generator(uint64_t stream = 0)
+      : rng_(gBenchOptions.seed_ + stream), offset_(0) {
+    const BenchOptions &o = gBenchOptions;
+    // Values are windows of a random buffer, so they neither repeat nor
+    // cost anything to make.
+    values_.resize((1 << 20) + o.valueSize_);
+    for (char &c : values_) {
+      c = static_cast<char>(' ' + rng_() % 95);
+    }
+    key_.resize(o.keySize_ + 1);
+  }
+
+  // The i-th key, valid until the next call.
+  Slice Key(int64_t i) {
+    snprintf(&key_[0], key_.size(), "%0*lld", gBenchOptions.keySize_,
+             static_cast<long long>(i));
+    return Slice(key_.data(), gBenchOptions.keySize_);
+  }
+
+  // A key in [0, num_) at random.
+  Slice RandomKey() { return Key(rng_() % gBenchOptions.num_); }
+
+  Slice Value() {
+    offset_ = (offset_ + 4099) & ((1 << 20) - 1);
+    return Slice(&values_[offset_], gBenchOptions.valueSize_);
+  }
+
+private:
+  std::mt19937_64 rng_;
+  std::string values_;
+  size_t offset_;
+  std::string key_;
+};
+
+// The keys 0 to num_ - 1 in order, for the bulk load of the read
+// workloads.
+class SequentialKeys : public KVIterator {
+public:
+  bool Valid() const override { return i_ < gBenchOptions.num_; }
+  Slice Key() const override { return key_; }
+  Slice Value() const override { return value_; }
+  void Next() override {
+    if (++i_ < gBenchOptions.num_) {
+      Load();
+    }
+  }
+
+  void Load() {
+    key_ = gen_.Key(i_);
+    value_ = gen_.Value();
+  }
+
+private:
+  Generator gen_;
+  int64_t i_ = 0;
+  Slice key_;
+  Slice value_;
+};
+
+// A new database of the workload, removed when done.
+class BenchDb {
+public:
+  explicit BenchDb(const std::string &name) : db_(nullptr) {
+    std::filesystem::create_directories(gBenchOptions.dir_);
+    path_ = gBenchOptions.dir_ + "/" + name + ".db";
+    options_.pageSize_ = gBenchOptions.pageSize_;
+    options_.cacheSize_ = gBenchOptions.cacheSize_;
+    options_.adaptiveHashIndex_ = gBenchOptions.hashIndex_;
+    Remove();
+  }
+
+  ~BenchDb() {
+    if (db_) {
+      db_->Close(db_);
+      delete db_;
+    }
+    Remove();
+  }
+
+  // Open the database, and fill it with the keys 0 to num_ - 1 if fill
+  // is true. Return false if that fails.
+  bool Open(bool fill) {
+    if (!Database::Open(options_, path_, &db_).Ok()) {
+      return false;
+    }
+    if (!fill) {
+      return true;
+    }
+    SequentialKeys keys;
+    keys.Load();
+    Txn *txn = db_->Begin(true);
+    Status status = txn->BulkLoad(nullptr, &keys, 100);
+    Status commit = db_->Commit(txn);
+    return status.Ok() && commit.Ok();
+  }
+
+  Database *Get() const { return db_; }
+
+  // The options of the database, may be changed before Open.
+  Options *MutableOptions() { return &options_; }
+
+private:
+  void Remove() {
+    std::filesystem::remove(path_);
+    std::filesystem::remove(path_ + "-wal");
+    std::filesystem::remove(path_ + "-spill");
+  }
+
+  std::string path_;
+  Options options_;
+  Database *db_;
+};
+
+// Write a key of the order per iteration, batch_ of them per transaction.
+template <typename NextKey>
+void WriteKeys(benchmark::State &state, Database *db, Generator *gen,
+               NextKey nextKey) {
+  Txn *txn = db->Begin(true);
+  int n = 0;
+
+  for (auto _ : state) {
+    if (!txn->Write(nullptr, nextKey(), gen->Value()).Ok()) {
+      state.SkipWithError("write failed");
+      break;
+    }
+    if (++n == gBenchOptions.batch_) {
+      db->Commit(txn);
+      txn = db->Begin(true);
+      n = 0;
+    }
+  }
+  db->Commit(txn);
+  int64_t size = gBenchOptions.keySize_ + gBenchOptions.valueSize_;
+  state.SetBytesProcessed(state.iterations() * size);
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_FillSeq(benchmark::State &state) {
+  BenchDb db("fillseq");
+  Generator gen;
+  int64_t i = 0;
+  if (!db.Open(false)) {
+    state.SkipWithError("cannot create the database");
+  } else {
+    WriteKeys(state, db.Get(), &gen, [&] { return gen.Key(i++); });
+  }
+}
+
+void BM_FillRandom(benchmark::State &state) {
+  BenchDb db("fillrandom");
+  Generator gen;
+  if (!db.Open(false)) {
+    state.SkipWithError("cannot create the database");
+  } else {
+    WriteKeys(state, db.Get(), &gen, [&] { return gen.RandomKey(); });
+  }
+}
+
+void BM_Overwrite(benchmark::State &state) {
+  BenchDb db("overwrite");
+  Generator gen;
+  if (!db.Open(true)) {
+    state.SkipWithError("cannot create the database");
+  } else {
+    WriteKeys(state, db.Get(), &gen, [&] { return gen.RandomKey(); });
+  }
+}
+
+// Read a key of the order per iteration, batch_ of them per transaction
+// so that the readers do not hold back checkpoints.
+template <typename NextKey>
+void ReadKeys(benchmark::State &state, Database *db, NextKey nextKey) {
+  Txn *txn = db->Begin(false);
+  int64_t found = 0;
+  int64_t bytes = 0;
+  int n = 0;
+
+  for (auto _ : state) {
+    Slice value;
+    if (txn->Get(nullptr, nextKey(), &value).Ok()) {
+      ++found;
+      bytes += gBenchOptions.keySize_ + value.Size();
+    }
+    if (++n == gBenchOptions.batch_) {
+      db->Commit(txn);
+      txn = db->Begin(false);
+      n = 0;
+    }
+  }
+  db->Commit(txn);
+  state.SetBytesProcessed(bytes);
+  state.SetItemsProcessed(state.iterations());
+  state.counters["found"] = found;
+}
+
+void BM_ReadRandom(benchmark::State &state) {
+  BenchDb db("readrandom");
+  Generator gen;
+  if (!db.Open(true)) {
+    state.SkipWithError("cannot create the database");
+  } else {
+    ReadKeys(state, db.Get(), [&] { return gen.RandomKey(); });
+  }
+}
+
+// Scan the keys in order, an entry per iteration, from the first key
+// again at the end.
+void BM_ReadSeq(benchmark::State &state) {
+  BenchDb db("readseq");
+  if (!db.Open(true)) {
+    state.SkipWithError("cannot create the database");
+    return;
+  }
+  Database *database = db.Get();
+  int64_t bytes = 0;
+  bool running = true;
+  auto read = [&](const Slice &key, const Slice &value) {
+    running = state.KeepRunning();
+    if (running) {
+      bytes += key.Size() + value.Size();
+    }
+    return running;
+  };
+
+  while (running) {
+    Txn *txn = database->Begin(false);
+    Status status = txn->Scan(nullptr, Slice(), Slice(), read);
+    database->Commit(txn);
+    if (!status.Ok()) {
+      state.SkipWithError("scan failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(bytes);
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Scan all the keys with --threads threads per iteration.
+void BM_ParallelScan(benchmark::State &state) {
+  BenchDb db("parallelscan");
+  if (!db.Open(true)) {
+    state.SkipWithError("cannot create the database");
+    return;
+  }
+  Database *database = db.Get();
+  std::atomic<int64_t> entries = 0;
+  std::atomic<int64_t> bytes = 0;
+  auto read = [&](const Slice &key, const Slice &value) {
+    entries.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(key.Size() + value.Size(), std::memory_order_relaxed);
+    return true;
+  };
+
+  for (auto _ : state) {
+    Txn *txn = database->Begin(false);
+    Status status = txn->ParallelScan(nullptr, Slice(), Slice(),
+                                      gBenchOptions.threads_, read);
+    database->Commit(txn);
+    if (!status.Ok()) {
+      state.SkipWithError("scan failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(bytes);
+  state.SetItemsProcessed(entries);
+}
+
+// Shared by the threads of readwhilewriting, nullptr if it could not be
+// created.
+BenchDb *gSharedDb;
+std::atomic<bool> gStopWriter;
+std::thread gWriter;
+
+// Run before the threads start, a writer overwrites random keys until
+// the readers are done.
+void StartWriter(const benchmark::State &) {
+  gSharedDb = new BenchDb("readwhilewriting");
+  if (!gSharedDb->Open(true)) {
+    delete gSharedDb;
+    gSharedDb = nullptr;
+    return;
+  }
+  gStopWriter = false;
+  gWriter = std::thread([] {
+    Database *db = gSharedDb->Get();
+    Generator gen(gBenchOptions.threads_);
+    while (!gStopWriter) {
+      Txn *txn = db->Begin(true);
+      for (int i = 0; i < gBenchOptions.batch_ && !gStopWriter; ++i) {
+        txn->Write(nullptr, gen.RandomKey(), gen.Value());
+      }
+      db->Commit(txn);
+    }
+  });
+}
+
+void StopWriter(const benchmark::State &) {
+  gStopWriter = true;
+  if (gWriter.joinable()) {
+    gWriter.join();
+  }
+  delete gSharedDb;
+  gSharedDb = nullptr;
+}
+
+// Readers read random keys while a writer overwrites random keys, the
+// reads are measured.
+void BM_ReadWhileWriting(benchmark::State &state) {
+  if (gSharedDb == nullptr) {
+    state.SkipWithError("cannot create the database");
+    return;
+  }
+  Generator gen(state.thread_index());
+  ReadKeys(state, gSharedDb->Get(), [&] { return gen.RandomKey(); });
+}
+// Shared by the threads of checkpointstress, nullptr if it could not be
+// created.
+BenchDb *gStressDb;
+std::atomic<bool> gStopStress;
+std::atomic<bool> gStressFailed;
+std::vector<std::thread> gStressWriters;
+
+// Run before the threads start, --threads writers commit small
+// transactions of random keys until the readers are done. The log is
+// checkpointed every few commits, so that the versions the readers and
+// the writers hold are backfilled and purged under them all the time.
+void StartStress(const benchmark::State &) {
+  gStressDb = new BenchDb("checkpointstress");
+  gStressDb->MutableOptions()->walCheckpointFrames_ = 8;
+  gStressDb->MutableOptions()->adaptiveHashIndex_ = true;
+  if (!gStressDb->Open(true)) {
+    delete gStressDb;
+    gStressDb = nullptr;
+    return;
+  }
+  gStopStress = false;
+  gStressFailed = false;
+  for (int t = 0; t < gBenchOptions.threads_; ++t) {
+    gStressWriters.emplace_back([t] {
+      Database *db = gStressDb->Get();
+      Generator gen(gBenchOptions.threads_ + t);
+      while (!gStopStress) {
+        Txn *txn = db->Begin(true);
+        for (int i = 0; i < 8; ++i) {
+          if (!txn->Write(nullptr, gen.RandomKey(), gen.Value()).Ok()) {
+            break;
+          }
+        }
+        // Writers on the same pages conflict, the loser just goes on.
+        Code code = db->Commit(txn).ErrorCode();
+        if (code != kOk && code != kConflict && code != kBusy) {
+          gStressFailed = true;
+        }
+      }
+    });
+  }
+}
+
+void StopStress(const benchmark::State &) {
+  gStopStress = true;
+  for (std::thread &writer : gStressWriters) {
+    writer.join();
+  }
+  gStressWriters.clear();
+  delete gStressDb;
+  gStressDb = nullptr;
+}
+
+// Readers read random keys while the writers commit and checkpoint, every
+// key is in the database and every value has valueSize_ bytes.
+void BM_CheckpointStress(benchmark::State &state) {
+  if (gStressDb == nullptr) {
+    state.SkipWithError("cannot create the database");
+    return;
+  }
+  Database *db = gStressDb->Get();
+  Generator gen(state.thread_index());
+  Txn *txn = db->Begin(false);
+  int n = 0;
+
+  for (auto _ : state) {
+    Slice value;
+    Status status = txn->Get(nullptr, gen.RandomKey(), &value);
+    if (!status.Ok() ||
+        static_cast<int>(value.Size()) != gBenchOptions.valueSize_) {
+      state.SkipWithError("read a wrong value");
+      break;
+    }
+    if (gStressFailed) {
+      state.SkipWithError("commit failed");
+      break;
+    }
+    if (++n == gBenchOptions.batch_) {
+      db->Commit(txn);
+      txn = db->Begin(false);
+      n = 0;
+    }
+  }
+  db->Commit(txn);
+  state.SetItemsProcessed(state.iterations());
+}
+} // namespace
+
+void RegisterDbBenchmarks() {
+  const BenchOptions &o = gBenchOptions;
+
+  // Each workload runs once over a fixed number of operations, like
+  // db_bench, so that runs are comparable. The time includes waiting for
+  // the disk and for the other threads.
+  benchmark::RegisterBenchmark("db/fillseq", BM_FillSeq)
+      ->Iterations(o.num_)
+      ->UseRealTime();
+  benchmark::RegisterBenchmark("db/fillrandom", BM_FillRandom)
+      ->Iterations(o.num_)
+      ->UseRealTime();
+  benchmark::RegisterBenchmark("db/overwrite", BM_Overwrite)
+      ->Iterations(o.num_)
+      ->UseRealTime();
+  benchmark::RegisterBenchmark("db/readrandom", BM_ReadRandom)
+      ->Iterations(o.reads_)
+      ->UseRealTime();
+  benchmark::RegisterBenchmark("db/readseq", BM_ReadSeq)
+      ->Iterations(o.reads_)
+      ->UseRealTime();
+  benchmark::RegisterBenchmark("db/parallelscan", BM_ParallelScan)
+      ->Iterations(std::max<int64_t>(1, o.reads_ / o.num_))
+      ->UseRealTime();
+  benchmark::RegisterBenchmark("db/readwhilewriting", BM_ReadWhileWriting)
+      ->Iterations(o.reads_)
+      ->Threads(o.threads_)
+      ->UseRealTime()
+      ->Setup(StartWriter)
+      ->Teardown(StopWriter);
+  benchmark::RegisterBenchmark("db/checkpointstress", BM_CheckpointStress)
+      ->Iterations(o.reads_)
+      ->Threads(o.threads_)
+      ->UseRealTime()
+      ->Setup(StartStress)
+      ->Teardown(StopStress);
+}
+} // namespace udb
@@ -0,0 +1,175 @@
+#include "bench.h"
+#include "buffer/mem_page.h"
+#include "common/bytes.h"
+#include "common/slice.h"
+#include "storage/cell.h"
+#include "storage/comparator.h"
+#include "storage/page.h"
+#include "storage/page_layout.h"
+
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+
+namespace udb {
+namespace {
+// Bytes of the synthetic pages.
+const int kBenchPageSize = 4096;
+
+// The keys of a bytewise or a u64 leaf, in order, sharing the prefix as
+// keys of a tree often do.
+std::vector<std::string> PageKeys(bool u64, int n) {
+  std::vector<std::string> keys;
+  for (int i = 0; i < n; ++i) {
+    std::string key;
+    if (u64) {
+      key.resize(kU64KeySize);
+      uint64_t v = __builtin_bswap64(static_cast<uint64_t>(i) * 7);
+      memcpy(&key[0], &v, sizeof(v));
+    } else {
+      char digits[24];
+      snprintf(digits, sizeof(digits), "%08d", i * 7);
+      key = std::string("user:") + digits;
+    }
+    keys.push_back(key);
+  }
+  return keys;
+}
+
+// A leaf page holding as many of the keys as fit, with short values.
+class SyntheticPage {
+public:
+  SyntheticPage(char flags, const std::vector<std::string> &keys)
+      : buffer_(kBenchPageSize) {
+    page_.Init(2, buffer_.data(), kBenchPageSize);
+    memPage_.Format(&page_, flags);
+    std::vector<CellData> cells;
+    for (const std::string &key : keys) {
+      cells.push_back(CellData{key, Slice("value", 5), kInvalidPageNo});
+      if (memPage_.SpaceNeeded(cells) > memPage_.UsableSize()) {
+        cells.pop_back();
+        break;
+      }
+    }
+    memPage_.Rebuild(cells);
+  }
+
+  MemPage *Get() { return &memPage_; }
+
+private:
+  std::vector<char> buffer_;
+  Page page_;
+  MemPage memPage_;
+};
+
+void BM_GetVarint(benchmark::State &state) {
+  std::mt19937_64 rng(gBenchOptions.seed_);
+  std::vector<char> buffer(9 * 1024);
+  std::vector<int> offsets;
+  int offset = 0;
+
+  // Mostly small values, as sizes of keys and values are.
+  for (int i = 0; i < 1024; ++i) {
+    int bits = std::uniform_int_distribution<int>(0, 3)(rng) == 0 ? 40 : 12;
+    offsets.push_back(offset);
+    offset += PutVarint(&buffer[offset], rng() >> (64 - bits));
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    uint64_t v;
+    benchmark::DoNotOptimize(GetVarint(&buffer[offsets[i++ & 1023]], &v));
+    benchmark::DoNotOptimize(v);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_CellParseFrom(benchmark::State &state) {
+  bool prefix = state.range(0) != 0;
+  SyntheticPage page(prefix ? kLeafPage | kPrefixPage : kLeafPage,
+                     PageKeys(false, 1000));
+  MemPage *mp = page.Get();
+  const char *data = mp->Data();
+  int n = mp->CellNumber();
+  std::vector<const char *> cells;
+  Slice pagePrefix = mp->Prefix();
+
+  for (int i = 0; i < n; ++i) {
+    cells.push_back(
+        data + get2byte(&data[kLeafPageHeaderSize +
+                              (prefix ? 2 + pagePrefix.Size() : 0) + 2 * i]));
+  }
+  int i = 0;
+  for (auto _ : state) {
+    Cell cell;
+    cell.ParseFrom(cells[i], true, kBenchPageSize, pagePrefix.Data(),
+                   pagePrefix.Size());
+    benchmark::DoNotOptimize(cell);
+    i = i + 1 == n ? 0 : i + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_MemPageSearch(benchmark::State &state) {
+  KeyOrderKind kind = static_cast<KeyOrderKind>(state.range(0));
+  bool prefix = state.range(1) != 0;
+  bool u64 = kind != kBytewiseOrder;
+  char flags = kLeafPage;
+  if (prefix) {
+    flags |= kPrefixPage;
+  } else if (kind == kIntKeyOrder) {
+    flags |= kIntKeyPage;
+  }
+  std::vector<std::string> keys = PageKeys(u64, 1000);
+  SyntheticPage page(flags, keys);
+  MemPage *mp = page.Get();
+  KeyOrder order = KeyOrder::Of(KeyOrder::Builtin(kind));
+  order.kind_ = kind;
+
+  // Look up the keys on the page and the ones between them.
+  keys.resize(mp->CellNumber());
+  std::vector<std::string> probes = PageKeys(u64, keys.size() * 7);
+  std::shuffle(probes.begin(), probes.end(),
+               std::mt19937_64(gBenchOptions.seed_));
+  size_t i = 0;
+  for (auto _ : state) {
+    PageNo child;
+    CursorLocation location;
+    int index;
+    mp->Search(probes[i], order, &child, &location, &index);
+    benchmark::DoNotOptimize(index);
+    i = i + 1 == probes.size() ? 0 : i + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["cells"] = mp->CellNumber();
+}
+
+void BM_SliceCompare(benchmark::State &state) {
+  // Keys of the key size differing in the last byte, the worst case.
+  std::string a(gBenchOptions.keySize_, 'k');
+  std::string b = a;
+  b.back() = 'l';
+  Slice x(a), y(b);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(x.Compare(y.Data(), y.Size()));
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+} // namespace
+
+void RegisterMicroBenchmarks() {
+  benchmark::RegisterBenchmark("micro/GetVarint", BM_GetVarint);
+  benchmark::RegisterBenchmark("micro/CellParseFrom", BM_CellParseFrom)
+      ->ArgName("prefix")
+      ->Arg(0)
+      ->Arg(1);
+  benchmark::RegisterBenchmark("micro/MemPageSearch", BM_MemPageSearch)
+      ->ArgNames({"order", "prefix"})
+      ->Args({kBytewiseOrder, 0})
+      ->Args({kBytewiseOrder, 1})
+      ->Args({kU64Order, 0})
+      ->Args({kIntKeyOrder, 0});
+  benchmark::RegisterBenchmark("micro/SliceCompare", BM_SliceCompare);
+}
+} // namespace udb
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 #include "common/code.h"
 #include "common/export.h"
 #include "common/types.h"
@@ -7,8 +13,21 @@
 
 namespace udb {
 
+class AsyncIo;
+class BufferShard;
+class FreeList;
 class MemPage;
+struct IoRequest;
+class SpillFile;
+class Wal;
+struct Frame;
+
+// The pages a writer read the data its writes depend on, with the version
+// of each it first read, see BufferManager::Commit.
+using ReadSet = std::unordered_map<PageNo, uint64_t>;
 
+// The buffer pool. Frames are allocated once from Options::cacheSize_
+// and partitioned into shards by page number.
 class BufferManager {
 public:
   BufferManager(const Options &options, const string &path);
@@ -16,14 +35,286 @@ public:
 
   static BufferManager *Instance();
 
-  Code GetPage(PageNo no, MemPage **page);
+  // Open the database file, MUST be called before any other operation.
+  Code Open();
+
+  // Return the pinned version of the page visible to the snapshot, the
+  // caller MUST call ReleasePage after use. A writer passes its writer
+  // snapshot and also sees the pages it modified.
+  Code GetPage(PageNo no, uint64_t snapshot, MemPage **page);
+
+  // Return the pinned version of the overflow page, as GetPage.
+  Code GetOverflowPage(PageNo no, uint64_t snapshot, MemPage **page);
+
+  // Unpin the page returned by GetPage.
+  void ReleasePage(MemPage *page);
+
+  // Return true if the snapshot would still get this version of the page.
+  // Always true for a reader, but a writer sees the commits of the others
+  // and the pages it read may have been replaced since.
+  bool IsLatest(MemPage *page, uint64_t snapshot) const;
+
+  // Return true if the reader snapshot likely gets the page without I/O,
+  // its version is in the pool or in the log.
+  bool IsCached(PageNo no, uint64_t snapshot);
+
+  // Prefetch the b+tree pages. The pages of the database file not in the
+  // mapping are read into the pool by AsyncIo, all in flight at once,
+  // mapped ones are hinted as ranges of neighbouring pages.
+  void Readahead(const PageNo *pages, int n, uint64_t snapshot);
+
+  // Hint that the pages will be read soon, for pages that may not be of
+  // the kind the caller expects. Neighbouring pages are hinted as one
+  // range so that the kernel reads them with large requests.
+  void Hint(const PageNo *pages, int n, uint64_t snapshot);
+
+  // Start a write transaction and return its writer snapshot. Writers run
+  // concurrently, each one locks the pages it modifies until it commits.
+  // A writer also takes a reader slot, so that the versions committed
+  // after it began stay in the log until it ends, see Commit.
+  Code BeginWrite(uint64_t *snapshot);
+
+  // Lock the page for the writer and replace it with a private copy the
+  // writer can modify, readers keep seeing the committed version. MUST be
+  // called before modifying the page. The copy stays in the pool, or in
+  // the spill file once evicted, until committed. Return kConflict if
+  // another writer has committed the page since it was read, then the page
+  // is left as is and the caller has to read it again. If another writer
+  // has the page locked, wait for it only if the writer holds no other
+  // page, else return kBusy, so that no two writers ever wait for each
+  // other.
+  Code MarkDirty(MemPage **page, uint64_t snapshot);
+
+  // Allocate a new page formatted as an empty page of the flags, from the
+  // freelist(nearest after near if given) or appended to the database.
+  // The page is dirty, pinned and locked by the writer, the caller MUST
+  // call ReleasePage after use.
+  Code AllocatePage(char flags, uint64_t snapshot, MemPage **page,
+                    PageNo near = kInvalidPageNo);
+
+  // Allocate a new overflow page, the page is dirty and pinned.
+  Code AllocateOverflowPage(uint64_t snapshot, MemPage **page);
+
+  // Take n contiguous pages from the freelist, or append them to the
+  // database if no free extent is long enough. Return the first one, the
+  // pages are locked by the writer and initialized with NewPage or
+  // NewOverflowPage.
+  PageNo AllocateRun(int n, uint64_t snapshot, PageNo near = kInvalidPageNo);
+
+  // Like AllocateRun, but if no free extent is long enough take the
+  // longest one, so that a fragmented freelist is still reused. The
+  // number of pages taken is returned in got.
+  PageNo AllocatePartialRun(int n, uint64_t snapshot, int *got);
+
+  // Return the allocated page no as a dirty and pinned page, formatted as
+  // an empty page of the flags.
+  Code NewPage(PageNo no, char flags, MemPage **page);
+
+  // Return the allocated page no as a dirty and pinned overflow page, or
+  // another page without a page header, filled with zero.
+  Code NewOverflowPage(PageNo no, MemPage **page);
+
+  // Put the page into the freelist when the writer commits, its content is
+  // dropped. Until then committed pages may still refer to it.
+  void FreePage(PageNo no, uint64_t snapshot);
+
+  // Number of pages in the freelist.
+  PageNo FreePageCount() const;
+
+  // Return true if the page is in the freelist.
+  bool IsFreePage(PageNo no) const;
+
+  // Copy the latest image of page from into the allocated page to, which
+  // becomes a dirty page of the same kind. The page from is left as is.
+  // An overflow page has no header to tell its kind, the caller does.
+  Code MovePage(PageNo from, PageNo to, uint64_t snapshot, bool overflow);
+
+  // Shrink the database to count pages, the pages after it MUST NOT be
+  // referred to any more. Only for a writer running alone. The file is
+  // truncated by the first checkpoint that resets the log.
+  void Truncate(PageNo count, uint64_t snapshot);
+
+  // Take a reader slot and the snapshot for a read transaction.
+  Code BeginRead(int *slot, uint64_t *snapshot);
+
+  void EndRead(int slot);
+
+  // Append the pages modified by the writer to the log with the freelist
+  // if it changed, return the LSN of the commit frame. The pages of the
+  // writer are unlocked and the write transaction ends, even on failure.
+  // Return kConflict if another writer has committed a new version of a
+  // page of reads, or freed it, since the writer read it. The changes are
+  // dropped as by Rollback then, so that the first of two writers reading
+  // and writing the same data commits and the other one starts over.
+  Code Commit(uint64_t snapshot, const ReadSet &reads, uint64_t *commitLsn);
+
+  // Drop the pages modified by the writer, return the pages it allocated
+  // to the freelist and end the write transaction, even on failure.
+  Code Rollback(uint64_t snapshot);
+
+  // Append only the dirty pages given to the log, so that their frames can
+  // be evicted. Only for pages no committed page refers to yet.
+  Code CommitPages(const std::vector<MemPage *> &pages, uint64_t *commitLsn);
+
+  // Wait until the log is durable up to lsn, and checkpoint the log
+  // if it has grown too large.
+  Code Sync(uint64_t lsn);
+
+  // Copy the log back into the database file.
+  Code Checkpoint();
+
+  // Compress the pages written into the database file from now on. Pages
+  // are read back whether compressed or not.
+  void SetCompression(CompressionType compression);
+
+  int PageSize() const { return pageSize_; }
+
+  // Number of frames of the buffer pool.
+  int FrameNumber() const { return frameNum_; }
+
+  // Number of pages in the database.
+  PageNo PageCount() const { return pageCount_.load(); }
+
+  // The LSN of the last commit that freed pages, 0 if none since opened.
+  // A freed page keeps its image, so a reader can not tell from a page
+  // whether it is still in the tree it was found in, unless no commit
+  // freed pages since.
+  uint64_t LastFreeLsn() const {
+    return lastFreeLsn_.load(std::memory_order_acquire);
+  }
+
+  // Load the page image of the frame version, from the log if the version
+  // is still there, then from the file mapping if the page is inside it,
+  // else read it into the frame buffer. A compressed page is decompressed
+  // into the frame buffer.
+  Code ReadFrame(Frame *frame);
+
+  // Write the image of the evicted dirty frame to the spill file, see
+  // SpillFile.
+  Code Spill(Frame *frame);
+
+  // Read the spilled image of the frame page back into the frame as a
+  // dirty page.
+  Code ReadSpilled(Frame *frame);
+
+  // Return true if the dirty image of the page is in the spill file.
+  bool IsSpilled(PageNo no) const;
+
+  // Drop the spilled image of the page if any.
+  void DropSpilled(PageNo no);
+
+private:
+  BufferShard *Shard(PageNo no) const;
+
+  // Return the frame holding the page returned by GetPage.
+  Frame *FrameOf(MemPage *page) const;
+
+  Code GetPage(PageNo no, uint64_t snapshot, bool overflow, MemPage **page);
+
+  // Return a dirty and pinned frame with a zero filled image for page no.
+  Code NewFrame(PageNo no, Frame **frame);
+
+  // The pages locked by a writer, the pages it allocated among them, and
+  // the pages it freed which go into the freelist when it commits.
+  struct WriteSet {
+    std::vector<PageNo> pages_;
+    std::vector<PageNo> allocated_;
+    std::vector<PageNo> freed_;
+    int shared_ = 0; // Locked pages that other writers may also want.
+    bool truncated_ = false; // The writer has cut off the end.
+    int slot_ = 0;           // The reader slot of the writer.
+    uint64_t begin_ = 0;     // The last commit when the writer began.
+  };
+
+  WriteSet *Writer(uint64_t snapshot);
+
+  // Return kConflict if a page of reads has changed since the writer read
+  // it, with allocMutex_ held.
+  Code Validate(const WriteSet &set, const ReadSet &reads);
+
+  // Drop the changes of the writer, with allocMutex_ held.
+  Code Undo(WriteSet *set);
+
+  // Take n pages for the writer, with allocMutex_ held.
+  PageNo TakeRun(int n, uint64_t snapshot, PageNo near);
+
+  // Unlock the pages of the writer and forget it.
+  void EndWrite(uint64_t snapshot);
+
+  // Truncate the database file to the size of the last commit, once the
+  // log is empty and no reader can see the pages after it.
+  Code TruncateFile();
+
+  // Append the dirty pages to the log as one transaction, with the
+  // freelist if it changed, with allocMutex_ held. Spilled pages are read
+  // back, pages with no dirty image are left out. freed is true if the
+  // transaction freed pages.
+  Code AppendFrames(const std::vector<PageNo> &pages, bool freed,
+                    uint64_t *commitLsn);
+
+  // Map the file if mmap is enabled, fall back to read if fail.
+  void MapFile(int64_t mmapSize);
+
+  // Return true if bytes [0, end) of the file can be accessed by the mapping.
+  bool IsMapped(uint64_t end);
+
+  // Return the pages of the database file the snapshot reads and the pool
+  // does not have, in order.
+  std::vector<PageNo> ColdPages(const PageNo *pages, int n,
+                                uint64_t snapshot);
+
+  // Hint the kernel to read n pages from page no.
+  void Advise(PageNo no, int n);
+
+  // Start reading the page into a frame of the pool and add the read to
+  // reads, unless it is cached already.
+  void StartReadahead(PageNo no, std::vector<IoRequest *> *reads);
+
+  // Called by AsyncIo when the readahead into the frame is done.
+  void FinishReadahead(Frame *frame, int error);
 
 private:
   int pageSize_;
   int cacheSize_;
   string dbName_;
+
+  File *file_;
+  AsyncIo *aio_;
+  Wal *wal_;
+  SpillFile *spill_;
+  FreeList *freeList_;
+  std::atomic<PageNo> pageCount_;
+  std::atomic<uint64_t> lastFreeLsn_;
+  // Protects the freelist, the growth of the database, committedCount_ and
+  // freedAt_, and orders the appends of the writers.
+  mutable std::mutex allocMutex_;
+  PageNo committedCount_; // Pages of the database as of the last commit.
+  // The pages freed by the commits since the oldest writer began, with
+  // the LSN of the commit.
+  std::unordered_map<PageNo, uint64_t> freedAt_;
+
+  std::mutex writersMutex_; // Protects writers_ and nextWriter_.
+  std::unordered_map<uint64_t, WriteSet> writers_;
+  uint64_t nextWriter_;
+  char *buffer_;  // Page images of all frames.
+  Frame *frames_; // Frames of all shards.
+  int frameNum_;
+  BufferShard *shards_;
+  int shardNum_;
+  int shardShift_; // 32 - log2(shardNum_), to take the high hash bits.
+
+  int64_t mmapSize_;
+  char *mapBase_;                // nullptr if the file is not mapped.
+  uint64_t mapSize_;             // Bytes of address space reserved.
+  std::atomic<uint64_t> mapEnd_; // Bytes of the file covered by the mapping.
+  std::mutex mapMutex_;
+
+  // Readaheads in flight, waited for before the frames are freed.
+  std::mutex readaheadMutex_;
+  std::condition_variable readaheadDone_;
+  int readaheads_;
 };
 
 #define Pager BufferManager::Instance()
 
-} // namespace udb
\ No newline at end of file
+} // namespace udb
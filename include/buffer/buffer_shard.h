@@ -0,0 +1,194 @@
+#pragma once
+
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer/mem_page.h"
+#include "common/code.h"
+#include "common/types.h"
+#include "os/aio.h"
+#include "storage/page.h"
+
+namespace udb {
+class BufferManager;
+
+// Which queue of the 2Q replacer a frame is in.
+enum FrameQueue {
+  kFreeQueue = 0,
+  kA1inQueue,
+  kAmQueue,
+};
+
+// A buffer pool slot holding one version of a page image.
+struct Frame {
+  Page page_;        // The disk image, points to buffer_ or the mmap.
+  MemPage memPage_;  // The parsed page.
+  char *buffer_;     // The page image owned by this frame.
+  uint64_t version_; // See kDbFileVersion and kDirtyVersion.
+  int pinCount_;     // Pinned frames are never evicted.
+  bool dirty_;       // Modified and not yet in the log, see SpillFile.
+  bool loading_;     // The page is being read from the file.
+  FrameQueue queue_; // The replacer queue this frame is in.
+  IoRequest read_;   // The readahead of the page, see StartLoad.
+  Frame *prev_;
+  Frame *next_;
+};
+
+// Frames are looked up by page number and version. The key of a pinned
+// frame may change, a commit or a purge renames it, so a pin is released
+// through its frame and never by looking the key up again.
+struct FrameKey {
+  PageNo pageNo_;
+  uint64_t version_;
+
+  bool operator==(const FrameKey &other) const {
+    return pageNo_ == other.pageNo_ && version_ == other.version_;
+  }
+};
+
+struct FrameKeyHash {
+  size_t operator()(const FrameKey &key) const {
+    return std::hash<uint64_t>()(key.version_ * 31 + key.pageNo_);
+  }
+};
+
+// An intrusive doubly linked list of frames, head is the newest.
+class FrameList {
+public:
+  FrameList() : head_(nullptr), tail_(nullptr), size_(0) {}
+
+  void PushFront(Frame *frame);
+  void Remove(Frame *frame);
+
+  Frame *Head() const { return head_; }
+  Frame *Tail() const { return tail_; }
+  int Size() const { return size_; }
+
+private:
+  Frame *head_;
+  Frame *tail_;
+  int size_;
+};
+
+// One partition of the buffer pool, pages are assigned to a shard by the
+// hash of their page number so that lookups on different pages rarely
+// share a latch. All versions of a page live in the same shard.
+//
+// Frames are replaced by the 2Q policy: a page read for the first time
+// enters the A1in FIFO queue, and only a page referenced again after
+// leaving A1in(remembered in the A1out ghost queue) enters the Am LRU
+// queue. A full scan touches every page once, so it only cycles through
+// A1in and never pushes the hot pages out of Am.
+class BufferShard {
+public:
+  BufferShard();
+
+  BufferShard(const BufferShard &) = delete;
+  BufferShard &operator=(const BufferShard &) = delete;
+
+  void Init(BufferManager *pager, Frame *frames, int frameNum);
+
+  // Return the pinned frame of the page version, read it if missing.
+  // An overflow page is not parsed as a b+tree page.
+  Code Fetch(PageNo no, uint64_t version, Frame **frame,
+             bool overflow = false);
+
+  // Return the pinned frame of the page version if cached, else nullptr.
+  Frame *Lookup(PageNo no, uint64_t version);
+
+  // Return the pinned dirty frame of the page if the writer owner has it
+  // locked and modified, else nullptr. A spilled page is read back.
+  Code LookupDirty(PageNo no, uint64_t owner, Frame **frame);
+
+  // Return true if the page version is cached, without pinning it.
+  bool IsCached(PageNo no, uint64_t version);
+
+  // Return a frame for the readahead of the page version, loading and
+  // pinned by the read until FinishLoad. A Fetch of the page waits for
+  // the read. Return nullptr if the page is cached, if the readaheads in
+  // flight already pin the share of A1in, or if no clean frame can be
+  // evicted, a readahead never spills.
+  Frame *StartLoad(PageNo no, uint64_t version);
+
+  // The readahead of the frame has read the page image, or failed with
+  // code. The page is parsed and cached, or dropped if it failed.
+  void FinishLoad(Frame *frame, Code code);
+
+  // Release a pin of the frame taken by Fetch, Lookup or the like.
+  void Unpin(Frame *frame);
+
+  // Return a pinned dirty frame with a zero filled image for a new page,
+  // the dirty frame of the page is reused if any.
+  Code NewFrame(PageNo no, Frame **frame);
+
+  // Copy the pinned page version into a new pinned dirty frame for the
+  // writer, the pin of the source is released.
+  Code CopyOnWrite(PageNo no, uint64_t version, Frame **copy);
+
+  // Return the pinned dirty frame of the page, nullptr if the page has
+  // none in the pool.
+  Frame *PinDirty(PageNo no);
+
+  // The dirty frame has been committed into the log as version lsn.
+  void Commit(Frame *frame, uint64_t lsn);
+
+  // Drop the page version if it is cached and not pinned. A pinned one is
+  // renamed to a version no lookup returns, so that it is never found
+  // again and is no longer the latest one for the writer holding it. So
+  // is a page being read, the image read may be the one before.
+  void Purge(PageNo no, uint64_t version);
+
+  // Drop the dirty frame of the page, or its spilled image.
+  void DropDirty(PageNo no);
+
+  // Lock the page for the writer owner, locked tells whether it was not
+  // locked by owner before. If another writer has it, wait for the writer
+  // to unlock it if wait, else return kBusy.
+  Code Lock(PageNo no, uint64_t owner, bool wait, bool *locked);
+
+  void Unlock(PageNo no);
+
+private:
+  // Return a frame for a new page, evict one if no frame is free. A dirty
+  // frame is only evicted if no clean one can be and spill is true, it is
+  // spilled then. kNoFreeFrame is saved as the error status of the thread
+  // only if saveError is true.
+  Code GetVictim(Frame **frame, bool spill = true, bool saveError = true);
+
+  // Pick an unpinned frame from the list tail, a clean one or a dirty one.
+  Frame *PickVictim(const FrameList &list, bool dirty) const;
+
+  // Read the spilled image of the page back into a new pinned dirty frame.
+  Code Unspill(PageNo no, Frame **frame);
+
+  void RememberGhost(PageNo no);
+  bool ForgetGhost(PageNo no);
+
+  FrameList &Queue(FrameQueue queue);
+
+  // Pin the cached frame, wait if it is being loaded.
+  Frame *PinCached(std::unique_lock<std::mutex> &lock, const FrameKey &key);
+
+  void FreeFrame(Frame *frame);
+
+private:
+  BufferManager *pager_;
+  std::mutex mutex_;
+  std::condition_variable loaded_;
+  std::condition_variable unlocked_;
+  std::unordered_map<FrameKey, Frame *, FrameKeyHash> table_;
+  std::unordered_map<PageNo, uint64_t> owners_; // Locked page to writer.
+  FrameList free_;
+  FrameList a1in_;
+  FrameList am_;
+  std::list<PageNo> a1out_;
+  std::unordered_map<PageNo, std::list<PageNo>::iterator> ghosts_;
+  int kin_;  // Max size of A1in before evicting from it.
+  int kout_; // Max size of the A1out ghost queue.
+  int loads_; // Frames pinned by a readahead, at most kin_.
+  uint64_t staleVersion_; // The next version for a purged pinned frame.
+};
+} // namespace udb
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "common/code.h"
+#include "common/types.h"
+
+namespace udb {
+class BufferManager;
+class MemPage;
+
+// The free pages of the database file. On disk they form the trunk/leaf
+// freelist of page_layout.h, in memory they are kept as extents of
+// contiguous pages, so that runs of pages can be handed out to page splits
+// and overflow chains. The trunk pages are free pages too, the whole
+// freelist is rewritten into the highest free pages when a transaction
+// that changed it commits. The caller serializes all calls.
+class FreeList {
+public:
+  explicit FreeList(BufferManager *pager);
+
+  FreeList(const FreeList &) = delete;
+  FreeList &operator=(const FreeList &) = delete;
+
+  // Read the freelist of the file header on page 1.
+  Code Load();
+
+  // Take n contiguous free pages, the ones nearest after near if given,
+  // else the lowest. Return kInvalidPageNo if no extent is long enough.
+  PageNo Allocate(int n, PageNo near = kInvalidPageNo);
+
+  void Free(PageNo no);
+
+  // Take the free page no out of the freelist, as if allocated.
+  void Take(PageNo no);
+
+  // Forget the free pages after no, the file is truncated there.
+  void TruncateAfter(PageNo no);
+
+  // Return true if the page is free.
+  bool Contains(PageNo no) const;
+
+  PageNo Count() const { return count_; }
+
+  // The length of the longest extent, 0 if there is no free page.
+  PageNo Longest() const;
+
+  // Return true if the freelist changed since the last Save.
+  bool IsDirty() const { return dirty_; }
+
+  // Save the freelist again with the next commit, the last Save has not
+  // been committed.
+  void SetDirty() { dirty_ = true; }
+
+  // Write the trunk pages as dirty pages, returned pinned in trunks.
+  Code Save(std::vector<MemPage *> *trunks);
+
+  // Write the freelist fields of the file header, MUST follow Save if the
+  // freelist is dirty.
+  void WriteHeader(char *page1) const;
+
+private:
+  // Trunk page capacity in page numbers of leaves.
+  int TrunkCapacity() const;
+
+private:
+  BufferManager *pager_;
+  std::map<PageNo, PageNo> extents_; // First page to number of pages.
+  PageNo count_;
+  PageNo trunk_; // The first trunk page on disk.
+  bool dirty_;
+};
+} // namespace udb
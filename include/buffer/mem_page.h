@@ -1,5 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <span>
+#include <string>
+#include <vector>
+
 #include "common/slice.h"
 #include "common/status.h"
 #include "common/types.h"
@@ -9,6 +14,8 @@ namespace udb {
 class Cell;
 class Cursor;
 class Page;
+struct CellData;
+struct KeyOrder;
 
 // A page which has been loaded into memory.
 class MemPage {
@@ -20,35 +27,173 @@ public:
 
   Code InitFromPage(Page *);
 
+  // Take the page as an overflow page, which has no page header.
+  void InitOverflow(Page *);
+
+  // Format the page as an empty page of the flags(see page_layout.h).
+  // The file header of page 1 is left untouched.
+  void Format(Page *, char flags);
+  void Format(char flags) { Format(page_, flags); }
+
   PageNo MemPageNo() const { return pageNo_; }
   int CellNumber() const { return cellNum_; }
   bool IsLeaf() const { return isLeaf_; }
+  char *Data() { return data_; }
+  int PageSize() const { return pageSize_; }
+
+  // Bytes of the page for the page header and the cells, all but the file
+  // header of page 1.
+  int UsableSize() const { return pageSize_ - headerOffset_; }
+
+  bool IsOverflow() const { return isOverflow_; }
+
+  // The next page of the chain of an overflow page.
+  PageNo NextOverflow() const;
+  void SetNextOverflow(PageNo no);
+
+  // True if the keys of the page are stored without their common prefix.
+  bool IsPrefixPage() const { return isPrefixPage_; }
+
+  // True if the keys of the page are 8-byte integers, see page_layout.h.
+  bool IsIntKeyPage() const { return isIntKeyPage_; }
+  Slice Prefix() const { return Slice(prefix_, prefixSize_); }
+
+  // The right child of an internal page.
+  PageNo RightChild() const;
+  void SetRightChild(PageNo no);
+
+  // True if the leaf points at its right sibling, see page_layout.h.
+  bool IsLinked() const { return isLinked_; }
+
+  // The right sibling of a linked leaf, kInvalidPageNo for the last leaf.
+  PageNo Sibling() const;
+  void SetSibling(PageNo no);
+
+  // The i-th child of an internal page, the right child if i is the cell
+  // number.
+  Code ChildPageNo(int i, PageNo *no) const;
+  void SetChildPageNo(int i, PageNo no);
+
+  // Point the i-th cell of a leaf page, whose value overflows, at another
+  // first overflow page. The page MUST be dirty.
+  void SetCellOverflow(int i, PageNo no);
+
+  // The version of the page image, see kDbFileVersion. The buffer pool
+  // may change it while the page is pinned, see BufferShard::Purge.
+  uint64_t Version() const { return version_.load(std::memory_order_acquire); }
+  void SetVersion(uint64_t version) {
+    version_.store(version, std::memory_order_release);
+  }
 
   // Search the key in the page.
   // If not reached the leaf page, return child page no in pageNo and kOk.
   // Return error otherwise.
-  Code Search(const Slice &key, Cursor *, PageNo *, CursorLocation *,
-              int *cellIndex);
+  // On return location is Equal if the key is at cellIndex, Left if the key
+  // is less than the cell at cellIndex, and Right if the key is greater than
+  // the last cell(at cellIndex).
+  // The keys are compared in the order of the tree, a tree not in memcmp
+  // order MUST NOT have prefix pages.
+  Code Search(const Slice &key, const KeyOrder &order, PageNo *,
+              CursorLocation *, int *cellIndex);
+
+  // Rebuild the key prefix array used by Search, MUST be called after
+  // the cells of the page are changed.
+  void BuildSearchIndex();
 
   void ParseCell(Cursor *);
 
+  // Return the i-th cell info.
+  Code GetCell(int i, Cell *) const;
+
+  // Compare the key with the full key of the i-th cell in the order, in
+  // the same sense as Slice::Compare.
+  int CompareCell(int i, const Slice &key, const KeyOrder &order) const;
+
+  // Bytes free for new cells and their cell pointers, including the space
+  // of dropped cells not yet reclaimed.
   int FreeSpace() const;
 
+  // Insert the cell at index. Return kPageFull if it does not fit, the
+  // page is unchanged then. The page MUST be dirty.
+  Code InsertCell(int index, const CellData &cell);
+
+  // Remove the cell at index. The page MUST be dirty.
+  void DropCell(int index);
+
+  // Bytes of the usable size a page of the same kind as this one takes
+  // when rebuilt with the cells, which MUST be in key order.
+  int SpaceNeeded(std::span<const CellData> cells) const;
+
+  // Bytes the cell takes with its cell pointer, without a prefix.
+  int CellSpace(const CellData &cell) const {
+    return CellDataSize(cell, 0) + 2;
+  }
+
+  // Return the cells of the page in order, the full keys of a prefix page
+  // are kept in keys. They are invalid once the page is changed.
+  void GetCells(std::vector<CellData> *cells, std::string *keys) const;
+
+  // Rewrite the page with the cells, which MUST be in key order. A prefix
+  // page takes the common prefix of the first and the last key. Return
+  // kPageFull if they do not fit, the page is unchanged then.
+  Code Rebuild(std::span<const CellData> cells);
+
 private:
   Code ReadPageHeader(char *data, PageNo pageNo);
   void ParseLeafPageCell(Cursor *);
   void ParseInternalPageCell(Cursor *);
 
-  // Return the i-th cell info.
-  Code GetCell(int i, Cell *);
+  // Binary search the cells from low to high with the comparison of the
+  // key to a cell, see Search.
+  template <class Compare>
+  Code SearchCells(const Compare &compare, int low, int high, PageNo *,
+                   CursorLocation *, int *cellIndex);
+
+  // Search the key in the keys of an intkey page, see Search.
+  Code SearchIntKey(uint64_t key, PageNo *, CursorLocation *,
+                    int *cellIndex);
+
+  // Compare the key with the prefix of the page. If the key starts with
+  // the prefix, return 0 and set suffix to the rest of the key.
+  int ComparePrefix(const Slice &key, Slice *suffix) const;
+
+  // Bytes of the cell on the page, without the cell pointer.
+  int CellDataSize(const CellData &cell, int prefixSize) const;
+  void WriteCell(char *p, const CellData &cell, int prefixSize) const;
+
+  // The common prefix a prefix page rebuilt with the cells takes.
+  int CommonPrefix(std::span<const CellData> cells) const;
+
+  int ContentStart() const;
+  void SetContentStart(int offset);
+  void SetCellNumber(int cellNum);
 
 private:
   Page *page_;
   PageNo pageNo_;
   uint16_t headerOffset_; // 100 for page 1.  0 otherwise
-  uint16_t headerSize_;   // 12 bytes for internal-page, 8 bytes for leaf page.
+  uint16_t headerSize_;   // 12 bytes for internal-page and linked leaf,
+                          // 8 bytes for other leaves.
   int cellNum_;           // The number of cells
   bool isLeaf_;           // True if the page is a leaf page.
   char *data_;            // Pointer to disk image of the page data
+  int pageSize_;          // Bytes of the page image
+  std::atomic<uint64_t> version_; // The version of the page image
+  bool isOverflow_;       // True if the page holds a part of a value.
+  bool isPrefixPage_;     // True if the prefix flag is set.
+  bool isIntKeyPage_;     // True if the intkey flag is set.
+  bool isLinked_;         // True if the linked flag is set.
+  const char *prefix_;    // The common prefix of the keys of a prefix page.
+  uint16_t prefixSize_;
+  uint16_t prefixAreaSize_; // Bytes of the prefix and its size, if any.
+  mutable int freeSpace_;   // Computed on first use, -1 before.
+
+  // The first 4 bytes of the key of each cell as big-endian integers, in
+  // cell order. Search scans it with SIMD compares and only parses the
+  // cells whose prefix equals the prefix of the key.
+  std::vector<uint32_t> prefixes_;
+
+  // The keys of an intkey page in cell order, instead of prefixes_.
+  std::vector<uint64_t> intKeys_;
 };
 }; // namespace udb
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/code.h"
+#include "common/types.h"
+
+namespace udb {
+class File;
+
+// The images of dirty pages evicted before their writer commits. The
+// database file and the log only ever see committed pages, so a writer
+// modifying more pages than the buffer pool holds has its least recently
+// used dirty pages written here, and read back when it uses them again or
+// commits. The file is only scratch, it is emptied when opened and once no
+// page is left in it.
+class SpillFile {
+public:
+  SpillFile(const std::string &dbPath, int pageSize);
+
+  SpillFile(const SpillFile &) = delete;
+  SpillFile &operator=(const SpillFile &) = delete;
+
+  ~SpillFile();
+
+  // Write the image of the dirty page, in place of any older one. overflow
+  // tells whether it is an overflow page, which has no header to tell.
+  Code Write(PageNo no, const char *data, bool overflow);
+
+  // Read the image of the page into buf and drop it from the file.
+  Code Take(PageNo no, char *buf, bool *overflow);
+
+  // Read the image of the page into buf, it stays in the file.
+  Code Read(PageNo no, char *buf);
+
+  // Return true if the page has an image in the file.
+  bool Contains(PageNo no) const;
+
+  // Drop the image of the page if any.
+  void Drop(PageNo no);
+
+private:
+  struct Slot {
+    uint64_t index_; // The image is at index_ * pageSize_.
+    bool overflow_;
+  };
+
+  void DropLocked(PageNo no);
+
+private:
+  int pageSize_;
+  File *file_;
+  mutable std::mutex mutex_;
+  std::unordered_map<PageNo, Slot> slots_;
+  std::vector<uint64_t> free_; // Indexes of dropped images.
+  uint64_t end_;               // Images in the file.
+};
+} // namespace udb
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+namespace udb {
+// A bump allocator whose memory is all freed at once. Allocations only
+// move a pointer in the current block, a block is taken from the heap
+// when it runs out. The first block is kept across resets, so a reused
+// owner allocates nothing as long as it fits in it.
+class Arena {
+public:
+  Arena();
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  ~Arena();
+
+  // Return bytes of memory, valid until Reset. Not aligned.
+  char *Allocate(size_t bytes) {
+    if (bytes <= remaining_) {
+      char *p = ptr_;
+      ptr_ += bytes;
+      remaining_ -= bytes;
+      return p;
+    }
+    return AllocateFallback(bytes);
+  }
+
+  // Free all the memory allocated but the first block.
+  void Reset();
+
+  // Bytes of the blocks taken from the heap.
+  size_t MemoryUsage() const { return usage_; }
+
+private:
+  char *AllocateFallback(size_t bytes);
+  char *AllocateNewBlock(size_t bytes);
+
+private:
+  char *ptr_;        // The next free byte of the current block.
+  size_t remaining_; // Bytes left in the current block.
+  char *first_;      // The first block, nullptr before the first use.
+  std::vector<char *> blocks_; // Blocks after the first one.
+  size_t usage_;
+};
+} // namespace udb
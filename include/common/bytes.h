@@ -3,10 +3,25 @@
 #include <stdint.h>
 
 namespace udb {
-#define get2byte(x) ((x)[0] << 8 | (x)[1])
+#define get2byte(x)                                                            \
+  (((const uint8_t *)(x))[0] << 8 | ((const uint8_t *)(x))[1])
 #define put2byte(p, v) ((p)[0] = (uint8_t)((v) >> 8), (p)[1] = (uint8_t)(v))
 
 uint32_t Get4Byte(const char *);
 void Put4Byte(char *, uint32_t);
 
+// Read a variable length integer(see page_layout.h) into v,
+// return the number of bytes read.
+int GetVarint(const char *, uint64_t *v);
+
+// Write v as a variable length integer, return the number of bytes written.
+int PutVarint(char *, uint64_t v);
+
+// Return the number of bytes to write v as a variable length integer.
+int VarintLen(uint64_t v);
+
+// Update the two checksums(see wal.h) with the data, n MUST be a multiple
+// of 8.
+void Checksum(const char *data, int n, uint32_t *sum);
+
 } // namespace udb
\ No newline at end of file
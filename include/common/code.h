@@ -13,6 +13,31 @@ enum UDB_EXPORT Code {
 
   // Cursor has reached the kTreeMaxDepth
   kCursorOverflow = 2,
+
+  // Read or write the file fail.
+  kIOError = 3,
+
+  // All the frames of the buffer pool are pinned.
+  kNoFreeFrame = 4,
+
+  // Too many concurrent transactions.
+  kBusy = 5,
+
+  // No room in the page for the cell.
+  kPageFull = 6,
+
+  // The key is not in the tree.
+  kNotFound = 7,
+
+  // Write in a read transaction.
+  kReadOnly = 8,
+
+  // The arguments of a call are not valid.
+  kInvalidArgument = 9,
+
+  // A page read by a write transaction has been changed by another one
+  // since, the operation has to read the pages again.
+  kConflict = 10,
 };
 
 } // namespace udb
\ No newline at end of file
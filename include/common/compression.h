@@ -0,0 +1,59 @@
+#pragma once
+
+#include "common/code.h"
+#include "common/types.h"
+#include "udb.h"
+
+/* The layout of a compressed page in the database file
+ **
+ ** The database file keeps a slot of the page size for each page, at the
+ ** same offset whether the page is compressed or not. A compressed page
+ ** fills only the first blocks of its slot, the rest of the slot is a hole
+ ** of the sparse file, which takes no space on the disk and reads as zero
+ ** without I/O. Page 1 is never compressed, so the file header is always
+ ** readable.
+ **
+ **   OFFSET   SIZE     DESCRIPTION
+ **      0       4      Magic number 0x75647a70("udzp")
+ **      4       1      Compression, see CompressionType
+ **      5       3      Bytes of the compressed image
+ **      8       4      Checksum-1 of the compressed image
+ **     12       4      Checksum-2 of the compressed image
+ **     16       *      The compressed image, zero padded to a multiple of
+ **                     8 bytes
+ **
+ ** The checksums are computed as those of the log frames. A page image in
+ ** a slot is compressed only if all the header fields are valid, so that
+ ** a page which happens to begin with the magic number is still read as
+ ** it is.
+ */
+
+namespace udb {
+static const uint32_t kCompressedPageMagic = 0x75647a70;
+static const int kCompressedPageHeaderSize = 16;
+
+// The unit of space the file system allocates, a page is compressed only
+// if it then takes fewer of them.
+static const int kFileBlockSize = 4096;
+
+// The smallest page that can take fewer blocks compressed.
+static const int kMinCompressedPageSize = 2 * kFileBlockSize;
+
+// Return true if udb is built with the compression.
+bool CompressionSupported(CompressionType type);
+
+const char *CompressionName(CompressionType type);
+
+// Compress the page image of size bytes into out, which has room for size
+// bytes. Return the bytes of out to write into the slot of the page, a
+// multiple of kFileBlockSize, or 0 if the page does not take fewer blocks
+// compressed and is written as it is.
+int CompressPage(CompressionType type, const char *page, int size, char *out);
+
+// Return true if the image of size bytes read from a slot is compressed.
+bool IsCompressedPage(const char *image, int size);
+
+// Decompress the compressed image of page no into page of size bytes,
+// which MUST NOT overlap.
+Code DecompressPage(PageNo no, const char *image, int size, char *page);
+} // namespace udb
@@ -5,6 +5,8 @@ namespace udb {
 // will be declared as corrupted.
 static const int kTreeMaxDepth = 20;
 
-static const int kPageSize = 4096;
+// The range of page sizes, see Options::pageSize_.
+static const int kMinPageSize = 1024;
+static const int kMaxPageSize = 65536;
 
 }; // namespace udb
\ No newline at end of file
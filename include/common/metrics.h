@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+namespace udb {
+struct Stats;
+
+// Events counted on the hot paths, see Stats for what each one counts.
+enum Ticker : uint8_t {
+  kCacheHits,
+  kCacheMisses,
+  kCacheEvictions,
+  kCursorSeeks,
+  kPagesVisited,
+  kHashHits,
+  kHashMisses,
+  kSearchProbes,
+  kPageSplits,
+  kPageMerges,
+  kCommits,
+  kWalBytes,
+  kFileSyncs,
+  kTickerCount
+};
+
+// Durations recorded in microseconds.
+enum HistogramKind : uint8_t { kCommitMicros, kSyncMicros, kHistogramCount };
+
+// Bucket i of a histogram counts the values of bit width i, that is 0 in
+// bucket 0 and [2^(i-1), 2^i) in the others.
+static const int kHistogramBuckets = 65;
+
+// The counters of one thread. Only the thread writes them, so an update
+// is a plain load and store, relaxed atomics only let GetStats read them
+// from another thread.
+struct ThreadMetrics {
+  void Add(std::atomic<uint64_t> &counter, uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> tickers_[kTickerCount] = {};
+  std::atomic<uint64_t> counts_[kHistogramCount][kHistogramBuckets] = {};
+  std::atomic<uint64_t> sums_[kHistogramCount] = {};
+};
+
+// The counters of the calling thread, nullptr until it records anything.
+extern constinit thread_local ThreadMetrics *gThreadMetrics;
+
+// Create and register the counters of the calling thread, they are added
+// to the totals of the ended threads when it exits.
+ThreadMetrics *NewThreadMetrics();
+
+// Add the counters of all threads since the process started to stats.
+void CollectMetrics(Stats *stats);
+
+// Subtract the counters of base from stats, which are collected later.
+void SubtractMetrics(const Stats &base, Stats *stats);
+
+inline ThreadMetrics *GetThreadMetrics() {
+  ThreadMetrics *metrics = gThreadMetrics;
+  return metrics ? metrics : NewThreadMetrics();
+}
+
+// The calls below compile to nothing without UDB_WITH_STATS.
+inline void RecordTick(Ticker ticker, uint64_t n = 1) {
+#ifdef UDB_WITH_STATS
+  ThreadMetrics *metrics = GetThreadMetrics();
+  metrics->Add(metrics->tickers_[ticker], n);
+#endif
+}
+
+inline void RecordValue(HistogramKind kind, uint64_t value) {
+#ifdef UDB_WITH_STATS
+  ThreadMetrics *metrics = GetThreadMetrics();
+  int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+  metrics->Add(metrics->counts_[kind][bucket], 1);
+  metrics->Add(metrics->sums_[kind], value);
+#endif
+}
+
+// Record the microseconds from its creation to its destruction, unless
+// it is created disabled.
+class MetricsTimer {
+public:
+  explicit MetricsTimer(HistogramKind kind, bool enabled = true)
+      : kind_(kind), enabled_(enabled) {
+#ifdef UDB_WITH_STATS
+    if (enabled_) {
+      start_ = std::chrono::steady_clock::now();
+    }
+#endif
+  }
+
+  MetricsTimer(const MetricsTimer &) = delete;
+  MetricsTimer &operator=(const MetricsTimer &) = delete;
+
+  ~MetricsTimer() {
+#ifdef UDB_WITH_STATS
+    if (!enabled_) {
+      return;
+    }
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_);
+    RecordValue(kind_, micros.count());
+#endif
+  }
+
+private:
+  HistogramKind kind_;
+  bool enabled_;
+  std::chrono::steady_clock::time_point start_;
+};
+} // namespace udb
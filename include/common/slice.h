@@ -14,6 +14,7 @@
 
 #include "common/debug.h"
 #include "common/export.h"
+#include <algorithm>
 #include <cstring>
 #include <string>
 
@@ -80,10 +81,12 @@ inline bool operator==(const Slice &x, const Slice &y) {
 inline bool operator!=(const Slice &x, const Slice &y) { return !(x == y); }
 
 inline bool operator>(const Slice &x, const Slice &y) {
-  x.Compare(y.Data(), y.Size()) > 0;
+  return x.Compare(y.Data(), y.Size()) > 0;
 }
 
-inline bool operator>(const Slice &x, const Slice &y) { x.Compare(y) > 0; }
+inline bool operator<(const Slice &x, const Slice &y) {
+  return x.Compare(y.Data(), y.Size()) < 0;
+}
 
 inline int Slice::Compare(const char *data, size_t len) const {
   const size_t minLen = std::min(len, size_);
@@ -92,6 +95,9 @@ inline int Slice::Compare(const char *data, size_t len) const {
     return r;
   }
 
+  if (size_ == len) {
+    return 0;
+  }
   return (size_ < len) ? -1 : 1;
 }
 
@@ -18,12 +18,19 @@ public:
 
   bool Ok() const { return code_ == kOk; }
 
+  Code ErrorCode() const { return code_; }
+  const std::string &Context() const { return context_; }
+
 private:
   Code code_;
   std::string context_;
 };
 
+// Keep status as the last error of the current thread, return its code.
 Code SaveErrorStatus(const Status &status);
-Status GetErrorStatus();
+
+// Return the last error of the current thread, for the calls that only
+// return a code or nullptr, such as Database::Begin.
+UDB_EXPORT Status GetErrorStatus();
 
 } // namespace udb
@@ -10,7 +10,7 @@ std::string FormatString(const std::string &format, Args... args) {
   size_t size = 1 + snprintf(nullptr, 0, format.c_str(), args...);
   char bytes[size];
   snprintf(bytes, size, format.c_str(), args...);
-  return string(bytes);
+  return std::string(bytes);
 }
 
 } // namespace udb
\ No newline at end of file
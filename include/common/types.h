@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #include <string>
 
 #include "common/export.h"
@@ -21,6 +22,22 @@ class Cursor;
 typedef uint32_t PageNo;
 static const PageNo kInvalidPageNo = 0;
 
+/*
+** Each committed image of a page is versioned by the LSN of the log frame
+** holding it. Version 0 is the image in the database file, and the image
+** being modified by the writer has no LSN yet.
+*/
+static const uint64_t kDbFileVersion = 0;
+static const uint64_t kDirtyVersion = UINT64_MAX;
+
+// The snapshot which sees the latest committed version of every page.
+static const uint64_t kLatestSnapshot = UINT64_MAX;
+
+// A write transaction sees the latest committed versions and the pages it
+// modified itself. Each one has its own snapshot from kMinWriterSnapshot
+// up, which also names it as the owner of the pages it locks.
+static const uint64_t kMinWriterSnapshot = UINT64_MAX - UINT32_MAX;
+
 class Page;
 
 } // namespace udb
\ No newline at end of file
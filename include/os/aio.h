@@ -0,0 +1,65 @@
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+
+#include "common/code.h"
+#include "common/export.h"
+
+namespace udb {
+class File;
+struct IoWaiter;
+
+// A read or write of whole pages submitted to AsyncIo.
+struct IoRequest {
+  IoRequest() = default;
+  IoRequest(File *file, bool write, uint64_t offset, char *buf, size_t size)
+      : file_(file), write_(write), offset_(offset), buf_(buf), size_(size) {}
+
+  File *file_ = nullptr;
+  bool write_ = false;
+  uint64_t offset_ = 0;
+  char *buf_ = nullptr;
+  size_t size_ = 0;
+
+  // Called by an I/O thread when the request is completed, the request
+  // can not be waited for then and belongs to the callback.
+  std::function<void(IoRequest *)> done_;
+
+  // The thread running the request, woken up once all of its requests
+  // are completed. Set by AsyncIo::Run.
+  IoWaiter *waiter_ = nullptr;
+
+  // The result, a read beyond the end of file is filled with zero.
+  int error_ = 0; // errno of the failed request, 0 on success.
+  bool finished_ = false;
+};
+
+// Asynchronous page I/O, so that one thread can keep many requests in
+// flight. Backed by io_uring if built with UDB_WITH_IO_URING and supported
+// by the kernel, else by a pool of threads doing pread and pwrite.
+class UDB_EXPORT AsyncIo {
+public:
+  virtual ~AsyncIo();
+
+  // Create the io_uring backend if possible, else a pool of threads.
+  static AsyncIo *Create(int threads);
+
+  // Start the requests, they MUST have a done_ callback and stay valid
+  // until completed.
+  virtual void Submit(IoRequest **requests, int n) = 0;
+
+  // Run the requests without done_ callback and wait for them, return the
+  // error of the first failed one. A single request is run by the calling
+  // thread.
+  Code Run(IoRequest **requests, int n);
+
+  virtual const char *Name() const = 0;
+
+protected:
+  AsyncIo() = default;
+
+  // Record the result of the request and wake up its waiter.
+  void Finish(IoRequest *request, int error);
+};
+} // namespace udb
@@ -1,10 +1,66 @@
 #pragma once
 
+#include <stdint.h>
+#include <string>
+
+#include "common/code.h"
 #include "common/export.h"
 
 namespace udb {
+// A file opened for positional reads and writes.
 class UDB_EXPORT File {
 public:
+  File(const std::string &path);
+
+  File(const File &) = delete;
+  File &operator=(const File &) = delete;
+
+  ~File();
+
+  // Open the file, create it if not exist when create is true.
+  Code Open(bool create);
+
+  void Close();
+
+  bool IsOpen() const { return fd_ >= 0; }
+
+  // Read n bytes at offset into buf, bytes beyond the end of file
+  // are filled with zero.
+  Code Read(uint64_t offset, char *buf, size_t n);
+
+  // Write n bytes from buf at offset.
+  Code Write(uint64_t offset, const char *buf, size_t n);
+
+  // Flush the file data to the disk.
+  Code Sync();
+
+  // Return the size of the file in bytes.
+  Code Size(uint64_t *size);
+
+  Code Truncate(uint64_t size);
+
+  // Free the disk blocks of n bytes at offset, which then read as zero.
+  // The size of the file is kept. Not an error if the file system does
+  // not support it, the bytes are left as they are then.
+  Code PunchHole(uint64_t offset, uint64_t n);
+
+  // Map size bytes of the file read-only from offset 0. The size may
+  // exceed the file, but only the bytes inside the file can be accessed.
+  Code Map(uint64_t size, char **base);
+
+  static void Unmap(char *base, uint64_t size);
+
+  // Hint that n bytes at offset will be read soon, errors are ignored.
+  void Advise(uint64_t offset, uint64_t n);
+
+  // Hint that the mapped bytes will be accessed soon, errors are ignored.
+  static void AdviseMap(char *addr, uint64_t n);
+
+  const std::string &Path() const { return path_; }
+  int Fd() const { return fd_; }
+
 private:
+  std::string path_;
+  int fd_;
 };
-} // namespace udb
\ No newline at end of file
+} // namespace udb
@@ -1,7 +1,15 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "common/export.h"
 
 namespace udb {
-class UDB_EXPORT Os {};
-} // namespace udb
\ No newline at end of file
+// Helpers to query the operating system.
+class UDB_EXPORT Os {
+public:
+  // Return the bytes of address space this process may still map,
+  // UINT64_MAX if unlimited.
+  static uint64_t AddressSpaceLimit();
+};
+} // namespace udb
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include "common/code.h"
+#include "common/types.h"
+#include "storage/cell.h"
+
+namespace udb {
+class Cursor;
+class MemPage;
+class TxnImpl;
+
+// Splits the pages of a b+tree which overflow and merges the ones left
+// underfull, along the path of the cursor of a writer.
+//
+// A page that overflows keeps the left half of its cells and a new page
+// after it takes the right half, and the place after it in the chain of
+// linked leaves. The key pushed up to the parent is the
+// shortest one that separates the halves of a leaf(suffix truncation),
+// which may split the parent in turn. A leaf that overflows by an entry
+// after all its cells is split there instead of in the middle, so that
+// ascending inserts leave full pages behind. The root keeps its page
+// number, its cells move down into new children.
+//
+// The pages to change are locked first and changed only when all of them
+// are locked, so a kConflict leaves the tree as it was and the caller
+// moves the cursor to the key again.
+class Balancer {
+public:
+  Balancer(TxnImpl *txn, Cursor *cursor);
+
+  Balancer(const Balancer &) = delete;
+  Balancer &operator=(const Balancer &) = delete;
+
+  // Put the cell at index of the leaf of the cursor, which is dirty and
+  // has no room for it. Replace the cell at index if replace is true. The
+  // cursor is reset once the tree is changed.
+  Code Insert(int index, const CellData &cell, bool replace);
+
+  // Merge the leaf of the cursor, which is dirty and has lost cells, with
+  // a sibling if it is less than a quarter full, or move cells into it
+  // from the sibling if they do not fit in one page. Parents left
+  // underfull are merged in turn, and a root with a single child takes
+  // its cells. A page locked by another writer ends the merging, the tree
+  // is valid but less full then. The cursor is reset if the tree is
+  // changed.
+  Code Underflow();
+
+private:
+  // The cells of a page, or of the pages to write in place of it.
+  struct Node {
+    std::vector<CellData> cells_;
+    std::string keys_;              // Full keys of a prefix page.
+    std::string buffer_;            // The cells copied by Own.
+    PageNo right_ = kInvalidPageNo; // Right child of an internal page.
+  };
+
+  // The change of a page on the path.
+  struct Level {
+    Node node_;
+    bool split_ = false;
+    // Where the cells are split, see Split. 0 for a root which moves
+    // into a single new page.
+    int at_ = 0;
+    std::string separator_; // The key pushed up by the split.
+    MemPage *pages_[2] = {nullptr, nullptr}; // The new pages.
+  };
+
+  // Choose where to split the cells of the node, none of the halves is
+  // empty. A leaf keeps the cells before at on the left page, an internal
+  // page also the left child of the cell at, whose key is pushed up. The
+  // split is biased to the end if append is true. Return kPageFull if no
+  // split fits the halves in pages like page.
+  Code Split(const MemPage *page, bool append, Level *lv) const;
+
+  // Write the cells into the page, with the right child of an internal
+  // page.
+  Code WritePage(MemPage *page, std::span<const CellData> cells,
+                 PageNo right) const;
+
+  // Write the halves of a split node into the pages.
+  Code WriteSplit(const Level &lv, MemPage *left, MemPage *right) const;
+
+  // Write the node into the root, as the cells of new pages under it.
+  Code WriteRoot(Level *lv, MemPage *root);
+
+  // Merge the page at the level of the path with a sibling, or move cells
+  // between them. Set merged if the parent has lost a cell. The left page
+  // of the two takes the cells of a merge, the right one is freed.
+  Code Merge(int level, bool *merged);
+
+  // Copy the only child of the root into it if it fits.
+  Code CollapseRoot();
+
+  // Load the cells of the page into the node.
+  static void Load(MemPage *page, Node *node);
+
+  // Copy the keys and values of the cells into the node, so that they stay
+  // valid while the pages they come from are rewritten.
+  static void Own(Node *node);
+
+  // Put the new page right after left in the chain of linked leaves.
+  static void Link(MemPage *left, MemPage *right);
+
+  // Set the index-th child of an internal node.
+  static void SetChild(Node *node, int index, PageNo no);
+
+private:
+  TxnImpl *txn_;
+  Cursor *cursor_;
+};
+} // namespace udb
@@ -1,16 +1,23 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 
 #include "common/slice.h"
 #include "common/types.h"
+#include "storage/comparator.h"
 #include "storage/txn_impl.h"
 
 namespace udb {
 
+class HashIndex;
+
 class BTree {
 public:
-  BTree(PageNo root, const std::string &name);
+  // The tree has an adaptive hash index of hashCapacity entries if it is
+  // not 0.
+  BTree(PageNo root, const std::string &name, const KeyOrder &order,
+        int hashCapacity = 0);
 
   BTree(const BTree &) = delete;
   BTree &operator=(const BTree &) = delete;
@@ -27,8 +34,29 @@ public:
 
   std::string Name() const { return name_; }
 
+  const KeyOrder &Order() const { return order_; }
+
+  // Return the flags of a new page of the tree, only a tree in memcmp
+  // order has prefix pages.
+  char PageFlags(bool isLeaf) const;
+
+  // Return kNotFound if the tree has been deleted, or kInvalidArgument if
+  // the key does not fit the order of the tree.
+  Code CheckKey(const Slice &key) const;
+
+  // Mark the tree deleted, it is kept until the database is closed for
+  // the transactions still holding it. Cleared if the transaction deleting
+  // it rolls back.
+  void SetDeleted(bool deleted) { deleted_ = deleted; }
+
+  // The adaptive hash index of the tree, nullptr if it has none.
+  HashIndex *Hash() const { return hash_; }
+
 private:
   PageNo root_;
   std::string name_;
+  KeyOrder order_;
+  std::atomic<bool> deleted_;
+  HashIndex *hash_;
 }; // class Database
-} // namespace udb
\ No newline at end of file
+} // namespace udb
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/code.h"
+#include "common/slice.h"
+#include "common/types.h"
+#include "storage/overflow.h"
+
+namespace udb {
+class BTree;
+class KVIterator;
+class MemPage;
+class TxnImpl;
+
+// Build a b+tree bottom-up from entries in ascending key order. Leaves are
+// filled left to right up to the fill factor, and each finished page adds
+// its last key as a separator to the level above, so no key is searched
+// and no page is split. The top page is written into the root page. A
+// finished leaf is held back until the next one is allocated, to link it
+// to its sibling.
+class BulkLoader {
+public:
+  BulkLoader(TxnImpl *txn, BTree *tree, int fillPercent);
+
+  BulkLoader(const BulkLoader &) = delete;
+  BulkLoader &operator=(const BulkLoader &) = delete;
+
+  ~BulkLoader();
+
+  Code Load(KVIterator *iter);
+
+private:
+  // A cell of the page being built, its key and value are in the buffer of
+  // the level.
+  struct PendingCell {
+    uint32_t keyOffset_;
+    uint32_t keySize_;
+    uint32_t valueOffset_;
+    uint32_t valueSize_;
+    PageNo child_;
+    PageNo overflow_;       // The overflow chain of the value, if any.
+    uint64_t overflowSize_;
+  };
+
+  // The page being built at one level, 0 is the leaf level.
+  struct Level {
+    std::string buffer_;
+    std::vector<PendingCell> cells_;
+    int size_;       // Bytes of the cells and their cell pointers.
+    int prefixSize_; // The common prefix of the keys.
+    int pages_;      // Pages finished at this level.
+  };
+
+  // Add a cell to the level, finish its page first if the cell does not fit.
+  Code Add(int level, const Slice &key, const Slice &value, PageNo child);
+
+  // Write the cells of the level into a new page and add it to the level
+  // above.
+  Code FinishPage(int level);
+
+  // Write the cells of the level into the page. The last cell of an
+  // internal level only gives the right child.
+  Code WritePage(int level, MemPage *page);
+
+  // Finish the pages of all levels from the leaves up, the last one is
+  // written into the root page.
+  Code Finish();
+
+  // Write the cells of the level into the root page of the tree, return
+  // kPageFull if they do not fit, the root is left empty then.
+  Code WriteRoot(int level);
+
+  // Append the finished pages and the overflow pages to the log and unpin
+  // them.
+  Code WriteFinished();
+
+private:
+  TxnImpl *txn_;
+  BTree *tree_;
+  int pageSize_;
+  int fillPercent_;
+  bool prefixPages_;
+  bool intKeyPages_; // Keys are stored without their size.
+  bool linkedLeaves_;
+  int batchPages_;   // Finished pages appended to the log at once.
+  std::vector<Level> levels_;
+  std::vector<MemPage *> finished_;
+  MemPage *lastLeaf_; // The last leaf finished, nullptr before the first.
+  OverflowWriter overflow_;
+  std::string lastKey_;
+};
+} // namespace udb
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/code.h"
+#include "common/slice.h"
+#include "common/types.h"
+#include "storage/comparator.h"
+
+namespace udb {
+class BTree;
+class Cursor;
+class TxnImpl;
+
+// Bytes of the name of a tree or of a comparator, so that a catalog entry
+// never overflows.
+static const size_t kMaxTreeNameSize = 64;
+
+// The catalog entry of a tree.
+struct TreeInfo {
+  PageNo root_ = kInvalidPageNo;
+  KeyOrderKind order_ = kBytewiseOrder;
+  std::string comparator_; // The name of the comparator of the order.
+};
+
+// The named trees of the database, kept in a b+tree in memcmp order whose
+// root is in the file header(see page_layout.h). The catalog is read in
+// the snapshot of the transaction like any tree, so a tree created by a
+// writer is only seen by others once it commits.
+class Catalog {
+public:
+  explicit Catalog(TxnImpl *txn);
+
+  Catalog(const Catalog &) = delete;
+  Catalog &operator=(const Catalog &) = delete;
+
+  // Find the tree of the name, return kNotFound if there is none.
+  Code Find(const std::string &name, TreeInfo *info);
+
+  // Add the tree of the name in the order of info, with a new empty root.
+  // If another writer has committed a tree of the name meanwhile, return
+  // that one in info instead, and false in created.
+  Code Create(const std::string &name, TreeInfo *info, bool *created);
+
+  // Remove the tree of the name and free all its pages, return kNotFound
+  // if there is none. The transaction MUST run alone.
+  Code Remove(const std::string &name, TreeInfo *info);
+
+  // The root pages of the default tree, the catalog and the trees in it.
+  Code Roots(std::vector<PageNo> *roots);
+
+private:
+  // Return the tree of the catalog, nullptr if the database has none yet
+  // and create is false.
+  Code Open(bool create, BTree **tree);
+
+  // Put the pages of the tree into the freelist.
+  Code FreeTree(PageNo root);
+
+  // Parse the entry the cursor is at.
+  Code ReadInfo(TreeInfo *info);
+
+private:
+  TxnImpl *txn_;
+  Cursor *cursor_;
+};
+} // namespace udb
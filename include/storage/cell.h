@@ -1,6 +1,9 @@
 #pragma once
 
+#include <string>
+
 #include "common/code.h"
+#include "common/slice.h"
 #include "common/types.h"
 
 namespace udb {
@@ -11,6 +14,21 @@ enum CellType {
   LeafCell = 2,
 };
 
+// The content of a cell to be written into a page, key is the full key.
+// value is the local part of the value if it has an overflow chain.
+struct CellData {
+  Slice key_;
+  Slice value_;      // Leaf cells only.
+  PageNo leftChild_; // Internal cells only.
+  PageNo overflow_ = kInvalidPageNo; // First page of the overflow chain.
+  uint64_t overflowSize_ = 0;        // Bytes of the value on the chain.
+};
+
+// Bytes of a value of valueSize kept in the leaf cell, the rest goes to an
+// overflow chain. An entry which does not fit in a quarter of the page
+// keeps just enough bytes locally that the last overflow page is full.
+uint64_t LocalValueSize(int pageSize, int keySize, uint64_t valueSize);
+
 class Cell {
 public:
   Cell();
@@ -20,7 +38,12 @@ public:
 
   ~Cell();
 
-  Code ParseFrom(const unsigned char *data);
+  // Parse the cell content at data, of a leaf page of pageSize if isLeaf
+  // is true. The cell of a prefix page only stores the key bytes after the
+  // prefix, the cell of an intkey page has a fixed-size key.
+  Code ParseFrom(const char *data, bool isLeaf, int pageSize,
+                 const char *prefix = nullptr, uint16_t prefixSize = 0,
+                 bool intKey = false);
 
   bool IsInvalid() const { return type_ == InvalidCell; }
   bool IsLeafPageCell() const { return type_ == LeafCell; };
@@ -28,18 +51,33 @@ public:
 
   void Reset();
   bool IsEmpty() const { return cellSize_ == 0; }
+  // The key bytes stored in the cell, after the page prefix.
   uint16_t KeySize() const { return keySize_; }
   const char *Key() const { return key_; }
-  uint16_t PayloadSize() const { return payLoadSize_; }
+  uint16_t PrefixSize() const { return prefixSize_; }
+  int FullKeySize() const { return prefixSize_ + keySize_; }
+  // Append the full key to key.
+  void AppendKey(std::string *key) const;
+  // Bytes of the whole value.
+  uint64_t PayloadSize() const { return payLoadSize_; }
+  // The bytes of the value held in the cell.
+  const char *Payload() const { return payload_; }
+  uint16_t LocalSize() const { return localSize_; }
+  // The first overflow page, kInvalidPageNo if the value is all local.
+  PageNo Overflow() const { return overflow_; }
+  uint16_t CellSize() const { return cellSize_; }
 
 private:
+  const char *prefix_;   // The prefix of the page, not part of the cell.
+  uint16_t prefixSize_;
   uint16_t keySize_;
-  uint16_t payLoadSize_; // Bytes of payload.
-  char *key_;            // Pointer to the start of the key.
-  char *payload_;        // Pointer to the start of the payload.
+  uint64_t payLoadSize_; // Bytes of payload.
+  const char *key_;      // Pointer to the start of the key.
+  const char *payload_;  // Pointer to the start of the payload.
   uint16_t localSize_;   // Amount of payload held locally, not on overflow.
   uint16_t cellSize_;    // Size of the cell content on the main b-tree page.
   PageNo leftChild_;     // The left child page number(if any).
+  PageNo overflow_;      // The first overflow page number(if any).
   CellType type_;
 };
 } // namespace udb
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "common/slice.h"
+#include "udb.h"
+
+namespace udb {
+// The kind of the order of a tree, kept in the catalog. The page search is
+// specialised for each built-in order, a custom order goes through the
+// virtual Comparator::Compare.
+enum KeyOrderKind : uint8_t {
+  kBytewiseOrder = 0,
+  kU64Order = 1,
+  kReverseOrder = 2,
+  kCustomOrder = 3,
+  kIntKeyOrder = 4, // kU64Order on intkey pages, see page_layout.h.
+};
+
+// Bytes of the keys of a kU64Order tree.
+static const size_t kU64KeySize = 8;
+
+// Return an 8-byte key as a big-endian integer.
+inline uint64_t U64Key(const char *key) {
+  uint64_t v;
+  memcpy(&v, key, sizeof(v));
+  return __builtin_bswap64(v);
+}
+
+// The order of the keys of a tree.
+struct KeyOrder {
+  KeyOrderKind kind_ = kBytewiseOrder;
+  const Comparator *comparator_ = BytewiseComparator();
+
+  // Return the order of the comparator, nullptr for the bytewise order.
+  static KeyOrder Of(const Comparator *comparator);
+
+  // Return the comparator of a built-in order, nullptr for kCustomOrder.
+  static const Comparator *Builtin(KeyOrderKind kind);
+
+  // Only the trees in memcmp order have prefix pages and truncated
+  // separators, which rely on keys sharing a prefix being adjacent.
+  bool IsBytewise() const { return kind_ == kBytewiseOrder; }
+
+  int Compare(const Slice &a, const Slice &b) const {
+    switch (kind_) {
+    case kBytewiseOrder:
+      return a.Compare(b.Data(), b.Size());
+    case kU64Order:
+    case kIntKeyOrder: {
+      uint64_t x = U64Key(a.Data());
+      uint64_t y = U64Key(b.Data());
+      return x < y ? -1 : x > y;
+    }
+    case kReverseOrder:
+      return b.Compare(a.Data(), a.Size());
+    default:
+      return comparator_->Compare(a, b);
+    }
+  }
+};
+} // namespace udb
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <span>
+#include <string>
+
 #include "common/limits.h"
 #include "common/slice.h"
 #include "common/status.h"
@@ -27,26 +30,128 @@ public:
   void Reset();
   Code MoveTo(BTree *, const Slice &key);
 
+  // Like MoveTo, but a reader goes to the leaf cell the adaptive hash
+  // index of the tree has for the key, if it still holds the key, and
+  // the cursor is detached from the path then. A key found from the root
+  // is added to the index.
+  Code MoveToHashed(BTree *, const Slice &key);
+
+  // Move to the first cell not less than the key. Return kNotFound if
+  // there is none, the cursor is invalid then.
+  Code Seek(BTree *, const Slice &key);
+
+  // Move to the first or the last cell of the tree. Return kNotFound if
+  // the tree is empty.
+  Code SeekToFirst(BTree *);
+  Code SeekToLast(BTree *);
+
+  // Move to the key from the current position, only climbing up to the
+  // lowest page whose subtree may hold the key. The key MUST NOT be less
+  // than the key the cursor was last moved to in the same tree.
+  Code MoveNear(BTree *, const Slice &key);
+
+  // Prefetch the leaves holding the keys, as long as they are under the
+  // parent of the current leaf. The keys MUST be sorted and not less than
+  // the current key. Return the number of keys looked at.
+  int PrefetchLeaves(std::span<const Slice> keys);
+
+  // Move to the next cell in key order, from the cell after the position
+  // of the last MoveTo if it was not found. Return kNotFound after the
+  // last cell, the cursor is invalid then. For a writer, return kConflict
+  // if a page on the way has been committed by another writer, the cursor
+  // has to be moved to the key again.
+  //
+  // A reader moves to the right sibling of a linked leaf without going
+  // through the parents when the sibling is cached or the path is already
+  // left, the cursor is detached from the path then. It goes through the
+  // parents again when the next leaf is cold, so that readahead hints the
+  // leaves ahead.
+  Code Next();
+
+  // Move to the previous cell in key order.
+  Code Prev();
+
   CursorLocation Location() const { return location_; }
-  uint16_t KeySize() const { return cell_.KeySize(); }
-  uint16_t PayloadSize() const { return cell_.PayloadSize(); }
+  int KeySize() const { return cell_.FullKeySize(); }
+  uint64_t PayloadSize() const { return cell_.PayloadSize(); }
 
   bool IsValid() const { return location_ != Invalid; }
 
+  // The tree of the last move.
+  BTree *Tree() const { return tree_; }
+
   Cell *MutCell() { return &cell_; }
   MemPage *Page() { return page_; }
 
-  int8_t CellIndex() const { return cellIndex_; }
+  int CellIndex() const { return cellIndex_; }
+
+  // Parse the cell the cursor is pointing at into MutCell().
   void GetCell();
 
-  Status Overwrite(const Slice &key, const Slice &value);
+  // Replace the current page with a copy the writer can modify. Return
+  // kConflict if the page has been committed by another writer since, the
+  // cursor is reset then and has to be moved again.
+  Code MarkDirty();
+
+  // Like MarkDirty, for the page at the level of the path from the root to
+  // the current page, the root is at level 0.
+  Code MarkDirty(int level);
+
+  // The level of the current page.
+  int Depth() const { return curIndex_; }
+
+  // The page at the level of the path.
+  MemPage *PathPage(int level) { return pageStack_[level]; }
+
+  // The index of the child of the page at the level the path goes through,
+  // the cell number of the page if it is the right child.
+  int PathChild(int level) const { return childCell_[level]; }
 
 private:
   Code MoveToRoot();
   Code MoveToChild(PageNo chidNo);
 
+  // Search the key from the current page down to the leaf.
+  Code Descend(const Slice &key);
+
+  // Return kConflict if the parent of the current page is no longer the
+  // latest version, so that the current page may not be the right child.
+  // Writers read the pages without latches, and validate each parent
+  // after reading its child instead(optimistic lock coupling).
+  Code ValidateParent();
+
+  // Return true if the key is not greater than the max key of the subtree
+  // of pageStack_[level].
+  bool InSubtree(int level, const Slice &key) const;
+
   void ParseCell();
-  void Reset();
+
+  // Move to the cell next to the current one in the direction(1 or -1).
+  Code Step(int dir);
+
+  // Move to the first(dir 1) or last(dir -1) cell of the neighbouring leaf
+  // that has cells, through the parents in pageStack_ or the siblings.
+  Code StepLeaf(int dir);
+
+  // Move to the right sibling of the leaf if Next() takes it instead of
+  // the path, and set stepped then. Return kNotFound after the last leaf.
+  Code StepSibling(bool *stepped);
+
+  // Load the path from the root to the detached leaf again.
+  Code Attach();
+
+  // Descend from the current page through the child in childCell_, then
+  // along the edge of the subtree facing the direction down to a leaf.
+  Code DescendEdge(int dir);
+
+  // Move to the first(dir 1) or last(dir -1) cell of the tree.
+  Code SeekToEdge(BTree *tree, int dir);
+
+  // Hint the leaves ahead of the current one in the direction once the
+  // cursor is halfway through the ones already hinted. The window doubles
+  // on each hint while the cursor keeps stepping through the leaves.
+  void Readahead(int dir);
+  void ResetReadahead();
 
 private:
   TxnImpl *txn_;
@@ -55,9 +160,22 @@ private:
   Cell cell_;   // A parse of the cell we are pointing at.
   PageNo root_; // root page no of BTree
   CursorLocation location_;
-  int8_t cellIndex_;                      // Index of cursor in current page.
+  int cellIndex_;                         // Index of cursor in current page.
   int8_t curIndex_;                       // Index of current page in pageStack_
+  // The leaf was reached through a sibling, pageStack_[0] holds it and
+  // not the root.
+  bool detached_;
+  std::string seekKey_; // The key of the leaf to attach to.
   MemPage *page_;                         // current page
   MemPage *pageStack_[kTreeMaxDepth - 1]; // Stack of parents of current page
+  // Index of the cell of pageStack_[i] whose child is pageStack_[i + 1],
+  // the cell number of the page if it is the right child.
+  int childCell_[kTreeMaxDepth - 1];
+
+  // Sequential readahead of the leaves under the parent raParent_.
+  PageNo raParent_; // kInvalidPageNo if not stepping through the leaves.
+  int8_t raDir_;
+  int raWindow_; // Leaves hinted at a time.
+  int raNext_;   // Index of the next child of raParent_ to hint.
 };
 } // namespace udb
\ No newline at end of file
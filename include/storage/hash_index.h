@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/slice.h"
+#include "common/types.h"
+
+namespace udb {
+
+// The adaptive hash index of a tree, in the spirit of InnoDB's. It maps
+// the keys readers found to the leaf cell they were found at, so that a
+// hot key is read with one probe and one page instead of the path from
+// the root. It is only used while the tree is looked up far more often
+// than written.
+//
+// The index is a table of buckets of two slots taken by the hash of the
+// key, a key replaces one of its bucket. A slot keeps a tag of the hash
+// and not the key, so an entry is only a hint: the reader checks it against
+// the page it reads, see Cursor::MoveToHashed. Freed pages keep their old
+// image, so an entry is also only trusted if no commit freed pages between
+// the snapshot that made it and the one reading it, see
+// BufferManager::LastFreeLsn.
+class HashIndex {
+public:
+  // Where a key was found, by the reader of the snapshot.
+  struct Entry {
+    PageNo page_;
+    int index_;
+    uint64_t version_; // The version of the page, see MemPage::Version.
+    uint64_t snapshot_;
+  };
+
+  // Keep about capacity entries, the table is allocated once the index is
+  // first turned on.
+  explicit HashIndex(int capacity);
+
+  HashIndex(const HashIndex &) = delete;
+  HashIndex &operator=(const HashIndex &) = delete;
+
+  ~HashIndex();
+
+  // True if the lookups of the tree go through the index.
+  bool IsActive() const { return active_.load(std::memory_order_relaxed); }
+
+  // Count a lookup or a write of the tree. The index is turned on after
+  // kBuildScore more lookups than kWriteWeight times the writes, and off
+  // once the writes catch up.
+  void RecordLookup();
+  void RecordWrite();
+
+  // Return true and the entry of the key if there is one.
+  bool Find(const Slice &key, Entry *entry) const;
+
+  // Set the entry of the key, in place of any other in its slot.
+  void Insert(const Slice &key, const Entry &entry);
+
+private:
+  static const int kBuildScore = 256;
+  static const int kWriteWeight = 4;
+
+  // A slot is read without a latch. The low 32 bits of tag_ hold the tag
+  // of the key hash, the high ones a sequence number which is odd while
+  // the slot is being written, so that a reader drops the entry it read
+  // if the number changed meanwhile.
+  struct Slot {
+    std::atomic<uint64_t> tag_;
+    std::atomic<uint64_t> location_; // The page, and the cell index.
+    std::atomic<uint64_t> version_;
+    std::atomic<uint64_t> snapshot_;
+  };
+
+  // The slots of a bucket share a cache line, so a probe reads one.
+  struct alignas(64) Bucket {
+    Slot slots_[2];
+  };
+
+  static uint64_t Hash(const Slice &key);
+
+  size_t mask_; // Buckets less 1, a power of 2 less 1.
+  // Lookups less kWriteWeight times the writes, in [0, kBuildScore]. A
+  // lookup only stores it while below the top, so that the readers of a
+  // read-only tree do not bounce its cache line.
+  std::atomic<int> score_;
+  std::atomic<bool> active_;
+  std::atomic<Bucket *> buckets_;
+};
+} // namespace udb
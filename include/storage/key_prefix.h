@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace udb {
+// Return the first 4 bytes of the key as a big-endian integer, padded with
+// zero. Comparing the prefixes of two keys as integers gives the order of
+// the keys, except that equal prefixes need a full key comparison.
+inline uint32_t KeyPrefix(const char *key, size_t size) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(key);
+  uint32_t prefix = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    prefix = (prefix << 8) | (i < size ? p[i] : 0);
+  }
+  return prefix;
+}
+
+// Return the index of the first prefix not less than key in the sorted
+// array, like std::lower_bound.
+int PrefixLowerBound(const uint32_t *prefixes, int n, uint32_t key);
+
+// Return the index of the first prefix greater than key in the sorted
+// array, like std::upper_bound.
+int PrefixUpperBound(const uint32_t *prefixes, int n, uint32_t key);
+
+// Return the index of the first key not less than key in the sorted array
+// of distinct keys, like std::lower_bound, by interpolation search.
+int IntKeyLowerBound(const uint64_t *keys, int n, uint64_t key);
+} // namespace udb
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/code.h"
+#include "common/slice.h"
+#include "common/types.h"
+#include "udb.h"
+
+namespace udb {
+class Cursor;
+class MemPage;
+
+// Put the pages of the overflow chain holding size bytes into the freelist
+// when the writer of the snapshot commits.
+Code FreeOverflow(PageNo first, uint64_t size, uint64_t snapshot);
+
+// Write the parts of values beyond their local bytes into chains of new
+// overflow pages. Each chain is allocated as one run of free pages, or at
+// the end of the file, so that it is contiguous in the file; only when the
+// freelist is fragmented it is pieced together from the longest extents.
+// No committed page refers to a new chain, so long chains are appended to
+// the log in batches ahead of the transaction and do not fill the buffer
+// pool with dirty pages.
+class OverflowWriter {
+public:
+  // Allocate the pages for the writer of the snapshot.
+  explicit OverflowWriter(uint64_t snapshot);
+
+  OverflowWriter(const OverflowWriter &) = delete;
+  OverflowWriter &operator=(const OverflowWriter &) = delete;
+
+  // Unpin the pages not yet appended to the log, they stay dirty and are
+  // committed with the transaction.
+  ~OverflowWriter();
+
+  // Write data into a new chain and return its first page.
+  Code Write(const Slice &data, PageNo *first);
+
+  // Append the pinned pages to the log.
+  Code Flush();
+
+private:
+  // Append the pages but the last one, whose next page is not known yet.
+  Code Flush(size_t n);
+
+private:
+  uint64_t snapshot_;
+  int batchPages_; // Pages appended to the log at once.
+  std::vector<MemPage *> pages_;
+};
+
+// Read a value in chunks: a copy of the local bytes in the leaf cell, then
+// one chunk per overflow page straight from the pinned pages of the buffer
+// pool.
+class ValueStream : public ValueReader {
+public:
+  explicit ValueStream(uint64_t snapshot);
+
+  ValueStream(const ValueStream &) = delete;
+  ValueStream &operator=(const ValueStream &) = delete;
+
+  ~ValueStream() override;
+
+  // Start at the entry the cursor is at, which MUST be Equal.
+  Code Open(Cursor *cursor);
+
+  uint64_t Size() const override { return size_; }
+
+  Status Next(Slice *chunk) override;
+
+  // Read the next chunk, as Next.
+  Code NextChunk(Slice *chunk);
+
+private:
+  void Release();
+
+private:
+  uint64_t snapshot_;
+  MemPage *page_;     // The overflow page of the last chunk.
+  std::string local_; // The local bytes of the value in the leaf.
+  bool localRead_;    // True once the local bytes are returned.
+  PageNo next_;       // The next overflow page to read.
+  PageNo hinted_;     // Overflow pages before it have been hinted.
+  uint64_t size_;     // Bytes of the value.
+  uint64_t remain_;   // Bytes of the value not returned yet.
+};
+} // namespace udb
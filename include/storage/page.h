@@ -5,13 +5,24 @@
 #include "common/types.h"
 
 namespace udb {
+// The disk image of a page.
 class UDB_EXPORT Page {
 public:
+  Page() : data_(nullptr), pageNo_(kInvalidPageNo), size_(0) {}
+
+  void Init(PageNo no, char *data, int size) {
+    pageNo_ = no;
+    data_ = data;
+    size_ = size;
+  }
+
   char *Data() { return data_; }
   PageNo DiskPageNo() const { return pageNo_; }
+  int Size() const { return size_; }
 
 private:
   char *data_;
   PageNo pageNo_;
+  int size_; // Bytes of the page image.
 };
-} // namespace udb
\ No newline at end of file
+} // namespace udb
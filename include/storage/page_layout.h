@@ -24,21 +24,75 @@
  **      | area           |   |  and free space fragments.
  **      |----------------|
  **
+ ** The file header looks like this(all integers are big-endian):
+ **
+ **   OFFSET   SIZE     DESCRIPTION
+ **      0      16      Header string "udb format 1\000"
+ **     16       2      Page size, 1 means 65536
+ **     18       1      Page format. Bit 0x01: prefix-compressed keys, bit
+ **                     0x02: linked leaves, bit 0x04: compressed pages
+ **     19       1      Compression of the pages, see CompressionType
+ **     20      12      Reserved, zero
+ **     32       4      Page number of the first freelist trunk page
+ **     36       4      Total number of freelist pages
+ **     40       4      Root page of the catalog, 0 if there is none yet
+ **     44      56      Reserved, zero
+ **
+ ** Page 1 is also the root page of the default b+tree. The catalog is a
+ ** b+tree from the name of each other tree to its root page and the order
+ ** of its keys, created with the first of them. Its entries look like this:
+ **
+ **   OFFSET   SIZE     DESCRIPTION
+ **      0       4      Root page of the tree
+ **      4       1      Order of the keys, see KeyOrderKind
+ **      5       *      Name of the comparator of the order
+ **
+ ** The page format is chosen when the file is created. Files of format 0
+ ** never have prefix-compressed pages, so they can still be read by older
+ ** versions of udb. The leaves of files with linked leaves all have the
+ ** linked flag, those of older files never. The pages of files with
+ ** compressed pages may be compressed in the file(see compression.h), the
+ ** format bit keeps older versions of udb from reading them.
+ **
  ** The page headers looks like this:
  **
  **   OFFSET   SIZE     DESCRIPTION
- **      0       1      Flags. 1: internal-page, 2: leaf-page
+ **      0       1      Flags. 1: internal-page, 2: leaf-page, bit 0x10: prefix,
+ **                     bit 0x20: intkey, bit 0x40: linked
  **      1       2      byte offset to the first freeblock
  **      3       2      number of cells on this page
- **      5       2      first byte of the cell content area
+ **      5       2      first byte of the cell content area, 0 means 65536
  **      7       1      number of fragmented free bytes
  **      8       4      Right child (the Ptr(N) value).  Omitted on leaves.
+ **      8       4      Right sibling of a linked leaf, 0 for the last leaf.
+ **                     Omitted on other leaves.
  **
  ** The flags define the format of this b+tree page.  The internal-page flag
  ** means that this page carries only keys and no data.
  ** The leaf-page flag means that this page has no children.
  **
- ** The cell pointer array begins on the first byte after the page header.
+ ** If the prefix flag is set, the page header is followed by the common
+ ** prefix of all keys of the page, and each cell only stores the key bytes
+ ** after the prefix:
+ **
+ **    SIZE    DESCRIPTION
+ **      2     Number of bytes of the prefix, may be 0
+ **      *     The prefix
+ **
+ ** The prefix is chosen when the page is rebuilt(defragmented or split), as
+ ** the common prefix of its first and last keys. Inserting a key without
+ ** the prefix rebuilds the page with a shorter one.
+ **
+ ** A linked leaf points at the next leaf of its tree in key order, so that
+ ** a scan moves from leaf to leaf without going through their parents.
+ **
+ ** The pages of an intkey tree have the intkey flag set and never the
+ ** prefix flag. Their keys are 8-byte big-endian integers, stored without
+ ** their size at a fixed place in the cell(see below), so that the keys of
+ ** a page are read without parsing the cells.
+ **
+ ** The cell pointer array begins on the first byte after the page header
+ ** (and the prefix).
  ** The cell pointer array contains zero or more 2-byte numbers which are
  ** offsets from the beginning of the page to the cell content in the cell
  ** content area. The cell pointers occur in sorted order.  The system strives
@@ -49,7 +103,8 @@
  ** beginning of the page.
  **
  ** Unused space within the cell content area is collected into a linked list of
- ** freeblocks.  Each freeblock is at least 4 bytes in size.  The byte offset
+ ** freeblocks(udb does not chain freeblocks yet, the space of a dropped cell
+ ** is reclaimed by defragmenting the page).  Each freeblock is at least 4 bytes in size.  The byte offset
  ** to the first freeblock is given in the header.  Freeblocks occur in
  ** increasing order.  Because a freeblock must be at least 4 bytes in size,
  ** any group of 3 or fewer unused bytes in the cell content area cannot
@@ -94,6 +149,22 @@
  **      *     Payload
  **      4     First page of the overflow chain.  Omitted if no overflow
  **
+ ** The cell of an intkey page looks like this instead:
+ **
+ **    SIZE    DESCRIPTION
+ **      8     Key of a leaf cell. Omitted if the internal flag is set.
+ **      4     Page number of the left child. Omitted if leaf page flag is set.
+ **      8     Key of an internal cell. Omitted if leaf page flag is set.
+ **     var    Number of bytes of data. Omitted if the internal flag is set.
+ **      *     Data
+ **      4     First page of the overflow chain.  Omitted if no overflow
+ **
+ ** A value too large for the cell keeps only its first bytes in the cell,
+ ** the number of them follows from the page size, the full key size and the
+ ** value size(see LocalValueSize in cell.h), the rest is on the overflow
+ ** chain. The pages of a chain are allocated in a row, so they are usually
+ ** contiguous in the file and read back with large requests.
+ **
  ** Overflow pages form a linked list.  Each page except the last is completely
  ** filled with data (pagesize - 4 bytes).  The last page can have as little
  ** as 1 byte of data.
@@ -117,21 +188,48 @@ namespace udb {
 // Page 1 header offset
 static const uint16_t kPage1HeaderOffset = 100;
 
+// File header field offsets
+static const uint16_t kFileHeaderStringOffset = 0;
+static const uint16_t kFileHeaderPageSizeOffset = 16;
+static const uint16_t kFileHeaderPageFormatOffset = 18;
+static const uint16_t kFileHeaderCompressionOffset = 19;
+static const uint16_t kFileHeaderFreelistTrunkOffset = 32;
+static const uint16_t kFileHeaderFreelistCountOffset = 36;
+static const uint16_t kFileHeaderCatalogRootOffset = 40;
+
+static const char kFileHeaderString[] = "udb format 1";
+
+// Page formats
+static const uint8_t kPlainPageFormat = 0;
+static const uint8_t kPrefixPageFormat = 1;
+static const uint8_t kLinkedLeafFormat = 2;
+static const uint8_t kCompressedPageFormat = 4;
+
 // Page header size.
 static const uint16_t kInternalPageHeaderSize = 12;
 static const uint16_t kLeafPageHeaderSize = 8;
+static const uint16_t kLinkedLeafPageHeaderSize = 12;
 
 // Offset of cell pointers array.
-#define kCellPtrOffet (headerOffset_ + headerSize_)
+#define kCellPtrOffet (headerOffset_ + headerSize_ + prefixAreaSize_)
 
 // Page header field offsets
 static const uint16_t kPageFlagHeaderOffset = 0;
 static const uint16_t kFirstFreeblockHeaderOffset = 1;
 static const uint16_t kCellNumberHeaderOffset = 3;
 static const uint16_t kCellContentHeaderOffset = 5;
+static const uint16_t kFragmentedBytesHeaderOffset = 7;
 static const uint16_t kRightChildPageNoHeaderOffset = 8;
+static const uint16_t kRightSiblingHeaderOffset = 8;
+
+// Bytes of the next page number at the start of an overflow page.
+static const uint16_t kOverflowHeaderSize = 4;
 
 // Page flags
 static const char kInternalPage = 1;
 static const char kLeafPage = 2;
+static const char kPageTypeMask = 0x0f;
+static const char kPrefixPage = 0x10;
+static const char kIntKeyPage = 0x20;
+static const char kLinkedPage = 0x40;
 } // namespace udb
\ No newline at end of file
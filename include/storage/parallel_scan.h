@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common/code.h"
+#include "common/slice.h"
+#include "common/status.h"
+#include "udb.h"
+
+namespace udb {
+class BTree;
+class Cursor;
+class TxnImpl;
+
+// Scan a key range of a tree with many threads. The range is cut at the
+// separator keys of the upper levels of the tree into parts of about the
+// same number of leaves, a few for each thread. Each thread scans the
+// parts of its own queue with its own cursor, and steals from the back of
+// the queues of the others once its own is empty. While a thread waits
+// for work, the busy ones cut the rest of their parts in two and queue the
+// second halves, so that a large part does not hold up the end of a scan.
+class ParallelScanner {
+public:
+  ParallelScanner(TxnImpl *txn, BTree *tree, const ScanCallback &callback);
+
+  ParallelScanner(const ParallelScanner &) = delete;
+  ParallelScanner &operator=(const ParallelScanner &) = delete;
+
+  Status Run(const Slice &start, const Slice &end, int threads);
+
+private:
+  // Keys from start_ up to end_, an empty one is no bound.
+  struct Part {
+    std::string start_;
+    std::string end_;
+  };
+
+  // Find at most parts - 1 keys between start and end that cut the range
+  // into parts of about the same number of leaves, in key order. They are
+  // the separators of the highest level of the tree that has enough of
+  // them in the range, fewer if the range spans few leaves.
+  Code Cut(const Slice &start, const Slice &end, int parts,
+           std::vector<std::string> *keys) const;
+
+  // Scan the parts taken from the queues until none are left.
+  void Work(int worker);
+
+  // Take a part from the queue of the worker, or from another queue, and
+  // wait for one while other workers may still queue some. Return false
+  // when the scan is over.
+  bool Take(int worker, Part *part);
+
+  void Queue(int worker, Part part);
+
+  // Scan the part with the cursor, cutting it when other workers wait.
+  Code Scan(int worker, Cursor *cursor, Part *part);
+
+private:
+  TxnImpl *txn_;
+  BTree *tree_;
+  const ScanCallback &callback_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<std::deque<Part>> queues_;
+  int queued_; // Parts in all the queues.
+  int busy_;   // Workers scanning a part.
+  Status status_;
+
+  // Read on each entry without the mutex.
+  std::atomic<bool> stop_;
+  std::atomic<int> idle_; // Workers waiting for a part.
+};
+} // namespace udb
@@ -1,16 +1,24 @@
 #pragma once
 
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "buffer/buffer_manager.h"
+#include "common/arena.h"
 #include "common/code.h"
-#include "common/limits.h"
 #include "storage/udb_impl.h"
 
 namespace udb {
 
 class Cursor;
+class MemPage;
+struct CellData;
 
 class TxnImpl : public Txn {
 public:
-  TxnImpl(bool write, int lockIndex);
+  TxnImpl(bool write, int lockIndex, uint64_t snapshot);
 
   TxnImpl() = default;
 
@@ -19,8 +27,23 @@ public:
 
   virtual ~TxnImpl() override;
 
-  virtual Status OpenTree(const std::string &name, BTree **,
-                          bool createIfNotExists) override;
+  // Return a transaction from the pool of the calling thread, or a new one
+  // if the pool is empty. The cursor and buffers of a pooled transaction
+  // are reused as they are.
+  static TxnImpl *New(bool write, int lockIndex, uint64_t snapshot);
+
+  // End the transaction and put it into the pool of the calling thread,
+  // or delete it if the pool is full.
+  static void Free(TxnImpl *txn);
+
+  // Unpin the pages of the transaction and free the values it returned,
+  // MUST be called before its snapshot or its writer lock ends.
+  void End();
+
+  using Txn::OpenTree;
+
+  virtual Status OpenTree(const std::string &name, const TreeOptions &options,
+                          BTree **, bool createIfNotExists) override;
 
   virtual Status DeleteTree(const std::string &name) override;
 
@@ -30,16 +53,87 @@ public:
 
   virtual Status Get(BTree *, const Slice &key, Slice *value) override;
 
+  virtual Status GetStream(BTree *, const Slice &key,
+                           ValueReader **reader) override;
+
+  virtual void MultiGet(BTree *, std::span<const Slice> keys,
+                        std::vector<Slice> *values,
+                        std::vector<Status> *statuses) override;
+
+  virtual Status Scan(BTree *, const Slice &start, const Slice &end,
+                      const ScanCallback &callback) override;
+
+  virtual Status ParallelScan(BTree *, const Slice &start, const Slice &end,
+                              int threads,
+                              const ScanCallback &callback) override;
+
+  virtual Status BulkLoad(BTree *, KVIterator *iter, int fillPercent) override;
+
+  virtual Status IncrementalVacuum(int maxPages, int *pages) override;
+
   int LockIndex() const { return lockIndex_; }
 
+  // The snapshot pages are read from, the writer snapshot for a writer.
+  uint64_t Snapshot() const { return snapshot_; }
+
+  // The error of the write that failed, the writer can only roll back
+  // then, since the write may have left its pages half changed.
+  const Status &Error() const { return error_; }
+
+  // The pages the values and the keys found or not found were read from,
+  // by a writer.
+  const ReadSet &Reads() const { return reads_; }
+
+  // Record the leaf the cursor of a writer read, see BufferManager::Commit.
+  // A page the writer has changed can not be changed by another one.
+  void RecordRead(MemPage *page);
+
+  // Undo the changes to the trees of the database, the writer has rolled
+  // back.
+  void RolledBack();
+
 private:
-  Code FillInCell(const Slice &key, const Slice &value, char *cell,
-                  int *cellSize);
+  friend class Catalog;
+  friend class ParallelScanner;
+
+  // Return the default tree if tree is nullptr.
+  BTree *Tree(BTree *tree) const;
+
+  // Move the cursor to the key with the leaf modifiable, again as long as
+  // other writers commit the leaf meanwhile.
+  Code MoveToWrite(BTree *tree, const Slice &key);
+
+  // Put the cell at the position of the cursor, whose leaf is modifiable,
+  // splitting the leaf if it has no room.
+  Code Put(const CellData &data);
+
+  // Check the bounds of a scan, an empty one is no bound.
+  Code CheckRange(BTree *tree, const Slice &start, const Slice &end) const;
+
+  // Scan with the cursor, see Scan. The end is compared with each key, so
+  // the callback may bring it closer.
+  Code ScanRange(Cursor *cursor, BTree *tree, const Slice &start,
+                 const Slice &end, const ScanCallback &callback);
+
+  // Copy the value of the entry the cursor is at into the transaction.
+  Status ReadValue(Slice *value);
+
+  // Keep the error of a failed write, which the writer returns from then.
+  Status Fail(const Status &status);
 
 public:
   bool write_;
   int lockIndex_;
+  uint64_t snapshot_;
   Cursor *cursor_;
-  char tmpSpace[kPageSize];
+  // The values returned by Get, freed when the transaction ends.
+  Arena arena_;
+  Status error_;
+  ReadSet reads_;
+  // The trees created and deleted by a writer, by name and root.
+  std::vector<std::pair<std::string, PageNo>> created_;
+  std::vector<std::pair<std::string, PageNo>> deleted_;
+  // The threads of a parallel scan record their reads together.
+  std::mutex readsMutex_;
 };
 } // namespace udb
\ No newline at end of file
@@ -1,12 +1,19 @@
 #pragma once
 
 #include "common/types.h"
+#include "storage/comparator.h"
 #include "udb.h"
+#include <condition_variable>
 #include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace udb {
 
 class BTree;
+class TxnImpl;
 
 class DBImpl : public Database {
 public:
@@ -20,22 +27,92 @@ public:
   // Implementations of the Database interface
   virtual Txn *Begin(bool write) override;
 
+  // Commit and delete the transaction, the changes of a write transaction
+  // are durable in the log when it returns.
   virtual Status Commit(Txn *) override;
 
+  virtual Status Abort(Txn *) override;
+
+  virtual void GetStats(Stats *) override;
+
   // Close the database, Returns OK on success.
   virtual Status Close(Database *) override;
 
   static DBImpl *Instance();
 
+  // Open the database file.
+  Status Open();
+
+  // Return the flags of a new page of the file's page format, for a tree
+  // of the order.
+  char PageFlags(bool isLeaf, KeyOrderKind order = kBytewiseOrder) const;
+
+  // The tree rooted at page 1.
+  BTree *DefaultTree() const { return default_tree_; }
+
+  // Return the tree of the name rooted at root, the same one to all
+  // transactions until it is deleted.
+  BTree *Tree(const std::string &name, PageNo root, const KeyOrder &order);
+
+  // Mark the tree of the name rooted at root deleted, if any.
+  void DeleteTree(const std::string &name, PageNo root);
+
+  // Undo DeleteTree, the transaction deleting the tree has rolled back.
+  void RestoreTree(const std::string &name, PageNo root);
+
+  // Make the calling write transaction the only one until it commits, for
+  // the work that changes pages no writer locks. Return kBusy if other
+  // write transactions are running.
+  Code RunAlone();
+
 private:
-  // Lock and return the index.
-  int Lock(bool write);
+  // Return the page size of an existing database, from the file header or
+  // from the log if the file has none yet, 0 for a new database.
+  Code ReadPageSize(int *pageSize);
+
+  // Write the file header of a new database, page 1 is an empty leaf.
+  Code CreateFileHeader();
+
+  // Check the file header of an existing database.
+  Code ReadFileHeader();
+
+  // Lock and return the index and the snapshot of the transaction. A
+  // reader gets its reader slot and the latest commit as snapshot, a
+  // writer gets kWriterLockIndex and its writer snapshot.
+  Code Lock(bool write, int *lockIndex, uint64_t *snapshot);
 
   void Unlock(int lockIndex);
 
+  // End the transaction without committing it, the changes of a writer
+  // are dropped if rollback.
+  Code End(TxnImpl *txn, bool rollback);
+
+  // Entries of the adaptive hash index of a tree, 0 if it has none.
+  int HashCapacity() const;
+
+  // Write the stats to stderr every statsDumpPeriodSec_ until stopped.
+  void DumpStats();
+
 private:
-  std::map<std::string, BTree *> tree_map_;
+  static const int kWriterLockIndex = -1;
+
+  Options options_;
+  std::string path_;
+  BufferManager *pager_;
+  uint8_t pageFormat_; // Bits of the page formats of page_layout.h.
+  std::mutex writerMutex_; // Protects writers_ and alone_.
+  std::condition_variable writerDone_;
+  int writers_; // Running write transactions.
+  bool alone_;  // A write transaction runs alone.
+  std::mutex treeMutex_; // Protects tree_map_ and deleted_trees_.
+  std::map<std::pair<std::string, PageNo>, BTree *> tree_map_;
+  std::vector<BTree *> deleted_trees_;
   BTree *default_tree_;
+  Stats baseStats_; // The counters of the process when opened.
+  std::mutex dumpMutex_; // Protects stopDump_.
+  std::condition_variable dumpWake_;
+  bool stopDump_;
+  std::thread dumper_;
 }; // class Database
 
 #define DBInstance DBImpl::Instance()
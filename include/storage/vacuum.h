@@ -0,0 +1,60 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "common/code.h"
+#include "common/types.h"
+
+namespace udb {
+class TxnImpl;
+
+// Shrink the database by moving the pages in use at its end into free
+// pages before them, then cutting off the end. The file has no pointer
+// map, so the pages referring to the moved ones are found by walking the
+// trees once per run. Only the end of the database is looked at, so each
+// run moves at most as many pages as it cuts off. The transaction runs
+// alone, as the pages moved are not locked by other writers.
+class Vacuum {
+public:
+  explicit Vacuum(TxnImpl *txn);
+
+  Vacuum(const Vacuum &) = delete;
+  Vacuum &operator=(const Vacuum &) = delete;
+
+  // Cut off at most maxPages pages, return the number cut in *pages.
+  Code Run(int maxPages, int *pages);
+
+private:
+  enum RefType {
+    kChildRef,         // The index_-th child of an internal page.
+    kCellOverflowRef,  // The overflow chain of the index_-th leaf cell.
+    kNextOverflowRef,  // The next page of an overflow page.
+    kSiblingRef,       // The right sibling of a linked leaf.
+  };
+
+  // Where a page number is kept.
+  struct Ref {
+    PageNo holder_;
+    RefType type_;
+    int index_;
+  };
+
+  // Record the references to the pages after limit in the tree.
+  Code Walk(PageNo root, PageNo limit);
+
+  Code WalkOverflow(PageNo leaf, int index, PageNo first, uint64_t size,
+                    PageNo limit);
+
+  // Copy the page from into to, and point its references at to.
+  Code Move(PageNo from, PageNo to);
+
+  Code SetRef(const Ref &ref, PageNo no);
+
+private:
+  TxnImpl *txn_;
+  // A leaf is referred to by its parent and its left sibling.
+  std::unordered_map<PageNo, std::vector<Ref>> refs_;
+  std::unordered_map<PageNo, PageNo> moved_; // Old page to new page.
+};
+} // namespace udb
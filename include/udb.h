@@ -1,6 +1,10 @@
 #pragma once
 
+#include <functional>
+#include <span>
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 #include "common/export.h"
 #include "common/slice.h"
@@ -15,16 +19,195 @@ static const int kMinorVersion = 1;
 class BTree;
 class Txn;
 
+// A source of key/value pairs.
+class UDB_EXPORT KVIterator {
+public:
+  virtual ~KVIterator() = default;
+
+  virtual bool Valid() const = 0;
+  virtual Slice Key() const = 0;
+  virtual Slice Value() const = 0;
+  virtual void Next() = 0;
+};
+
+// A value read in chunks, see Txn::GetStream.
+class UDB_EXPORT ValueReader {
+public:
+  virtual ~ValueReader() = default;
+
+  // Bytes of the whole value.
+  virtual uint64_t Size() const = 0;
+
+  // Return the next chunk of the value, an empty chunk after the last one.
+  // The chunk stays valid until the next call or the reader is deleted.
+  virtual Status Next(Slice *chunk) = 0;
+};
+
+// The order of the keys of a tree.
+class UDB_EXPORT Comparator {
+public:
+  virtual ~Comparator() = default;
+
+  // Return a value less than, equal to or greater than 0 if a is before,
+  // the same as or after b.
+  virtual int Compare(const Slice &a, const Slice &b) const = 0;
+
+  // The name of the order, kept with the tree. A tree MUST always be
+  // opened with a comparator of the same name.
+  virtual const char *Name() const = 0;
+};
+
+// Keys ordered by memcmp, a key before the longer keys it is a prefix of.
+// The order of the default tree and of trees opened without a comparator.
+UDB_EXPORT const Comparator *BytewiseComparator();
+
+// 8-byte keys ordered as big-endian unsigned integers. Keys of any other
+// size are rejected.
+UDB_EXPORT const Comparator *U64Comparator();
+
+// The reverse of BytewiseComparator.
+UDB_EXPORT const Comparator *ReverseBytewiseComparator();
+
+// How a tree is opened, see Txn::OpenTree.
+struct UDB_EXPORT TreeOptions {
+public:
+  // The order of the keys. A tree created with a built-in comparator may
+  // be opened without one, nullptr means BytewiseComparator otherwise.
+  const Comparator *comparator_ = nullptr;
+
+  // Create an intkey tree, whose keys are 8-byte big-endian integers in
+  // the order of U64Comparator. The keys are stored at a fixed place in
+  // each page and searched by interpolation, which suits dense ids. Only
+  // used when the tree is created, comparator_ MUST be nullptr or
+  // U64Comparator.
+  bool intKey_ = false;
+};
+
+// How the pages are compressed in the database file, see Options.
+enum UDB_EXPORT CompressionType : uint8_t {
+  kNoCompression = 0,
+  kLz4Compression = 1,
+  kZstdCompression = 2,
+  kZlibCompression = 3,
+};
+
 struct UDB_EXPORT Options {
 public:
   // Create an Options object with default values for all fields.
   Options();
 
-  // page size, MUST be a power of 2 and between [1024, 65536]
+  // page size, MUST be a power of 2 and between [1024, 65536]. Only used
+  // when the database is created, an existing one keeps its page size.
+  // Larger pages suit scans and compression, smaller ones point lookups.
   int pageSize_ = 4096;
 
-  // cache size
+  // Bytes of the buffer pool.
   int cacheSize_ = 1024000;
+
+  // Max bytes of the database file to memory map, 0 disables mmap.
+  // Pages inside the mapping are read without copying into the buffer
+  // pool, pages beyond it are read through the buffer pool.
+  int64_t mmapSize_ = 0;
+
+  // Microseconds a group commit waits for more transactions to commit
+  // before syncing the log, 0 syncs at once.
+  int walCommitWindowUs_ = 0;
+
+  // Checkpoint the log when it has this many frames.
+  int walCheckpointFrames_ = 1000;
+
+  // Threads doing page I/O if io_uring is not available.
+  int ioThreads_ = 4;
+
+  // Store the keys of each page without their common prefix. Only used
+  // when the database is created, the choice is kept in the file header.
+  bool prefixCompression_ = true;
+
+  // Compress the pages written into the database file, they are the same
+  // in the buffer pool. A page keeps its slot of pageSize_ bytes in the
+  // file, but takes only the 4096-byte blocks its compressed image needs,
+  // the rest is a hole of the sparse file. So only pages of 8192 bytes or
+  // more can take less space and fewer reads, Open fails when creating a
+  // database with compression and a smaller pageSize_. Only used when the
+  // database is created, the choice is kept in the file header. Open fails
+  // if udb is not built with the compression.
+  CompressionType compression_ = kNoCompression;
+
+  // Keep an adaptive hash index in memory for each tree that is looked up
+  // far more often than written, so that Get of a hot key reads its leaf
+  // without the path from the root. It takes 16 entries of 32 bytes per
+  // frame of the buffer pool for each tree it is turned on for, and is
+  // turned off again once writes take over.
+  bool adaptiveHashIndex_ = false;
+
+  // Seconds between dumps of GetStats to stderr, 0 disables them.
+  int statsDumpPeriodSec_ = 0;
+};
+
+// The distribution of a duration in microseconds.
+struct UDB_EXPORT Histogram {
+public:
+  static const int kBuckets = 65;
+
+  // Return the mean of the values, 0 if there are none.
+  double Average() const;
+
+  // Return an estimate of the value below which p percent of the values
+  // fall, interpolated inside the bucket it is in.
+  double Percentile(double p) const;
+
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+  // buckets_[i] counts the values of bit width i, that is 0 in bucket 0
+  // and [2^(i-1), 2^i) in the others.
+  uint64_t buckets_[kBuckets] = {};
+};
+
+// Counters of the work of the database since it was opened. They are kept
+// per thread and summed when read, so counting costs a few instructions.
+// The counters are of the process, not of one database: with two
+// databases open, each one also counts the work of the other since it
+// was opened. All of them stay 0 if the library is built without
+// UDB_WITH_STATS.
+struct UDB_EXPORT Stats {
+public:
+  // Page lookups of the buffer pool found cached, read from the file, and
+  // the frames taken from other pages for them.
+  uint64_t cacheHits_ = 0;
+  uint64_t cacheMisses_ = 0;
+  uint64_t cacheEvictions_ = 0;
+
+  // Moves of cursors to a key, and the pages they and the steps between
+  // leaves went through.
+  uint64_t cursorSeeks_ = 0;
+  uint64_t pagesVisited_ = 0;
+
+  // Lookups of trees with an active adaptive hash index that read the
+  // leaf at once, and those that went from the root.
+  uint64_t hashHits_ = 0;
+  uint64_t hashMisses_ = 0;
+
+  // Cells compared by the binary search of pages.
+  uint64_t searchProbes_ = 0;
+
+  // Pages split in two and pages merged into a sibling.
+  uint64_t pageSplits_ = 0;
+  uint64_t pageMerges_ = 0;
+
+  // Committed write transactions, and the time each took to commit,
+  // syncing the log included.
+  uint64_t commits_ = 0;
+  Histogram commitMicros_;
+
+  // Bytes of frames appended to the log.
+  uint64_t walBytes_ = 0;
+
+  // fdatasync calls on the log and the database file, and their time.
+  uint64_t syncs_ = 0;
+  Histogram syncMicros_;
+
+  // Return the counters as text, one per line.
+  std::string ToString() const;
 };
 
 class UDB_EXPORT Database {
@@ -39,16 +222,37 @@ public:
 
   virtual ~Database();
 
-  // Begin a transaction.
+  // Begin a transaction. At most 64 transactions, readers and writers
+  // alike, run at once, each one takes a reader slot of the log until it
+  // ends. Return nullptr if all the slots are taken, GetErrorStatus()
+  // returns kBusy then.
   virtual Txn *Begin(bool write) = 0;
 
-  // Commit a transaction.
+  // Commit a transaction, which MUST NOT be used afterwards. Ended
+  // transactions are kept for reuse by the next Begin of the thread.
+  // Write transactions run concurrently, one fails with kConflict if
+  // another has committed changes to the pages it read its data from
+  // since it read them. If a write of the transaction failed, it is rolled
+  // back and the error of the write is returned. The changes of a failed
+  // commit are dropped, the transaction may be run again.
   virtual Status Commit(Txn *) = 0;
 
+  // End a transaction and drop its changes, the transaction MUST NOT be
+  // used afterwards.
+  virtual Status Abort(Txn *) = 0;
+
+  // Get a snapshot of the counters since the database was opened, which
+  // are of the whole process, see Stats.
+  virtual void GetStats(Stats *) = 0;
+
   // Close the database, Returns OK on success.
   virtual Status Close(Database *) = 0;
 }; // class Database
 
+// Called by Txn::Scan for each entry, returns false to stop the scan.
+using ScanCallback =
+    std::function<bool(const Slice &key, const Slice &value)>;
+
 class Txn {
 public:
   Txn() = default;
@@ -60,10 +264,18 @@ public:
 
   // Open a tree by name, return BTree if exist.
   // When createIfNotExists is true, create the tree if not exist.
-  virtual Status OpenTree(const std::string &name, BTree **,
-                          bool createIfNotExists) = 0;
+  // The BTree stays valid until the database is closed, and may be used
+  // by later transactions.
+  virtual Status OpenTree(const std::string &name, const TreeOptions &options,
+                          BTree **, bool createIfNotExists) = 0;
 
-  // Delete a tree by name.
+  Status OpenTree(const std::string &name, BTree **tree,
+                  bool createIfNotExists) {
+    return OpenTree(name, TreeOptions(), tree, createIfNotExists);
+  }
+
+  // Delete a tree by name, and free its pages. The transaction runs alone
+  // until it commits, return kBusy if other write transactions are running.
   // Note that in a transaction, if operate a BTree after
   // it has been deleted, will return error.
   virtual Status DeleteTree(const std::string &name);
@@ -80,6 +292,51 @@ public:
 
   // If the BTree contains an entry for "key" store the
   // corresponding value in value and return OK.
+  // The value stays valid until the transaction ends.
   virtual Status Get(BTree *, const Slice &key, Slice *value) = 0;
+
+  // Return a reader of the value of "key" in *reader, which the caller
+  // MUST delete before the transaction ends. Only the bytes kept in the
+  // leaf are copied, the other chunks point into the pages of the buffer
+  // pool, so a large value is never copied as a whole. The reader MUST NOT
+  // be used after the transaction writes or deletes the key.
+  virtual Status GetStream(BTree *, const Slice &key,
+                           ValueReader **reader) = 0;
+
+  // Get the entries of many keys at once, (*values)[i] and (*statuses)[i]
+  // are the result of keys[i] as if by Get. The keys are looked up in
+  // sorted order, so that neighbouring keys share the walk down the tree.
+  virtual void MultiGet(BTree *, std::span<const Slice> keys,
+                        std::vector<Slice> *values,
+                        std::vector<Status> *statuses) = 0;
+
+  // Call callback with the entries of the keys in [start, end) in key
+  // order, until it returns false. An empty start begins at the first key
+  // and an empty end goes on to the last one. The key and the value are
+  // only valid during the call, which MUST NOT use the transaction.
+  virtual Status Scan(BTree *, const Slice &start, const Slice &end,
+                      const ScanCallback &callback) = 0;
+
+  // Scan like Scan with threads threads at once, the calling one among
+  // them. The range is cut into parts at the separator keys of the upper
+  // levels of the tree, each part is scanned in key order by one thread,
+  // the parts in no particular order. The callback is called from all the
+  // threads concurrently. Once it returns false the threads stop after
+  // their current entries.
+  virtual Status ParallelScan(BTree *, const Slice &start, const Slice &end,
+                              int threads, const ScanCallback &callback) = 0;
+
+  // Fill an empty BTree with the entries of iter, whose keys MUST be in
+  // strictly ascending order. The tree is built bottom-up, each page is
+  // filled up to fillPercent(in [10, 100]) of its space.
+  // The pages are written to the log as they are finished, but the tree
+  // only becomes visible when the transaction commits.
+  virtual Status BulkLoad(BTree *, KVIterator *iter, int fillPercent) = 0;
+
+  // Move pages in use at the end of the database into free pages and cut
+  // off at most maxPages pages from the end, return the number of pages
+  // cut off in *pages. The file shrinks at the first checkpoint after the
+  // transaction commits that no reader needs the pages any more.
+  virtual Status IncrementalVacuum(int maxPages, int *pages) = 0;
 }; // class Txn
 } // namespace udb
\ No newline at end of file
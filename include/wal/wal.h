@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/code.h"
+#include "common/types.h"
+
+/* The layout of the write-ahead log file(modeled on the sqlite wal)
+ **
+ ** The log begins with a 32-byte header followed by zero or more frames,
+ ** each frame records the image of one page.
+ **
+ **   OFFSET   SIZE     DESCRIPTION
+ **      0       4      Magic number 0x75646277("udbw")
+ **      4       4      File format version, currently 1
+ **      8       4      Page size
+ **     12       4      Checkpoint sequence number
+ **     16       4      Salt-1, random integer renewed at every checkpoint
+ **     20       4      Salt-2, a copy of the checkpoint sequence number
+ **     24       4      Checksum-1 of the first 24 bytes
+ **     28       4      Checksum-2 of the first 24 bytes
+ **
+ ** Each frame has a 24-byte header followed by the page image:
+ **
+ **   OFFSET   SIZE     DESCRIPTION
+ **      0       4      Page number
+ **      4       4      For commit frames, the number of pages of the
+ **                     database after the commit. Zero for other frames.
+ **      8       4      Salt-1 copied from the log header
+ **     12       4      Salt-2 copied from the log header
+ **     16       4      Cumulative checksum-1
+ **     20       4      Cumulative checksum-2
+ **
+ ** The checksum of a frame covers the first 8 bytes of its header and the
+ ** page image, seeded with the checksum of the previous frame(or the log
+ ** header). A frame is valid only if its salts match the log header and its
+ ** checksum is right, so frames left over from before the last checkpoint
+ ** and torn writes are both detected.
+ **
+ ** The frames of a transaction are appended together, the last one is the
+ ** commit frame. Frames after the last valid commit frame are ignored.
+ **
+ ** A page may have several frames in the log, each one is a version of the
+ ** page. A read transaction takes the LSN of the last commit frame as its
+ ** snapshot and records it in a reader slot, then it reads the latest
+ ** version of each page not newer than the snapshot. A checkpoint only
+ ** copies back the versions not newer than the oldest snapshot in use,
+ ** and the log is reset only when no reader needs any frame in it.
+ */
+
+namespace udb {
+class AsyncIo;
+class File;
+struct Options;
+enum CompressionType : uint8_t;
+
+static const uint32_t kWalMagic = 0x75646277;
+static const uint32_t kWalVersion = 1;
+static const int kWalHeaderSize = 32;
+static const int kWalFrameHeaderSize = 24;
+
+// Max number of concurrent read transactions.
+static const int kWalReaderSlots = 64;
+
+// Called by a checkpoint for each page copied back into the database file,
+// with the log locked so that no one looks up the page meanwhile. Versions
+// up to and including the given one are no longer in the log index.
+typedef std::function<void(PageNo, uint64_t)> BackfillHandler;
+
+// Called by Append with the LSN of the first frame appended, with the log
+// locked so that no one looks up the new versions before the buffer pool
+// knows them.
+typedef std::function<void(uint64_t)> AppendHandler;
+
+// A page to be appended into the log.
+struct WalPage {
+  PageNo pageNo_;
+  const char *data_;
+};
+
+// The write-ahead log. Frames are numbered by a log sequence number(LSN)
+// which keeps increasing across checkpoints, the frame with LSN n since
+// the last checkpoint is at offset kWalHeaderSize + (n - base - 1) * frame.
+class Wal {
+public:
+  Wal(const Options &options, const std::string &dbPath);
+
+  Wal(const Wal &) = delete;
+  Wal &operator=(const Wal &) = delete;
+
+  ~Wal();
+
+  // Return the page size in the valid header of the log of the database,
+  // 0 if there is no log or its header has never been written completely.
+  static Code ReadPageSize(const std::string &dbPath, int *pageSize);
+
+  // Open the log and replay the committed frames into the database file.
+  // The pages are copied back through aio.
+  Code Open(File *dbFile, AsyncIo *aio);
+
+  // Append the pages of a transaction, return the LSN of the commit frame.
+  // The frames are visible to readers at once, but not durable until Sync.
+  Code Append(const std::vector<WalPage> &pages, PageNo dbSize,
+              uint64_t *commitLsn, const AppendHandler &appended);
+
+  // Wait until the log is durable up to lsn. Concurrent callers are
+  // coalesced into one fdatasync(group commit).
+  Code Sync(uint64_t lsn);
+
+  // Take a reader slot and the snapshot of the read transaction.
+  Code BeginRead(int *slot, uint64_t *snapshot);
+
+  void EndRead(int slot);
+
+  // Return the version of the page visible to the snapshot,
+  // kDbFileVersion if the page should be read from the database file.
+  uint64_t Lookup(PageNo no, uint64_t snapshot) const;
+
+  // Read the page image of version lsn into buf, set found to false if
+  // the frame is gone, then the database file holds that image.
+  Code ReadFrame(uint64_t lsn, char *buf, bool *found);
+
+  // Copy the frames visible to every reader back into the database file,
+  // reset the log if no reader needs it any more.
+  Code Checkpoint(const BackfillHandler &backfilled);
+
+  // Compress the pages the checkpoints copy back, except page 1. Set
+  // before the log is used by more than one thread.
+  void SetCompression(CompressionType compression) {
+    compression_ = compression;
+  }
+
+  // Return true if the log has grown enough for a checkpoint.
+  bool NeedCheckpoint() const;
+
+  // Return true if all frames are in the database file and the log has
+  // been reset.
+  bool IsEmpty() const;
+
+  // Pages of the database as of the last commit, kInvalidPageNo if no
+  // commit has been seen since the log was opened.
+  PageNo DbSize() const;
+
+private:
+  Code Recover();
+  Code Reset();
+
+  uint64_t FrameOffset(uint64_t lsn) const;
+
+  // Return the oldest snapshot in use, lastLsn_ if no reader.
+  uint64_t OldestSnapshot() const;
+
+private:
+  std::string path_;
+  int pageSize_;
+  int commitWindowUs_;  // Time the group commit leader waits for others.
+  int checkpointFrames_; // Checkpoint when the log has this many frames.
+  CompressionType compression_;
+  File *file_;
+  File *dbFile_;
+  AsyncIo *aio_;
+
+  // Protects the frame index and the log header, appends and checkpoints
+  // hold it exclusively, readers of the log hold it shared.
+  mutable std::shared_mutex mutex_;
+  // Page to the LSNs of its versions in the log, in ascending order.
+  std::unordered_map<PageNo, std::vector<uint64_t>> index_;
+  uint64_t base_;       // LSN of the last frame before the log was reset.
+  uint64_t lastLsn_;    // LSN of the last appended frame.
+  uint64_t backfilled_; // Versions up to this LSN are in the database file.
+  PageNo dbSize_;       // Pages of the database as of the last commit.
+  uint32_t checkpointSeq_;
+  uint32_t salt1_;
+  uint32_t checksum_[2]; // Checksum of the last frame.
+
+  // Snapshots of the read transactions, kFreeSlot if not used. Written
+  // with mutex_ held shared, so a checkpoint sees all of them.
+  static const uint64_t kFreeSlot = UINT64_MAX;
+  std::atomic<uint64_t> readers_[kWalReaderSlots];
+
+  // Group commit state.
+  std::mutex syncMutex_;
+  std::condition_variable synced_;
+  uint64_t syncedLsn_; // The log is durable up to this LSN.
+  bool syncing_;       // A leader is running fdatasync.
+};
+} // namespace udb
@@ -1,12 +1,78 @@
 set(libudb_files
   src/buffer/buffer_manager.cc
+  src/buffer/buffer_shard.cc
+  src/buffer/free_list.cc
+  src/buffer/spill_file.cc
+  src/common/arena.cc
+  src/common/bytes.cc
+  src/common/compression.cc
+  src/common/metrics.cc
+  src/common/status.cc
+  src/os/aio.cc
+  src/os/file.cc
+  src/os/os.cc
+  src/storage/balance.cc
+  src/storage/btree.cc
+  src/storage/catalog.cc
+  src/storage/bulk_loader.cc
+  src/storage/cell.cc
+  src/storage/comparator.cc
   src/storage/cursor.cc
+  src/storage/hash_index.cc
+  src/storage/key_prefix.cc
   src/storage/mem_page.cc
+  src/storage/overflow.cc
+  src/storage/parallel_scan.cc
   src/storage/txn_impl.cc
   src/storage/udb_impl.cc
+  src/storage/vacuum.cc
+  src/wal/wal.cc
 )
 
 add_library(udb 
   ${udb_SHARED_OR_STATIC}
   ${libudb_files}
-)
\ No newline at end of file
+)
+
+find_package(Threads REQUIRED)
+target_link_libraries(udb PUBLIC Threads::Threads)
+
+# io_uring is used through the raw system calls, only the kernel header
+# is needed.
+option(UDB_WITH_IO_URING "Use io_uring for page I/O when supported" ON)
+if(UDB_WITH_IO_URING)
+  include(CheckIncludeFileCXX)
+  check_include_file_cxx(linux/io_uring.h UDB_HAVE_IO_URING_H)
+  if(UDB_HAVE_IO_URING_H)
+    target_compile_definitions(udb PRIVATE UDB_WITH_IO_URING)
+  endif()
+endif()
+# Page compression codecs, each one is built in if its library is found.
+option(UDB_WITH_LZ4 "Build in lz4 page compression if found" ON)
+option(UDB_WITH_ZSTD "Build in zstd page compression if found" ON)
+option(UDB_WITH_ZLIB "Build in zlib page compression if found" ON)
+foreach(codec LZ4 ZSTD ZLIB)
+  string(TOLOWER ${codec} name)
+  if(codec STREQUAL "ZLIB")
+    set(header zlib.h)
+    set(library z)
+  else()
+    set(header ${name}.h)
+    set(library ${name})
+  endif()
+  if(UDB_WITH_${codec})
+    find_path(UDB_${codec}_INCLUDE_DIR ${header})
+    find_library(UDB_${codec}_LIBRARY ${library})
+    if(UDB_${codec}_INCLUDE_DIR AND UDB_${codec}_LIBRARY)
+      target_include_directories(udb PRIVATE ${UDB_${codec}_INCLUDE_DIR})
+      target_link_libraries(udb PRIVATE ${UDB_${codec}_LIBRARY})
+      target_compile_definitions(udb PRIVATE UDB_WITH_${codec})
+      message(STATUS "Page compression with ${name}")
+    endif()
+  endif()
+endforeach()
+# Per-thread counters of the hot paths, see Database::GetStats.
+option(UDB_WITH_STATS "Count cache, tree and log events for GetStats" ON)
+if(UDB_WITH_STATS)
+  target_compile_definitions(udb PRIVATE UDB_WITH_STATS)
+endif()
@@ -1,9 +1,903 @@
 #include "buffer/buffer_manager.h"
+#include "buffer/buffer_shard.h"
+#include "buffer/free_list.h"
+#include "buffer/mem_page.h"
+#include "buffer/spill_file.h"
+#include "common/compression.h"
+#include "common/debug.h"
+#include "common/string.h"
+#include "os/aio.h"
+#include "os/file.h"
+#include "os/os.h"
+#include "wal/wal.h"
+
+#include <algorithm>
+#include <string.h>
 
 namespace udb {
+// Max number of shards of the buffer pool.
+static const int kMaxShardNum = 64;
+
+// Min number of frames in one shard, a shard too small makes the 2Q
+// queues useless.
+static const int kMinShardFrames = 16;
+
+static BufferManager *gBufferManager = nullptr;
+
 BufferManager::BufferManager(const Options &options, const string &name)
     : pageSize_(options.pageSize_), cacheSize_(options.cacheSize_),
-      dbName_(name) {}
+      dbName_(name), file_(new File(name)),
+      aio_(AsyncIo::Create(options.ioThreads_)), wal_(new Wal(options, name)),
+      spill_(new SpillFile(name, options.pageSize_)),
+      freeList_(new FreeList(this)), pageCount_(0), lastFreeLsn_(0),
+      committedCount_(0), nextWriter_(0),
+      mmapSize_(options.mmapSize_), mapBase_(nullptr), mapSize_(0), mapEnd_(0),
+      readaheads_(0) {
+  frameNum_ = std::max(cacheSize_ / pageSize_, kMinShardFrames);
+
+  // Use as many shards as possible, the number MUST be a power of 2.
+  shardNum_ = 1;
+  shardShift_ = 32;
+  while (shardNum_ < kMaxShardNum &&
+         frameNum_ / (shardNum_ * 2) >= kMinShardFrames) {
+    shardNum_ *= 2;
+    --shardShift_;
+  }
+
+  buffer_ = new char[static_cast<size_t>(frameNum_) * pageSize_];
+  frames_ = new Frame[frameNum_];
+  for (int i = 0; i < frameNum_; ++i) {
+    Frame *frame = &frames_[i];
+    frame->buffer_ = &buffer_[static_cast<size_t>(i) * pageSize_];
+    frame->page_.Init(kInvalidPageNo, frame->buffer_, pageSize_);
+    frame->pinCount_ = 0;
+    frame->dirty_ = false;
+    frame->loading_ = false;
+    frame->prev_ = frame->next_ = nullptr;
+    frame->read_.done_ = [this, frame](IoRequest *request) {
+      FinishReadahead(frame, request->error_);
+    };
+  }
+
+  shards_ = new BufferShard[shardNum_];
+  int perShard = frameNum_ / shardNum_;
+  for (int i = 0; i < shardNum_; ++i) {
+    // The last shard takes the remainder.
+    int num = (i == shardNum_ - 1) ? frameNum_ - perShard * i : perShard;
+    shards_[i].Init(this, &frames_[perShard * i], num);
+  }
+
+  gBufferManager = this;
+}
+
+BufferManager::~BufferManager() {
+  if (gBufferManager == this) {
+    gBufferManager = nullptr;
+  }
+  // The I/O threads may still be in the callback of the last one.
+  {
+    std::unique_lock<std::mutex> lock(readaheadMutex_);
+    readaheadDone_.wait(lock, [this] { return readaheads_ == 0; });
+  }
+  delete aio_;
+  if (mapBase_) {
+    File::Unmap(mapBase_, mapSize_);
+  }
+  delete[] shards_;
+  delete[] frames_;
+  delete[] buffer_;
+  delete freeList_;
+  delete spill_;
+  delete wal_;
+  delete file_;
+}
+
+BufferManager *BufferManager::Instance() { return gBufferManager; }
+
+Code BufferManager::Open() {
+  uint64_t fileSize;
+  Code code = file_->Open(true);
+  if (code != kOk) {
+    return code;
+  }
+
+  // Replay the log before anything is read from the file.
+  code = wal_->Open(file_, aio_);
+  if (code != kOk) {
+    return code;
+  }
+  code = TruncateFile();
+  if (code != kOk) {
+    return code;
+  }
+  code = file_->Size(&fileSize);
+  if (code != kOk) {
+    return code;
+  }
+  pageCount_ = fileSize / pageSize_;
+  committedCount_ = pageCount_;
+
+  if (mmapSize_ > 0) {
+    MapFile(mmapSize_);
+  }
+  return pageCount_ > 0 ? freeList_->Load() : kOk;
+}
+
+void BufferManager::MapFile(int64_t mmapSize) {
+  // Leave at least half of the address space to the others.
+  uint64_t size = std::min<uint64_t>(mmapSize, Os::AddressSpaceLimit() / 2);
+  size -= size % pageSize_;
+  if (size == 0) {
+    return;
+  }
+
+  // Reserve the whole budget once, so that the mapping grows with the file
+  // without remapping and the page images handed out stay valid.
+  if (file_->Map(size, &mapBase_) != kOk) {
+    // Not an error, all pages will be read through the buffer pool.
+    mapBase_ = nullptr;
+    return;
+  }
+  mapSize_ = size;
+}
+
+bool BufferManager::IsMapped(uint64_t end) {
+  if (end > mapSize_) {
+    return false;
+  }
+  if (end <= mapEnd_.load(std::memory_order_acquire)) {
+    return true;
+  }
+
+  // The file may have grown since last check.
+  std::lock_guard<std::mutex> lock(mapMutex_);
+  uint64_t fileSize;
+  if (file_->Size(&fileSize) != kOk) {
+    return false;
+  }
+  fileSize -= fileSize % pageSize_;
+  mapEnd_.store(std::min(fileSize, mapSize_), std::memory_order_release);
+  return end <= mapEnd_.load(std::memory_order_relaxed);
+}
+
+Code BufferManager::ReadFrame(Frame *frame) {
+  PageNo no = frame->page_.DiskPageNo();
+  uint64_t offset = static_cast<uint64_t>(no - 1) * pageSize_;
+  bool found;
+
+  if (frame->version_ != kDbFileVersion) {
+    Code code = wal_->ReadFrame(frame->version_, frame->buffer_, &found);
+    if (code != kOk || found) {
+      return code;
+    }
+    // Checkpointed, the database file holds this version now.
+  }
+
+  if (mapBase_ && IsMapped(offset + pageSize_)) {
+    const char *image = mapBase_ + offset;
+    if (IsCompressedPage(image, pageSize_)) {
+      return DecompressPage(no, image, pageSize_, frame->buffer_);
+    }
+    frame->page_.Init(no, mapBase_ + offset, pageSize_);
+    return kOk;
+  }
+  IoRequest request(file_, false, offset, frame->buffer_, pageSize_);
+  IoRequest *requests[] = {&request};
+  Code code = aio_->Run(requests, 1);
+  if (code != kOk || !IsCompressedPage(frame->buffer_, pageSize_)) {
+    return code;
+  }
+  // Decompress from a copy, the image is read into the frame buffer.
+  static thread_local std::vector<char> image;
+  image.assign(frame->buffer_, frame->buffer_ + pageSize_);
+  return DecompressPage(no, image.data(), pageSize_, frame->buffer_);
+}
+
+Code BufferManager::Spill(Frame *frame) {
+  return spill_->Write(frame->page_.DiskPageNo(), frame->page_.Data(),
+                       frame->memPage_.IsOverflow());
+}
+
+Code BufferManager::ReadSpilled(Frame *frame) {
+  bool overflow;
+  Code code = spill_->Take(frame->page_.DiskPageNo(), frame->buffer_,
+                           &overflow);
+  if (code != kOk) {
+    return code;
+  }
+  if (overflow) {
+    frame->memPage_.InitOverflow(&frame->page_);
+  } else {
+    code = frame->memPage_.InitFromPage(&frame->page_);
+  }
+  frame->memPage_.SetVersion(kDirtyVersion);
+  return code;
+}
+
+bool BufferManager::IsSpilled(PageNo no) const {
+  return spill_->Contains(no);
+}
+
+void BufferManager::DropSpilled(PageNo no) { spill_->Drop(no); }
+
+void BufferManager::SetCompression(CompressionType compression) {
+  wal_->SetCompression(compression);
+}
+
+BufferShard *BufferManager::Shard(PageNo no) const {
+  if (shardNum_ == 1) {
+    return &shards_[0];
+  }
+  // Fibonacci hashing, neighbouring pages go to different shards.
+  uint32_t hash = no * 2654435769U;
+  return &shards_[hash >> shardShift_];
+}
+
+Code BufferManager::GetPage(PageNo no, uint64_t snapshot, MemPage **page) {
+  return GetPage(no, snapshot, false, page);
+}
+
+Code BufferManager::GetOverflowPage(PageNo no, uint64_t snapshot,
+                                    MemPage **page) {
+  return GetPage(no, snapshot, true, page);
+}
+
+Code BufferManager::GetPage(PageNo no, uint64_t snapshot, bool overflow,
+                            MemPage **page) {
+  BufferShard *shard = Shard(no);
+  Frame *frame;
+
+  if (snapshot >= kMinWriterSnapshot) {
+    Code code = shard->LookupDirty(no, snapshot, &frame);
+    if (code != kOk) {
+      return code;
+    }
+    if (frame) {
+      *page = &frame->memPage_;
+      return kOk;
+    }
+  }
+
+  Code code =
+      shard->Fetch(no, wal_->Lookup(no, snapshot), &frame, overflow);
+  if (code != kOk) {
+    return code;
+  }
+  *page = &frame->memPage_;
+  return kOk;
+}
+
+Frame *BufferManager::FrameOf(MemPage *page) const {
+  // The pages handed out are the memPage_ of the frames, which are one
+  // array.
+  size_t offset = reinterpret_cast<const char *>(page) -
+                  reinterpret_cast<const char *>(&frames_[0].memPage_);
+  Assert(offset % sizeof(Frame) == 0 &&
+         offset / sizeof(Frame) < static_cast<size_t>(frameNum_));
+  return &frames_[offset / sizeof(Frame)];
+}
+
+void BufferManager::ReleasePage(MemPage *page) {
+  Shard(page->MemPageNo())->Unpin(FrameOf(page));
+}
+
+bool BufferManager::IsLatest(MemPage *page, uint64_t snapshot) const {
+  if (snapshot < kMinWriterSnapshot || page->Version() == kDirtyVersion) {
+    return true;
+  }
+  return wal_->Lookup(page->MemPageNo(), snapshot) == page->Version();
+}
+
+bool BufferManager::IsCached(PageNo no, uint64_t snapshot) {
+  uint64_t version = wal_->Lookup(no, snapshot);
+  return version != kDbFileVersion || Shard(no)->IsCached(no, version);
+}
+
+std::vector<PageNo> BufferManager::ColdPages(const PageNo *pages, int n,
+                                             uint64_t snapshot) {
+  std::vector<PageNo> cold;
+
+  for (int i = 0; i < n; ++i) {
+    // Versions in the log were written recently and are likely in the
+    // OS cache.
+    uint64_t version = wal_->Lookup(pages[i], snapshot);
+    if (version == kDbFileVersion &&
+        !Shard(pages[i])->IsCached(pages[i], version)) {
+      cold.push_back(pages[i]);
+    }
+  }
+  std::sort(cold.begin(), cold.end());
+  return cold;
+}
+
+void BufferManager::Readahead(const PageNo *pages, int n, uint64_t snapshot) {
+  std::vector<PageNo> cold = ColdPages(pages, n, snapshot);
+  std::vector<IoRequest *> reads;
+
+  for (size_t i = 0; i < cold.size();) {
+    size_t j = i + 1;
+    while (j < cold.size() && cold[j] == cold[j - 1] + 1) {
+      ++j;
+    }
+    // Mapped pages are not copied into the pool.
+    uint64_t offset = static_cast<uint64_t>(cold[i] - 1) * pageSize_;
+    uint64_t size = static_cast<uint64_t>(j - i) * pageSize_;
+    if (mapBase_ && IsMapped(offset + size)) {
+      File::AdviseMap(mapBase_ + offset, size);
+    } else {
+      for (size_t k = i; k < j; ++k) {
+        StartReadahead(cold[k], &reads);
+      }
+    }
+    i = j;
+  }
+  if (!reads.empty()) {
+    aio_->Submit(reads.data(), static_cast<int>(reads.size()));
+  }
+}
+
+void BufferManager::Hint(const PageNo *pages, int n, uint64_t snapshot) {
+  std::vector<PageNo> cold = ColdPages(pages, n, snapshot);
+
+  // One hint for each run of neighbouring pages.
+  for (size_t i = 0; i < cold.size();) {
+    size_t j = i + 1;
+    while (j < cold.size() && cold[j] == cold[j - 1] + 1) {
+      ++j;
+    }
+    Advise(cold[i], j - i);
+    i = j;
+  }
+}
+
+void BufferManager::Advise(PageNo no, int n) {
+  uint64_t offset = static_cast<uint64_t>(no - 1) * pageSize_;
+  uint64_t size = static_cast<uint64_t>(n) * pageSize_;
+  if (mapBase_ && IsMapped(offset + size)) {
+    File::AdviseMap(mapBase_ + offset, size);
+  } else {
+    file_->Advise(offset, size);
+  }
+}
+
+void BufferManager::StartReadahead(PageNo no,
+                                   std::vector<IoRequest *> *reads) {
+  Frame *frame = Shard(no)->StartLoad(no, kDbFileVersion);
+  if (!frame) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(readaheadMutex_);
+    ++readaheads_;
+  }
+  IoRequest *read = &frame->read_;
+  read->file_ = file_;
+  read->write_ = false;
+  read->offset_ = static_cast<uint64_t>(no - 1) * pageSize_;
+  read->buf_ = frame->buffer_;
+  read->size_ = pageSize_;
+  read->error_ = 0;
+  reads->push_back(read);
+}
+
+void BufferManager::FinishReadahead(Frame *frame, int error) {
+  PageNo no = frame->page_.DiskPageNo();
+  Code code = error == 0 ? kOk : kIOError;
+  if (code == kOk && IsCompressedPage(frame->buffer_, pageSize_)) {
+    static thread_local std::vector<char> image;
+    image.assign(frame->buffer_, frame->buffer_ + pageSize_);
+    code = DecompressPage(no, image.data(), pageSize_, frame->buffer_);
+  }
+  Shard(no)->FinishLoad(frame, code);
+
+  std::lock_guard<std::mutex> lock(readaheadMutex_);
+  if (--readaheads_ == 0) {
+    readaheadDone_.notify_all();
+  }
+}
+
+Code BufferManager::BeginWrite(uint64_t *snapshot) {
+  int slot;
+  uint64_t begin;
+  Code code = wal_->BeginRead(&slot, &begin);
+  if (code != kOk) {
+    return code;
+  }
+
+  std::lock_guard<std::mutex> lock(writersMutex_);
+  // The numbers wrap around, long after any writer of the same number
+  // has ended.
+  *snapshot = kMinWriterSnapshot + nextWriter_++ % UINT32_MAX;
+  WriteSet &set = writers_[*snapshot];
+  set.slot_ = slot;
+  set.begin_ = begin;
+  return kOk;
+}
+
+BufferManager::WriteSet *BufferManager::Writer(uint64_t snapshot) {
+  std::lock_guard<std::mutex> lock(writersMutex_);
+  return &writers_[snapshot];
+}
+
+void BufferManager::EndWrite(uint64_t snapshot) {
+  std::lock_guard<std::mutex> lock(writersMutex_);
+  auto iter = writers_.find(snapshot);
+  for (PageNo no : iter->second.pages_) {
+    Shard(no)->Unlock(no);
+  }
+  wal_->EndRead(iter->second.slot_);
+  writers_.erase(iter);
+}
+
+Code BufferManager::MarkDirty(MemPage **page, uint64_t snapshot) {
+  MemPage *old = *page;
+  Frame *frame;
+  bool locked;
+
+  if (old->Version() == kDirtyVersion) {
+    return kOk;
+  }
+  PageNo no = old->MemPageNo();
+  BufferShard *shard = Shard(no);
+  WriteSet *set = Writer(snapshot);
+  Code code = shard->Lock(no, snapshot, set->shared_ == 0, &locked);
+  if (code != kOk) {
+    return code;
+  }
+
+  // Once locked the page cannot change, but it may have changed between
+  // the read and the lock.
+  if (!IsLatest(old, snapshot)) {
+    // Do not keep a page the writer has not modified, so that it can
+    // still wait for the others.
+    if (locked) {
+      shard->Unlock(no);
+    }
+    return kConflict;
+  }
+  if (locked) {
+    set->pages_.push_back(no);
+    ++set->shared_;
+  }
+
+  code = shard->CopyOnWrite(no, old->Version(), &frame);
+  if (code != kOk) {
+    return code;
+  }
+  *page = &frame->memPage_;
+  return kOk;
+}
+
+Code BufferManager::AllocatePage(char flags, uint64_t snapshot,
+                                 MemPage **page, PageNo near) {
+  return NewPage(AllocateRun(1, snapshot, near), flags, page);
+}
+
+Code BufferManager::AllocateOverflowPage(uint64_t snapshot, MemPage **page) {
+  return NewOverflowPage(AllocateRun(1, snapshot), page);
+}
+
+PageNo BufferManager::AllocateRun(int n, uint64_t snapshot, PageNo near) {
+  std::lock_guard<std::mutex> lock(allocMutex_);
+  return TakeRun(n, snapshot, near);
+}
+
+PageNo BufferManager::AllocatePartialRun(int n, uint64_t snapshot,
+                                         int *got) {
+  std::lock_guard<std::mutex> lock(allocMutex_);
+  int longest = static_cast<int>(freeList_->Longest());
+  *got = longest > 0 ? std::min(n, longest) : n;
+  return TakeRun(*got, snapshot, kInvalidPageNo);
+}
+
+PageNo BufferManager::TakeRun(int n, uint64_t snapshot, PageNo near) {
+  PageNo no = freeList_->Allocate(n, near);
+  if (no == kInvalidPageNo) {
+    no = pageCount_ + 1;
+    pageCount_ += n;
+  }
+
+  // No other writer can reach the new pages, the locks only mark them as
+  // pages of the writer for GetPage and Commit.
+  WriteSet *set = Writer(snapshot);
+  for (int i = 0; i < n; ++i) {
+    bool locked;
+    Shard(no + i)->Lock(no + i, snapshot, false, &locked);
+    Assert(locked);
+    set->pages_.push_back(no + i);
+    set->allocated_.push_back(no + i);
+  }
+  return no;
+}
+
+Code BufferManager::NewPage(PageNo no, char flags, MemPage **page) {
+  Frame *frame;
+
+  Code code = NewFrame(no, &frame);
+  if (code != kOk) {
+    return code;
+  }
+  frame->memPage_.Format(&frame->page_, flags);
+  frame->memPage_.SetVersion(kDirtyVersion);
+
+  *page = &frame->memPage_;
+  return kOk;
+}
+
+Code BufferManager::NewOverflowPage(PageNo no, MemPage **page) {
+  Frame *frame;
+
+  Code code = NewFrame(no, &frame);
+  if (code != kOk) {
+    return code;
+  }
+  frame->memPage_.InitOverflow(&frame->page_);
+  frame->memPage_.SetVersion(kDirtyVersion);
+
+  *page = &frame->memPage_;
+  return kOk;
+}
+
+Code BufferManager::NewFrame(PageNo no, Frame **frame) {
+  Assert(no != kInvalidPageNo && no <= pageCount_);
+  return Shard(no)->NewFrame(no, frame);
+}
+
+void BufferManager::FreePage(PageNo no, uint64_t snapshot) {
+  Assert(no > 1 && no <= pageCount_);
+  Writer(snapshot)->freed_.push_back(no);
+}
+
+PageNo BufferManager::FreePageCount() const {
+  std::lock_guard<std::mutex> lock(allocMutex_);
+  return freeList_->Count();
+}
+
+bool BufferManager::IsFreePage(PageNo no) const {
+  std::lock_guard<std::mutex> lock(allocMutex_);
+  return freeList_->Contains(no);
+}
+
+Code BufferManager::MovePage(PageNo from, PageNo to, uint64_t snapshot,
+                            bool overflow) {
+  MemPage *source;
+  Frame *frame;
+
+  Code code = GetPage(from, snapshot, overflow, &source);
+  if (code != kOk) {
+    return code;
+  }
+  code = NewFrame(to, &frame);
+  if (code == kOk) {
+    memcpy(frame->buffer_, source->Data(), pageSize_);
+    if (source->IsOverflow()) {
+      frame->memPage_.InitOverflow(&frame->page_);
+    } else {
+      code = frame->memPage_.InitFromPage(&frame->page_);
+    }
+    frame->memPage_.SetVersion(kDirtyVersion);
+    ReleasePage(&frame->memPage_);
+  }
+  ReleasePage(source);
+  return code;
+}
+
+void BufferManager::Truncate(PageNo count, uint64_t snapshot) {
+  std::lock_guard<std::mutex> lock(allocMutex_);
+  for (PageNo no = count + 1; no <= pageCount_; ++no) {
+    Shard(no)->DropDirty(no);
+  }
+  freeList_->TruncateAfter(count);
+  pageCount_ = count;
+  Writer(snapshot)->truncated_ = true;
+}
+
+Code BufferManager::TruncateFile() {
+  uint64_t fileSize;
+  PageNo dbSize = wal_->DbSize();
+
+  if (dbSize == kInvalidPageNo || !wal_->IsEmpty()) {
+    return kOk;
+  }
+  Code code = file_->Size(&fileSize);
+  if (code != kOk) {
+    return code;
+  }
+  PageNo filePages = fileSize / pageSize_;
+  if (filePages <= dbSize) {
+    return kOk;
+  }
+
+  // Every snapshot is newer than the commit which freed the pages, so
+  // nothing reads them and their images can go.
+  for (PageNo no = dbSize + 1; no <= filePages; ++no) {
+    Shard(no)->Purge(no, kDbFileVersion);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mapMutex_);
+    uint64_t end = static_cast<uint64_t>(dbSize) * pageSize_;
+    if (mapEnd_.load(std::memory_order_relaxed) > end) {
+      mapEnd_.store(end, std::memory_order_release);
+    }
+  }
+  code = file_->Truncate(static_cast<uint64_t>(dbSize) * pageSize_);
+  if (code != kOk) {
+    return code;
+  }
+  return file_->Sync();
+}
+
+Code BufferManager::BeginRead(int *slot, uint64_t *snapshot) {
+  return wal_->BeginRead(slot, snapshot);
+}
+
+void BufferManager::EndRead(int slot) { wal_->EndRead(slot); }
+
+Code BufferManager::Commit(uint64_t snapshot, const ReadSet &reads,
+                           uint64_t *commitLsn) {
+  std::lock_guard<std::mutex> lock(allocMutex_);
+  WriteSet *set = Writer(snapshot);
+
+  // The commits are ordered by allocMutex_, no other one can come between
+  // the check and the append.
+  Code code = Validate(*set, reads);
+  if (code != kOk) {
+    Undo(set);
+    EndWrite(snapshot);
+    return kConflict;
+  }
+
+  // No committed page refers to the freed pages after this commit. Pages
+  // cut off by a vacuum are gone already.
+  for (PageNo no : set->freed_) {
+    if (no <= pageCount_) {
+      freeList_->Free(no);
+    }
+  }
+
+  code = AppendFrames(set->pages_, !set->freed_.empty(), commitLsn);
+  if (code != kOk) {
+    // The changes are lost, the pages go back to their committed version
+    // and the freed ones are still in use.
+    for (PageNo no : set->freed_) {
+      if (no <= pageCount_) {
+        freeList_->Take(no);
+      }
+    }
+    // The error of the append is the one returned.
+    Undo(set);
+    EndWrite(snapshot);
+    return code;
+  }
+  committedCount_ = pageCount_;
+
+  // The writers still running may have read the freed pages, they are
+  // told by freedAt_. It only has to go back to the oldest of them.
+  uint64_t oldest = UINT64_MAX;
+  {
+    std::lock_guard<std::mutex> writersLock(writersMutex_);
+    for (auto &iter : writers_) {
+      if (iter.first != snapshot) {
+        oldest = std::min(oldest, iter.second.begin_);
+      }
+    }
+  }
+  for (auto iter = freedAt_.begin(); iter != freedAt_.end();) {
+    if (iter->second <= oldest) {
+      iter = freedAt_.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+  if (oldest != UINT64_MAX) {
+    for (PageNo no : set->freed_) {
+      freedAt_[no] = *commitLsn;
+    }
+  }
+  EndWrite(snapshot);
+  return kOk;
+}
+
+Code BufferManager::Rollback(uint64_t snapshot) {
+  std::lock_guard<std::mutex> lock(allocMutex_);
+  Code code = Undo(Writer(snapshot));
+  EndWrite(snapshot);
+  return code;
+}
+
+Code BufferManager::Validate(const WriteSet &set, const ReadSet &reads) {
+  for (auto &iter : reads) {
+    PageNo no = iter.first;
+    // A version the writer read is only checkpointed if no commit after
+    // it began has replaced it, since the writer holds a reader slot.
+    uint64_t latest = wal_->Lookup(no, kLatestSnapshot);
+    auto freed = freedAt_.find(no);
+    if ((latest != iter.second && latest != kDbFileVersion) ||
+        (freed != freedAt_.end() && freed->second > set.begin_)) {
+      return SaveErrorStatus(Status(
+          kConflict,
+          FormatString("page %u read by the transaction has been changed "
+                       "by another one",
+                       no)));
+    }
+  }
+  return kOk;
+}
+
+Code BufferManager::Undo(WriteSet *set) {
+  for (PageNo no : set->pages_) {
+    Shard(no)->DropDirty(no);
+  }
+
+  // A vacuum runs alone, so the freelist and the size of the database
+  // are the committed ones again once it is reloaded.
+  if (set->truncated_) {
+    pageCount_ = committedCount_;
+    return freeList_->Load();
+  }
+  for (PageNo no : set->allocated_) {
+    freeList_->Free(no);
+  }
+  return kOk;
+}
+
+Code BufferManager::CommitPages(const std::vector<MemPage *> &pages,
+                                uint64_t *commitLsn) {
+  std::lock_guard<std::mutex> lock(allocMutex_);
+  std::vector<PageNo> nos;
+
+  for (MemPage *page : pages) {
+    nos.push_back(page->MemPageNo());
+  }
+  return AppendFrames(nos, false, commitLsn);
+}
+
+Code BufferManager::AppendFrames(const std::vector<PageNo> &dirty, bool freed,
+                                 uint64_t *commitLsn) {
+  std::vector<PageNo> nos(dirty);
+  std::vector<PageNo> trunkNos;
+  std::vector<WalPage> pages;
+  std::vector<char> page1;
+  bool saved = false;
+  Code code;
+
+  // The freelist goes with every commit that changed it, so that the
+  // committed freelist never hands out the pages committed here.
+  if (freeList_->IsDirty()) {
+    std::vector<MemPage *> trunks;
+    code = freeList_->Save(&trunks);
+    for (MemPage *trunk : trunks) {
+      trunkNos.push_back(trunk->MemPageNo());
+      ReleasePage(trunk);
+    }
+    if (code != kOk) {
+      for (PageNo no : trunkNos) {
+        Shard(no)->DropDirty(no);
+      }
+      return code;
+    }
+    nos.insert(nos.end(), trunkNos.begin(), trunkNos.end());
+    saved = true;
+  }
+
+  // A page the writer modified and freed may be a trunk now.
+  std::sort(nos.begin(), nos.end());
+  nos.erase(std::unique(nos.begin(), nos.end()), nos.end());
+
+  // Page 1 of a writer was copied before the commits of the others, its
+  // freelist header is rewritten. Without it the header goes with a copy
+  // of the latest page 1, the tree on it is left to its writer. The copy
+  // is read before the dirty frames are pinned, they may take all the
+  // frames of its shard.
+  bool ownPage1 = !nos.empty() && nos[0] == 1 &&
+                  (Shard(1)->IsCached(1, kDirtyVersion) || spill_->Contains(1));
+  code = kOk;
+  if (saved && !ownPage1) {
+    MemPage *page;
+    code = GetPage(1, kLatestSnapshot, &page);
+    if (code == kOk) {
+      page1.assign(page->Data(), page->Data() + pageSize_);
+      ReleasePage(page);
+      freeList_->WriteHeader(page1.data());
+      pages.push_back(WalPage{1, page1.data()});
+    }
+  }
+
+  // Pin the dirty frames so that no eviction spills them meanwhile, and
+  // read the spilled pages back. Pages appended by CommitPages or cut off
+  // have neither.
+  std::vector<PageNo> found;
+  std::vector<Frame *> frames;
+  size_t spilled = 0;
+  for (size_t i = 0; code == kOk && i < nos.size(); ++i) {
+    Frame *frame = Shard(nos[i])->PinDirty(nos[i]);
+    if (frame || spill_->Contains(nos[i])) {
+      found.push_back(nos[i]);
+      frames.push_back(frame);
+      spilled += frame ? 0 : 1;
+    }
+  }
+  std::vector<char> images(spilled * pageSize_);
+  std::vector<char *> data(found.size());
+  for (size_t i = 0, j = 0; i < found.size(); ++i) {
+    if (frames[i]) {
+      data[i] = frames[i]->buffer_;
+    } else {
+      data[i] = &images[pageSize_ * j++];
+      if (code == kOk) {
+        code = spill_->Read(found[i], data[i]);
+      }
+    }
+  }
+
+  if (code == kOk && !found.empty() && found[0] == 1) {
+    freeList_->WriteHeader(data[0]);
+  }
+  for (size_t i = 0; i < found.size(); ++i) {
+    pages.push_back(WalPage{found[i], data[i]});
+  }
+
+  // The frames become committed versions, numbered in append order,
+  // before anyone can look the versions up. The last free is known
+  // before any snapshot sees it as well.
+  if (code == kOk) {
+    code = wal_->Append(pages, pageCount_, commitLsn, [&](uint64_t lsn) {
+      if (freed) {
+        lastFreeLsn_.store(*commitLsn, std::memory_order_release);
+      }
+      if (!page1.empty()) {
+        ++lsn;
+      }
+      for (Frame *frame : frames) {
+        if (frame) {
+          Shard(frame->page_.DiskPageNo())->Commit(frame, lsn);
+        }
+        ++lsn;
+      }
+    });
+  }
+  for (size_t i = 0; i < found.size(); ++i) {
+    if (frames[i]) {
+      ReleasePage(&frames[i]->memPage_);
+    } else if (code == kOk) {
+      spill_->Drop(found[i]);
+    }
+  }
+  if (code != kOk && saved) {
+    // The freelist in the log is still the one before, and the trunks
+    // written for it are dropped.
+    freeList_->SetDirty();
+    for (PageNo no : trunkNos) {
+      Shard(no)->DropDirty(no);
+    }
+  }
+  return code;
+}
+
+Code BufferManager::Sync(uint64_t lsn) {
+  Code code = wal_->Sync(lsn);
+  if (code != kOk) {
+    return code;
+  }
+  if (wal_->NeedCheckpoint()) {
+    return Checkpoint();
+  }
+  return kOk;
+}
 
-BufferManager::~BufferManager() {}
-} // namespace udb
\ No newline at end of file
+Code BufferManager::Checkpoint() {
+  // The database file image of a backfilled page has changed, and the
+  // backfilled version is read from the database file from now on.
+  // No reader can still use the old image, since every snapshot is
+  // newer than the backfilled version.
+  Code code = wal_->Checkpoint([this](PageNo no, uint64_t version) {
+    BufferShard *shard = Shard(no);
+    shard->Purge(no, kDbFileVersion);
+    shard->Purge(no, version);
+  });
+  if (code != kOk) {
+    return code;
+  }
+  return TruncateFile();
+}
+} // namespace udb
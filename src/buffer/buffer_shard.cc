@@ -0,0 +1,517 @@
+#include "buffer/buffer_shard.h"
+#include "buffer/buffer_manager.h"
+#include "common/debug.h"
+#include "common/metrics.h"
+#include "common/string.h"
+
+#include <string.h>
+
+namespace udb {
+
+void FrameList::PushFront(Frame *frame) {
+  frame->prev_ = nullptr;
+  frame->next_ = head_;
+  if (head_) {
+    head_->prev_ = frame;
+  } else {
+    tail_ = frame;
+  }
+  head_ = frame;
+  ++size_;
+}
+
+void FrameList::Remove(Frame *frame) {
+  if (frame->prev_) {
+    frame->prev_->next_ = frame->next_;
+  } else {
+    head_ = frame->next_;
+  }
+  if (frame->next_) {
+    frame->next_->prev_ = frame->prev_;
+  } else {
+    tail_ = frame->prev_;
+  }
+  frame->prev_ = frame->next_ = nullptr;
+  --size_;
+}
+
+BufferShard::BufferShard()
+    : pager_(nullptr), kin_(0), kout_(0), loads_(0),
+      staleVersion_(kDirtyVersion - 1) {}
+
+void BufferShard::Init(BufferManager *pager, Frame *frames, int frameNum) {
+  pager_ = pager;
+  for (int i = 0; i < frameNum; ++i) {
+    frames[i].queue_ = kFreeQueue;
+    free_.PushFront(&frames[i]);
+  }
+
+  // The sizes recommended by the 2Q paper.
+  kin_ = std::max(1, frameNum / 4);
+  kout_ = std::max(1, frameNum / 2);
+}
+
+FrameList &BufferShard::Queue(FrameQueue queue) {
+  switch (queue) {
+  case kA1inQueue:
+    return a1in_;
+  case kAmQueue:
+    return am_;
+  default:
+    return free_;
+  }
+}
+
+Frame *BufferShard::PinCached(std::unique_lock<std::mutex> &lock,
+                              const FrameKey &key) {
+  while (true) {
+    auto iter = table_.find(key);
+    if (iter == table_.end()) {
+      return nullptr;
+    }
+    Frame *frame = iter->second;
+    if (frame->loading_) {
+      // Another thread is reading the page, wait for it and look up again
+      // since the read may have failed.
+      loaded_.wait(lock);
+      continue;
+    }
+
+    // Hit. Only pages in Am are reordered, a hit in A1in is usually a
+    // correlated reference and does not make the page hot.
+    ++frame->pinCount_;
+    if (frame->queue_ == kAmQueue) {
+      am_.Remove(frame);
+      am_.PushFront(frame);
+    }
+    return frame;
+  }
+}
+
+Frame *BufferShard::Lookup(PageNo no, uint64_t version) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return PinCached(lock, FrameKey{no, version});
+}
+
+Code BufferShard::LookupDirty(PageNo no, uint64_t owner, Frame **frame) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto iter = owners_.find(no);
+  *frame = nullptr;
+  if (iter == owners_.end() || iter->second != owner) {
+    return kOk;
+  }
+  *frame = PinCached(lock, FrameKey{no, kDirtyVersion});
+  if (*frame == nullptr && pager_->IsSpilled(no)) {
+    return Unspill(no, frame);
+  }
+  return kOk;
+}
+
+bool BufferShard::IsCached(PageNo no, uint64_t version) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return table_.count(FrameKey{no, version}) > 0;
+}
+
+Code BufferShard::Fetch(PageNo no, uint64_t version, Frame **result,
+                        bool overflow) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  FrameKey key{no, version};
+  Frame *frame;
+  Code code;
+
+  frame = PinCached(lock, key);
+  if (frame) {
+    RecordTick(kCacheHits);
+    *result = frame;
+    return kOk;
+  }
+  RecordTick(kCacheMisses);
+
+  // Miss, get a frame and read the page into it.
+  code = GetVictim(&frame);
+  if (code != kOk) {
+    return code;
+  }
+
+  frame->page_.Init(no, frame->buffer_, pager_->PageSize());
+  frame->version_ = version;
+  frame->pinCount_ = 1;
+  frame->dirty_ = false;
+  frame->loading_ = true;
+  frame->queue_ = ForgetGhost(no) ? kAmQueue : kA1inQueue;
+  Queue(frame->queue_).PushFront(frame);
+  table_[key] = frame;
+
+  // Do not hold the latch while reading the file.
+  lock.unlock();
+  code = pager_->ReadFrame(frame);
+  if (code == kOk) {
+    if (overflow) {
+      frame->memPage_.InitOverflow(&frame->page_);
+    } else {
+      code = frame->memPage_.InitFromPage(&frame->page_);
+    }
+  }
+  lock.lock();
+
+  // Purge may have renamed the frame meanwhile.
+  frame->loading_ = false;
+  if (code != kOk) {
+    table_.erase(FrameKey{no, frame->version_});
+    Queue(frame->queue_).Remove(frame);
+    FreeFrame(frame);
+  } else {
+    frame->memPage_.SetVersion(frame->version_);
+    *result = frame;
+  }
+  loaded_.notify_all();
+
+  return code;
+}
+
+Frame *BufferShard::StartLoad(PageNo no, uint64_t version) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  FrameKey key{no, version};
+  Frame *frame;
+
+  // The reads in flight leave the pool to the pages in use. A readahead
+  // without a frame is simply skipped, it is no error of the reader.
+  if (loads_ >= kin_ || table_.count(key) > 0 ||
+      GetVictim(&frame, false, false) != kOk) {
+    return nullptr;
+  }
+  ++loads_;
+  frame->page_.Init(no, frame->buffer_, pager_->PageSize());
+  frame->version_ = version;
+  frame->pinCount_ = 1;
+  frame->dirty_ = false;
+  frame->loading_ = true;
+  // Not referenced yet, so the page is not taken as hot.
+  frame->queue_ = kA1inQueue;
+  a1in_.PushFront(frame);
+  table_[key] = frame;
+  return frame;
+}
+
+void BufferShard::FinishLoad(Frame *frame, Code code) {
+  // Parse without the latch, the frame is not used until loaded.
+  if (code == kOk) {
+    code = frame->memPage_.InitFromPage(&frame->page_);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  frame->loading_ = false;
+  --frame->pinCount_;
+  --loads_;
+  if (code != kOk) {
+    // A reader of the page reads it again.
+    table_.erase(FrameKey{frame->page_.DiskPageNo(), frame->version_});
+    Queue(frame->queue_).Remove(frame);
+    FreeFrame(frame);
+  } else {
+    frame->memPage_.SetVersion(frame->version_);
+  }
+  loaded_.notify_all();
+}
+
+void BufferShard::Unpin(Frame *frame) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Assert(frame->pinCount_ > 0);
+  --frame->pinCount_;
+}
+
+Code BufferShard::NewFrame(PageNo no, Frame **result) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Frame *frame;
+
+  // The page has a dirty frame already, e.g. a freelist trunk rewritten.
+  // A spilled image is replaced as well.
+  pager_->DropSpilled(no);
+  auto iter = table_.find(FrameKey{no, kDirtyVersion});
+  if (iter != table_.end()) {
+    frame = iter->second;
+    memset(frame->buffer_, 0, pager_->PageSize());
+    frame->page_.Init(no, frame->buffer_, pager_->PageSize());
+    ++frame->pinCount_;
+    *result = frame;
+    return kOk;
+  }
+
+  Code code = GetVictim(&frame);
+  if (code != kOk) {
+    return code;
+  }
+  memset(frame->buffer_, 0, pager_->PageSize());
+  frame->page_.Init(no, frame->buffer_, pager_->PageSize());
+  frame->version_ = kDirtyVersion;
+  frame->pinCount_ = 1;
+  frame->dirty_ = true;
+  frame->loading_ = false;
+  frame->queue_ = kAmQueue;
+  am_.PushFront(frame);
+  table_[FrameKey{no, kDirtyVersion}] = frame;
+
+  *result = frame;
+  return kOk;
+}
+
+Code BufferShard::CopyOnWrite(PageNo no, uint64_t version, Frame **result) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = table_.find(FrameKey{no, version});
+  Assert(iter != table_.end());
+  Frame *frame = iter->second;
+  Frame *copy;
+  Code code;
+
+  // The writer has modified the page through another pin already.
+  auto dirty = table_.find(FrameKey{no, kDirtyVersion});
+  if (dirty != table_.end()) {
+    ++dirty->second->pinCount_;
+    --frame->pinCount_;
+    *result = dirty->second;
+    return kOk;
+  }
+  if (pager_->IsSpilled(no)) {
+    code = Unspill(no, result);
+    if (code == kOk) {
+      --frame->pinCount_;
+    }
+    return code;
+  }
+
+  // The committed version stays for the readers, the writer
+  // modifies its own copy.
+  code = GetVictim(&copy);
+  if (code != kOk) {
+    return code;
+  }
+  memcpy(copy->buffer_, frame->page_.Data(), pager_->PageSize());
+  copy->page_.Init(no, copy->buffer_, pager_->PageSize());
+  if (frame->memPage_.IsOverflow()) {
+    copy->memPage_.InitOverflow(&copy->page_);
+    code = kOk;
+  } else {
+    code = copy->memPage_.InitFromPage(&copy->page_);
+  }
+  if (code != kOk) {
+    FreeFrame(copy);
+    return code;
+  }
+  copy->memPage_.SetVersion(kDirtyVersion);
+  copy->version_ = kDirtyVersion;
+  copy->pinCount_ = 1;
+  copy->dirty_ = true;
+  copy->loading_ = false;
+  copy->queue_ = kAmQueue;
+  am_.PushFront(copy);
+  table_[FrameKey{no, kDirtyVersion}] = copy;
+  --frame->pinCount_;
+
+  *result = copy;
+  return kOk;
+}
+
+Frame *BufferShard::PinDirty(PageNo no) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = table_.find(FrameKey{no, kDirtyVersion});
+  if (iter == table_.end()) {
+    return nullptr;
+  }
+  ++iter->second->pinCount_;
+  return iter->second;
+}
+
+Code BufferShard::Unspill(PageNo no, Frame **result) {
+  Frame *frame;
+  Code code = GetVictim(&frame);
+  if (code != kOk) {
+    return code;
+  }
+  frame->page_.Init(no, frame->buffer_, pager_->PageSize());
+  code = pager_->ReadSpilled(frame);
+  if (code != kOk) {
+    FreeFrame(frame);
+    return code;
+  }
+  frame->version_ = kDirtyVersion;
+  frame->pinCount_ = 1;
+  frame->dirty_ = true;
+  frame->loading_ = false;
+  frame->queue_ = kAmQueue;
+  am_.PushFront(frame);
+  table_[FrameKey{no, kDirtyVersion}] = frame;
+
+  *result = frame;
+  return kOk;
+}
+
+void BufferShard::Commit(Frame *frame, uint64_t lsn) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  PageNo no = frame->page_.DiskPageNo();
+
+  table_.erase(FrameKey{no, kDirtyVersion});
+  table_[FrameKey{no, lsn}] = frame;
+  frame->version_ = lsn;
+  frame->memPage_.SetVersion(lsn);
+  frame->dirty_ = false;
+}
+
+void BufferShard::Purge(PageNo no, uint64_t version) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = table_.find(FrameKey{no, version});
+  if (iter == table_.end()) {
+    return;
+  }
+  Frame *frame = iter->second;
+  if (frame->dirty_) {
+    return;
+  }
+  table_.erase(iter);
+  if (frame->pinCount_ > 0) {
+    // A writer may still hold the version a checkpoint has backfilled,
+    // after which the version of the database file would match it again.
+    // A page being read ahead may get the image before the backfill.
+    frame->version_ = staleVersion_--;
+    frame->memPage_.SetVersion(frame->version_);
+    table_[FrameKey{no, frame->version_}] = frame;
+    return;
+  }
+  Queue(frame->queue_).Remove(frame);
+  FreeFrame(frame);
+}
+
+void BufferShard::DropDirty(PageNo no) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pager_->DropSpilled(no);
+  auto iter = table_.find(FrameKey{no, kDirtyVersion});
+  if (iter == table_.end()) {
+    return;
+  }
+  Frame *frame = iter->second;
+  Assert(frame->pinCount_ == 0);
+  table_.erase(iter);
+  Queue(frame->queue_).Remove(frame);
+  FreeFrame(frame);
+}
+
+Code BufferShard::Lock(PageNo no, uint64_t owner, bool wait, bool *locked) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  *locked = false;
+  while (true) {
+    auto iter = owners_.find(no);
+    if (iter == owners_.end()) {
+      owners_[no] = owner;
+      *locked = true;
+      return kOk;
+    }
+    if (iter->second == owner) {
+      return kOk;
+    }
+    if (!wait) {
+      return SaveErrorStatus(Status(
+          kBusy, FormatString("page %u is locked by another writer", no)));
+    }
+    unlocked_.wait(lock);
+  }
+}
+
+void BufferShard::Unlock(PageNo no) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  owners_.erase(no);
+  unlocked_.notify_all();
+}
+
+void BufferShard::FreeFrame(Frame *frame) {
+  frame->pinCount_ = 0;
+  frame->dirty_ = false;
+  frame->queue_ = kFreeQueue;
+  free_.PushFront(frame);
+}
+
+Frame *BufferShard::PickVictim(const FrameList &list, bool dirty) const {
+  for (Frame *frame = list.Tail(); frame != nullptr; frame = frame->prev_) {
+    if (frame->pinCount_ == 0 && frame->dirty_ == dirty) {
+      return frame;
+    }
+  }
+  return nullptr;
+}
+
+Code BufferShard::GetVictim(Frame **result, bool spill, bool saveError) {
+  Frame *frame = free_.Tail();
+
+  if (frame) {
+    free_.Remove(frame);
+    *result = frame;
+    return kOk;
+  }
+
+  // Evict from A1in when it is over its share, so that pages seen only once
+  // leave the cache before any page of Am does.
+  frame = nullptr;
+  if (a1in_.Size() > kin_) {
+    frame = PickVictim(a1in_, false);
+  }
+  if (!frame) {
+    frame = PickVictim(am_, false);
+  }
+  if (!frame) {
+    frame = PickVictim(a1in_, false);
+  }
+
+  // The writers have modified the whole shard, the dirty page used least
+  // recently goes to the spill file. The latch is held meanwhile, but a
+  // writer that large is rare.
+  if (!frame && spill) {
+    frame = PickVictim(am_, true);
+    if (frame) {
+      Code code = pager_->Spill(frame);
+      if (code != kOk) {
+        return code;
+      }
+    }
+  }
+  if (!frame && !saveError) {
+    return kNoFreeFrame;
+  }
+  if (!frame) {
+    return SaveErrorStatus(
+        Status(kNoFreeFrame, "all frames of the buffer shard are pinned"));
+  }
+
+  RecordTick(kCacheEvictions);
+  PageNo no = frame->page_.DiskPageNo();
+  if (frame->queue_ == kA1inQueue) {
+    RememberGhost(no);
+  }
+  Queue(frame->queue_).Remove(frame);
+  frame->queue_ = kFreeQueue;
+  table_.erase(FrameKey{no, frame->version_});
+
+  *result = frame;
+  return kOk;
+}
+
+void BufferShard::RememberGhost(PageNo no) {
+  if (ghosts_.count(no) > 0) {
+    return;
+  }
+  if (static_cast<int>(a1out_.size()) >= kout_) {
+    ghosts_.erase(a1out_.back());
+    a1out_.pop_back();
+  }
+  a1out_.push_front(no);
+  ghosts_[no] = a1out_.begin();
+}
+
+bool BufferShard::ForgetGhost(PageNo no) {
+  auto iter = ghosts_.find(no);
+  if (iter == ghosts_.end()) {
+    return false;
+  }
+  a1out_.erase(iter->second);
+  ghosts_.erase(iter);
+  return true;
+}
+} // namespace udb
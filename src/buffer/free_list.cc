@@ -0,0 +1,240 @@
+#include "buffer/free_list.h"
+#include "buffer/buffer_manager.h"
+#include "buffer/mem_page.h"
+#include "common/bytes.h"
+#include "common/debug.h"
+#include "common/string.h"
+#include "storage/page_layout.h"
+
+#include <algorithm>
+
+namespace udb {
+FreeList::FreeList(BufferManager *pager)
+    : pager_(pager), count_(0), trunk_(kInvalidPageNo), dirty_(false) {}
+
+int FreeList::TrunkCapacity() const { return (pager_->PageSize() - 8) / 4; }
+
+Code FreeList::Load() {
+  MemPage *page1;
+  Code code;
+
+  extents_.clear();
+  count_ = 0;
+  dirty_ = false;
+
+  code = pager_->GetPage(1, kLatestSnapshot, &page1);
+  if (code != kOk) {
+    return code;
+  }
+  PageNo trunk = Get4Byte(&page1->Data()[kFileHeaderFreelistTrunkOffset]);
+  trunk_ = trunk;
+  PageNo total = Get4Byte(&page1->Data()[kFileHeaderFreelistCountOffset]);
+  pager_->ReleasePage(page1);
+
+  PageNo pageCount = pager_->PageCount();
+  int capacity = TrunkCapacity();
+  auto valid = [&](PageNo no) { return no >= 2 && no <= pageCount; };
+
+  while (trunk != kInvalidPageNo) {
+    MemPage *page;
+    if (!valid(trunk) || count_ >= total) {
+      return SaveErrorStatus(Status(
+          kCorrupt, FormatString("invalid freelist trunk page %u", trunk)));
+    }
+    code = pager_->GetOverflowPage(trunk, kLatestSnapshot, &page);
+    if (code != kOk) {
+      return code;
+    }
+    const char *data = page->Data();
+    PageNo next = Get4Byte(data);
+    int n = Get4Byte(data + 4);
+    bool ok = n <= capacity;
+    for (int i = 0; ok && i < n; ++i) {
+      PageNo leaf = Get4Byte(data + 8 + 4 * i);
+      ok = valid(leaf) && !Contains(leaf);
+      if (ok) {
+        Free(leaf);
+      }
+    }
+    pager_->ReleasePage(page);
+    if (!ok || Contains(trunk)) {
+      return SaveErrorStatus(Status(
+          kCorrupt, FormatString("invalid freelist trunk page %u", trunk)));
+    }
+    Free(trunk);
+    trunk = next;
+  }
+  if (count_ != total) {
+    return SaveErrorStatus(Status(
+        kCorrupt, FormatString("freelist has %u pages, the header says %u",
+                               count_, total)));
+  }
+  dirty_ = false;
+  return kOk;
+}
+
+PageNo FreeList::Allocate(int n, PageNo near) {
+  auto found = extents_.end();
+
+  // The nearest extent at or after near that is long enough, else the
+  // lowest one.
+  if (near != kInvalidPageNo) {
+    auto iter = extents_.upper_bound(near);
+    if (iter != extents_.begin()) {
+      auto prev = std::prev(iter);
+      if (prev->first + prev->second > near) {
+        iter = prev;
+      }
+    }
+    for (; iter != extents_.end() && found == extents_.end(); ++iter) {
+      if (iter->second >= static_cast<PageNo>(n)) {
+        found = iter;
+      }
+    }
+  }
+  for (auto iter = extents_.begin();
+       iter != extents_.end() && found == extents_.end(); ++iter) {
+    if (iter->second >= static_cast<PageNo>(n)) {
+      found = iter;
+    }
+  }
+  if (found == extents_.end()) {
+    return kInvalidPageNo;
+  }
+
+  // Take the pages from near if it is inside the extent.
+  PageNo first = found->first;
+  PageNo size = found->second;
+  PageNo start = first;
+  if (near > first && near + n <= first + size) {
+    start = near;
+  }
+  extents_.erase(found);
+  if (start > first) {
+    extents_[first] = start - first;
+  }
+  if (start + n < first + size) {
+    extents_[start + n] = first + size - start - n;
+  }
+  count_ -= n;
+  dirty_ = true;
+  return start;
+}
+
+void FreeList::Free(PageNo no) {
+  PageNo start = no;
+  PageNo size = 1;
+
+  // Merge with the extents before and after.
+  auto next = extents_.upper_bound(no);
+  if (next != extents_.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == no) {
+      start = prev->first;
+      size += prev->second;
+      extents_.erase(prev);
+    }
+  }
+  if (next != extents_.end() && next->first == no + 1) {
+    size += next->second;
+    extents_.erase(next);
+  }
+  extents_[start] = size;
+  ++count_;
+  dirty_ = true;
+}
+
+void FreeList::Take(PageNo no) {
+  auto iter = std::prev(extents_.upper_bound(no));
+  PageNo first = iter->first;
+  PageNo size = iter->second;
+  Assert(no >= first && no < first + size);
+
+  extents_.erase(iter);
+  if (no > first) {
+    extents_[first] = no - first;
+  }
+  if (no + 1 < first + size) {
+    extents_[no + 1] = first + size - no - 1;
+  }
+  --count_;
+  dirty_ = true;
+}
+
+void FreeList::TruncateAfter(PageNo no) {
+  auto iter = extents_.upper_bound(no);
+  if (iter != extents_.begin()) {
+    auto prev = std::prev(iter);
+    if (prev->first + prev->second > no + 1) {
+      count_ -= prev->first + prev->second - no - 1;
+      prev->second = no + 1 - prev->first;
+    }
+  }
+  for (auto i = iter; i != extents_.end(); ++i) {
+    count_ -= i->second;
+  }
+  extents_.erase(iter, extents_.end());
+  dirty_ = true;
+}
+
+bool FreeList::Contains(PageNo no) const {
+  auto iter = extents_.upper_bound(no);
+  if (iter == extents_.begin()) {
+    return false;
+  }
+  --iter;
+  return no < iter->first + iter->second;
+}
+
+PageNo FreeList::Longest() const {
+  PageNo n = 0;
+  for (auto &iter : extents_) {
+    n = std::max(n, iter.second);
+  }
+  return n;
+}
+
+Code FreeList::Save(std::vector<MemPage *> *trunks) {
+  std::vector<PageNo> pages;
+  MemPage *page;
+  Code code;
+
+  pages.reserve(count_);
+  for (auto &iter : extents_) {
+    for (PageNo i = 0; i < iter.second; ++i) {
+      pages.push_back(iter.first + i);
+    }
+  }
+
+  // The highest pages are the trunks, each holds the leaves before it.
+  int capacity = TrunkCapacity();
+  size_t n = (pages.size() + capacity) / (capacity + 1);
+  size_t leaves = pages.size() - n;
+  PageNo first = kInvalidPageNo;
+  for (size_t t = n; t-- > 0;) {
+    PageNo trunk = pages[leaves + t];
+    size_t begin = t * capacity;
+    size_t end = std::min(leaves, begin + capacity);
+    code = pager_->NewOverflowPage(trunk, &page);
+    if (code != kOk) {
+      return code;
+    }
+    char *data = page->Data();
+    Put4Byte(data, first);
+    Put4Byte(data + 4, end - begin);
+    for (size_t i = begin; i < end; ++i) {
+      Put4Byte(data + 8 + 4 * (i - begin), pages[i]);
+    }
+    trunks->push_back(page);
+    first = trunk;
+  }
+  trunk_ = first;
+  dirty_ = false;
+  return kOk;
+}
+
+void FreeList::WriteHeader(char *page1) const {
+  Put4Byte(&page1[kFileHeaderFreelistTrunkOffset], trunk_);
+  Put4Byte(&page1[kFileHeaderFreelistCountOffset], count_);
+}
+} // namespace udb
@@ -0,0 +1,100 @@
+#include "buffer/spill_file.h"
+#include "common/status.h"
+#include "common/string.h"
+#include "os/file.h"
+
+namespace udb {
+SpillFile::SpillFile(const std::string &dbPath, int pageSize)
+    : pageSize_(pageSize), file_(new File(dbPath + "-spill")), end_(0) {}
+
+SpillFile::~SpillFile() { delete file_; }
+
+Code SpillFile::Write(PageNo no, const char *data, bool overflow) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Code code;
+
+  // Images left by a crash are of no use, the writers are gone.
+  if (!file_->IsOpen()) {
+    code = file_->Open(true);
+    if (code == kOk) {
+      code = file_->Truncate(0);
+    }
+    if (code != kOk) {
+      file_->Close();
+      return code;
+    }
+  }
+
+  auto iter = slots_.find(no);
+  uint64_t index;
+  if (iter != slots_.end()) {
+    index = iter->second.index_;
+  } else if (!free_.empty()) {
+    index = free_.back();
+    free_.pop_back();
+  } else {
+    index = end_++;
+  }
+  code = file_->Write(index * pageSize_, data, pageSize_);
+  if (code != kOk) {
+    if (iter == slots_.end()) {
+      free_.push_back(index);
+    }
+    return code;
+  }
+  slots_[no] = Slot{index, overflow};
+  return kOk;
+}
+
+Code SpillFile::Take(PageNo no, char *buf, bool *overflow) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = slots_.find(no);
+  if (iter == slots_.end()) {
+    return SaveErrorStatus(
+        Status(kNotFound, FormatString("page %u is not spilled", no)));
+  }
+  Code code = file_->Read(iter->second.index_ * pageSize_, buf, pageSize_);
+  if (code != kOk) {
+    return code;
+  }
+  *overflow = iter->second.overflow_;
+  DropLocked(no);
+  return kOk;
+}
+
+Code SpillFile::Read(PageNo no, char *buf) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = slots_.find(no);
+  if (iter == slots_.end()) {
+    return SaveErrorStatus(
+        Status(kNotFound, FormatString("page %u is not spilled", no)));
+  }
+  return file_->Read(iter->second.index_ * pageSize_, buf, pageSize_);
+}
+
+bool SpillFile::Contains(PageNo no) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return slots_.count(no) > 0;
+}
+
+void SpillFile::Drop(PageNo no) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  DropLocked(no);
+}
+
+void SpillFile::DropLocked(PageNo no) {
+  auto iter = slots_.find(no);
+  if (iter == slots_.end()) {
+    return;
+  }
+  free_.push_back(iter->second.index_);
+  slots_.erase(iter);
+
+  // Give the space back once the last writer using it is done.
+  if (slots_.empty()) {
+    free_.clear();
+    end_ = 0;
+    file_->Truncate(0);
+  }
+}
+} // namespace udb
@@ -0,0 +1,53 @@
+#include "common/arena.h"
+
+namespace udb {
+static const size_t kArenaBlockSize = 8192;
+
+Arena::Arena()
+    : ptr_(nullptr), remaining_(0), first_(nullptr), usage_(0) {}
+
+Arena::~Arena() {
+  for (char *block : blocks_) {
+    delete[] block;
+  }
+  delete[] first_;
+}
+
+void Arena::Reset() {
+  for (char *block : blocks_) {
+    delete[] block;
+  }
+  blocks_.clear();
+  ptr_ = first_;
+  remaining_ = first_ ? kArenaBlockSize : 0;
+  usage_ = first_ ? kArenaBlockSize : 0;
+}
+
+char *Arena::AllocateFallback(size_t bytes) {
+  if (first_ == nullptr) {
+    first_ = new char[kArenaBlockSize];
+    usage_ += kArenaBlockSize;
+    ptr_ = first_;
+    remaining_ = kArenaBlockSize;
+    if (bytes <= remaining_) {
+      return Allocate(bytes);
+    }
+  }
+
+  // A large request gets a block of its own, so that the rest of the
+  // current block is not wasted.
+  if (bytes > kArenaBlockSize / 4) {
+    return AllocateNewBlock(bytes);
+  }
+  ptr_ = AllocateNewBlock(kArenaBlockSize);
+  remaining_ = kArenaBlockSize;
+  return Allocate(bytes);
+}
+
+char *Arena::AllocateNewBlock(size_t bytes) {
+  char *block = new char[bytes];
+  blocks_.push_back(block);
+  usage_ += bytes;
+  return block;
+}
+} // namespace udb
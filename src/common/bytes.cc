@@ -0,0 +1,93 @@
+#include "common/bytes.h"
+
+namespace udb {
+uint32_t Get4Byte(const char *p) {
+  const uint8_t *b = reinterpret_cast<const uint8_t *>(p);
+  return (static_cast<uint32_t>(b[0]) << 24) |
+         (static_cast<uint32_t>(b[1]) << 16) |
+         (static_cast<uint32_t>(b[2]) << 8) | static_cast<uint32_t>(b[3]);
+}
+
+void Put4Byte(char *p, uint32_t v) {
+  p[0] = static_cast<char>(v >> 24);
+  p[1] = static_cast<char>(v >> 16);
+  p[2] = static_cast<char>(v >> 8);
+  p[3] = static_cast<char>(v);
+}
+
+int GetVarint(const char *p, uint64_t *v) {
+  const uint8_t *b = reinterpret_cast<const uint8_t *>(p);
+  uint64_t x = 0;
+
+  // Fast path for the common one byte integer.
+  if (b[0] < 0x80) {
+    *v = b[0];
+    return 1;
+  }
+
+  for (int i = 0; i < 8; ++i) {
+    x = (x << 7) | (b[i] & 0x7f);
+    if (b[i] < 0x80) {
+      *v = x;
+      return i + 1;
+    }
+  }
+
+  // All 8 bits of the 9th byte are used.
+  *v = (x << 8) | b[8];
+  return 9;
+}
+
+int PutVarint(char *p, uint64_t v) {
+  char buf[10];
+  int n = 0;
+
+  if (v <= 0x7f) {
+    p[0] = static_cast<char>(v);
+    return 1;
+  }
+
+  if (v & (static_cast<uint64_t>(0xff000000) << 32)) {
+    p[8] = static_cast<char>(v);
+    v >>= 8;
+    for (int i = 7; i >= 0; --i) {
+      p[i] = static_cast<char>((v & 0x7f) | 0x80);
+      v >>= 7;
+    }
+    return 9;
+  }
+
+  do {
+    buf[n++] = static_cast<char>((v & 0x7f) | 0x80);
+    v >>= 7;
+  } while (v != 0);
+  buf[0] &= 0x7f;
+  for (int i = 0; i < n; ++i) {
+    p[i] = buf[n - 1 - i];
+  }
+  return n;
+}
+
+int VarintLen(uint64_t v) {
+  int n = 1;
+  if (v & (static_cast<uint64_t>(0xff000000) << 32)) {
+    return 9;
+  }
+  while (v > 0x7f) {
+    v >>= 7;
+    ++n;
+  }
+  return n;
+}
+
+void Checksum(const char *data, int n, uint32_t *sum) {
+  uint32_t s1 = sum[0];
+  uint32_t s2 = sum[1];
+  for (int i = 0; i < n; i += 8) {
+    s1 += Get4Byte(&data[i]) + s2;
+    s2 += Get4Byte(&data[i + 4]) + s1;
+  }
+  sum[0] = s1;
+  sum[1] = s2;
+}
+} // namespace udb
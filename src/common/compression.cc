@@ -0,0 +1,178 @@
+#include "common/compression.h"
+#include "common/bytes.h"
+#include "common/status.h"
+#include "common/string.h"
+
+#include <string.h>
+
+#ifdef UDB_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef UDB_WITH_ZSTD
+#include <zstd.h>
+#endif
+#ifdef UDB_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+namespace udb {
+// The levels favour speed, a page is small and read far more often than
+// it is written.
+static const int kZstdLevel = 1;
+static const int kZlibLevel = 1;
+
+static int Pad8(int n) { return (n + 7) & ~7; }
+
+bool CompressionSupported(CompressionType type) {
+  switch (type) {
+  case kNoCompression:
+    return true;
+#ifdef UDB_WITH_LZ4
+  case kLz4Compression:
+    return true;
+#endif
+#ifdef UDB_WITH_ZSTD
+  case kZstdCompression:
+    return true;
+#endif
+#ifdef UDB_WITH_ZLIB
+  case kZlibCompression:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+const char *CompressionName(CompressionType type) {
+  switch (type) {
+  case kNoCompression:
+    return "none";
+  case kLz4Compression:
+    return "lz4";
+  case kZstdCompression:
+    return "zstd";
+  case kZlibCompression:
+    return "zlib";
+  default:
+    return "unknown";
+  }
+}
+
+// Compress n bytes of src into dst of capacity bytes, return the bytes of
+// dst used or 0 if they do not fit.
+static int Compress(CompressionType type, const char *src, int n, char *dst,
+                    int capacity) {
+  switch (type) {
+#ifdef UDB_WITH_LZ4
+  case kLz4Compression:
+    return LZ4_compress_default(src, dst, n, capacity);
+#endif
+#ifdef UDB_WITH_ZSTD
+  case kZstdCompression: {
+    size_t size = ZSTD_compress(dst, capacity, src, n, kZstdLevel);
+    return ZSTD_isError(size) ? 0 : static_cast<int>(size);
+  }
+#endif
+#ifdef UDB_WITH_ZLIB
+  case kZlibCompression: {
+    uLongf size = capacity;
+    int r = compress2(reinterpret_cast<Bytef *>(dst), &size,
+                      reinterpret_cast<const Bytef *>(src), n, kZlibLevel);
+    return r == Z_OK ? static_cast<int>(size) : 0;
+  }
+#endif
+  default:
+    return 0;
+  }
+}
+
+// Decompress n bytes of src into dst of size bytes, return false unless
+// it is exactly filled.
+static bool Decompress(CompressionType type, const char *src, int n,
+                       char *dst, int size) {
+  switch (type) {
+#ifdef UDB_WITH_LZ4
+  case kLz4Compression:
+    return LZ4_decompress_safe(src, dst, n, size) == size;
+#endif
+#ifdef UDB_WITH_ZSTD
+  case kZstdCompression: {
+    size_t r = ZSTD_decompress(dst, size, src, n);
+    return !ZSTD_isError(r) && r == static_cast<size_t>(size);
+  }
+#endif
+#ifdef UDB_WITH_ZLIB
+  case kZlibCompression: {
+    uLongf r = size;
+    return uncompress(reinterpret_cast<Bytef *>(dst), &r,
+                      reinterpret_cast<const Bytef *>(src), n) == Z_OK &&
+           r == static_cast<uLongf>(size);
+  }
+#endif
+  default:
+    return false;
+  }
+}
+
+int CompressPage(CompressionType type, const char *page, int size,
+                 char *out) {
+  // Room for the image in one block fewer than the page takes.
+  int blocks = (size + kFileBlockSize - 1) / kFileBlockSize;
+  int capacity =
+      ((blocks - 1) * kFileBlockSize - kCompressedPageHeaderSize) & ~7;
+  if (type == kNoCompression || capacity <= 0) {
+    return 0;
+  }
+  int n = Compress(type, page, size, &out[kCompressedPageHeaderSize],
+                   capacity);
+  if (n <= 0) {
+    return 0;
+  }
+
+  int used = kCompressedPageHeaderSize + Pad8(n);
+  int total = (used + kFileBlockSize - 1) / kFileBlockSize * kFileBlockSize;
+  memset(&out[kCompressedPageHeaderSize + n], 0,
+         total - kCompressedPageHeaderSize - n);
+  uint32_t sum[2] = {0, 0};
+  Checksum(&out[kCompressedPageHeaderSize], Pad8(n), sum);
+  Put4Byte(&out[0], kCompressedPageMagic);
+  Put4Byte(&out[4], static_cast<uint32_t>(type) << 24 | n);
+  Put4Byte(&out[8], sum[0]);
+  Put4Byte(&out[12], sum[1]);
+  return total;
+}
+
+bool IsCompressedPage(const char *image, int size) {
+  if (Get4Byte(&image[0]) != kCompressedPageMagic) {
+    return false;
+  }
+  uint32_t word = Get4Byte(&image[4]);
+  int type = word >> 24;
+  int n = word & 0xffffff;
+  if (type == kNoCompression || type > kZlibCompression || n == 0 ||
+      kCompressedPageHeaderSize + Pad8(n) > size) {
+    return false;
+  }
+  uint32_t sum[2] = {0, 0};
+  Checksum(&image[kCompressedPageHeaderSize], Pad8(n), sum);
+  return Get4Byte(&image[8]) == sum[0] && Get4Byte(&image[12]) == sum[1];
+}
+
+Code DecompressPage(PageNo no, const char *image, int size, char *page) {
+  uint32_t word = Get4Byte(&image[4]);
+  CompressionType type = static_cast<CompressionType>(word >> 24);
+  if (!CompressionSupported(type)) {
+    return SaveErrorStatus(Status(
+        kCorrupt, FormatString("page %u is compressed by %s, which is not "
+                               "built in",
+                               no, CompressionName(type))));
+  }
+  if (!Decompress(type, &image[kCompressedPageHeaderSize], word & 0xffffff,
+                  page, size)) {
+    return SaveErrorStatus(Status(
+        kCorrupt, FormatString("can not decompress page %u", no)));
+  }
+  return kOk;
+}
+} // namespace udb
@@ -0,0 +1,175 @@
+#include "common/metrics.h"
+#include "common/string.h"
+#include "udb.h"
+
+#include <algorithm>
+#include <math.h>
+#include <mutex>
+#include <vector>
+
+namespace udb {
+constinit thread_local ThreadMetrics *gThreadMetrics = nullptr;
+
+static_assert(Histogram::kBuckets == kHistogramBuckets);
+
+// The Stats field of each ticker and histogram.
+static uint64_t Stats::*const kTickerFields[kTickerCount] = {
+    &Stats::cacheHits_,    &Stats::cacheMisses_,  &Stats::cacheEvictions_,
+    &Stats::cursorSeeks_,  &Stats::pagesVisited_, &Stats::hashHits_,
+    &Stats::hashMisses_,   &Stats::searchProbes_, &Stats::pageSplits_,
+    &Stats::pageMerges_,   &Stats::commits_,      &Stats::walBytes_,
+    &Stats::syncs_,
+};
+static Histogram Stats::*const kHistogramFields[kHistogramCount] = {
+    &Stats::commitMicros_,
+    &Stats::syncMicros_,
+};
+
+namespace {
+// The counters of the running threads, and the sum of the ended ones.
+struct MetricsRegistry {
+  std::mutex mutex_;
+  std::vector<ThreadMetrics *> threads_;
+  ThreadMetrics ended_;
+};
+
+// Unregisters the counters of a thread when it exits.
+struct ThreadMetricsOwner {
+  ~ThreadMetricsOwner();
+};
+} // namespace
+
+// Never destroyed, threads may exit after the static objects are gone.
+static MetricsRegistry *Registry() {
+  static MetricsRegistry *registry = new MetricsRegistry;
+  return registry;
+}
+
+static void AddMetrics(const ThreadMetrics &from, ThreadMetrics *to) {
+  for (int i = 0; i < kTickerCount; ++i) {
+    to->Add(to->tickers_[i], from.tickers_[i].load(std::memory_order_relaxed));
+  }
+  for (int i = 0; i < kHistogramCount; ++i) {
+    for (int j = 0; j < kHistogramBuckets; ++j) {
+      to->Add(to->counts_[i][j],
+              from.counts_[i][j].load(std::memory_order_relaxed));
+    }
+    to->Add(to->sums_[i], from.sums_[i].load(std::memory_order_relaxed));
+  }
+}
+
+static void AddMetrics(const ThreadMetrics &from, Stats *stats) {
+  for (int i = 0; i < kTickerCount; ++i) {
+    uint64_t n = from.tickers_[i].load(std::memory_order_relaxed);
+    stats->*kTickerFields[i] += n;
+  }
+  for (int i = 0; i < kHistogramCount; ++i) {
+    Histogram &histogram = stats->*kHistogramFields[i];
+    for (int j = 0; j < kHistogramBuckets; ++j) {
+      uint64_t n = from.counts_[i][j].load(std::memory_order_relaxed);
+      histogram.buckets_[j] += n;
+      histogram.count_ += n;
+    }
+    histogram.sum_ += from.sums_[i].load(std::memory_order_relaxed);
+  }
+}
+
+ThreadMetricsOwner::~ThreadMetricsOwner() {
+  MetricsRegistry *registry = Registry();
+  std::lock_guard<std::mutex> lock(registry->mutex_);
+  ThreadMetrics *metrics = gThreadMetrics;
+  AddMetrics(*metrics, &registry->ended_);
+  std::erase(registry->threads_, metrics);
+  gThreadMetrics = nullptr;
+  delete metrics;
+}
+
+ThreadMetrics *NewThreadMetrics() {
+  static thread_local ThreadMetricsOwner owner;
+  MetricsRegistry *registry = Registry();
+  std::lock_guard<std::mutex> lock(registry->mutex_);
+  gThreadMetrics = new ThreadMetrics;
+  registry->threads_.push_back(gThreadMetrics);
+  return gThreadMetrics;
+}
+
+void CollectMetrics(Stats *stats) {
+  MetricsRegistry *registry = Registry();
+  std::lock_guard<std::mutex> lock(registry->mutex_);
+  AddMetrics(registry->ended_, stats);
+  for (ThreadMetrics *metrics : registry->threads_) {
+    AddMetrics(*metrics, stats);
+  }
+}
+
+void SubtractMetrics(const Stats &base, Stats *stats) {
+  for (int i = 0; i < kTickerCount; ++i) {
+    stats->*kTickerFields[i] -= base.*kTickerFields[i];
+  }
+  for (int i = 0; i < kHistogramCount; ++i) {
+    Histogram &histogram = stats->*kHistogramFields[i];
+    const Histogram &from = base.*kHistogramFields[i];
+    for (int j = 0; j < kHistogramBuckets; ++j) {
+      histogram.buckets_[j] -= from.buckets_[j];
+    }
+    histogram.count_ -= from.count_;
+    histogram.sum_ -= from.sum_;
+  }
+}
+
+double Histogram::Average() const {
+  return count_ == 0 ? 0 : static_cast<double>(sum_) / count_;
+}
+
+double Histogram::Percentile(double p) const {
+  double target = count_ * std::clamp(p, 0.0, 100.0) / 100;
+  double seen = 0;
+
+  for (int i = 0; i < kBuckets; ++i) {
+    if (buckets_[i] == 0 || seen + buckets_[i] < target) {
+      seen += buckets_[i];
+      continue;
+    }
+    if (i == 0) {
+      return 0;
+    }
+    double low = ldexp(1, i - 1);
+    return low + low * (target - seen) / buckets_[i];
+  }
+  return 0;
+}
+
+static std::string FormatHistogram(const char *name, const Histogram &h) {
+  return FormatString("%s count %llu avg %.1f p50 %.1f p99 %.1f p99.9 %.1f\n",
+                      name, static_cast<unsigned long long>(h.count_),
+                      h.Average(), h.Percentile(50), h.Percentile(99),
+                      h.Percentile(99.9));
+}
+
+std::string Stats::ToString() const {
+  auto ratio = [](uint64_t a, uint64_t b) {
+    return b == 0 ? 0.0 : static_cast<double>(a) / b;
+  };
+  auto u = [](uint64_t n) { return static_cast<unsigned long long>(n); };
+  std::string s;
+
+  s += FormatString("cache hits %llu misses %llu evictions %llu "
+                    "hit ratio %.3f\n",
+                    u(cacheHits_), u(cacheMisses_), u(cacheEvictions_),
+                    ratio(cacheHits_, cacheHits_ + cacheMisses_));
+  s += FormatString("cursor seeks %llu pages visited %llu per seek %.2f\n",
+                    u(cursorSeeks_), u(pagesVisited_),
+                    ratio(pagesVisited_, cursorSeeks_));
+  s += FormatString("hash index hits %llu misses %llu hit ratio %.3f\n",
+                    u(hashHits_), u(hashMisses_),
+                    ratio(hashHits_, hashHits_ + hashMisses_));
+  s += FormatString("search probes %llu\n", u(searchProbes_));
+  s += FormatString("page splits %llu merges %llu\n", u(pageSplits_),
+                    u(pageMerges_));
+  s += FormatString("commits %llu wal bytes %llu syncs %llu\n", u(commits_),
+                    u(walBytes_), u(syncs_));
+  s += FormatHistogram("commit micros", commitMicros_);
+  s += FormatHistogram("sync micros", syncMicros_);
+  return s;
+}
+} // namespace udb
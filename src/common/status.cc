@@ -0,0 +1,14 @@
+#include "common/status.h"
+
+namespace udb {
+// The last error status of the current thread.
+static thread_local Status gErrorStatus;
+
+Code SaveErrorStatus(const Status &status) {
+  gErrorStatus = status;
+  return status.ErrorCode();
+}
+
+Status GetErrorStatus() { return gErrorStatus; }
+
+} // namespace udb
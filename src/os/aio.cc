@@ -0,0 +1,475 @@
+#include "os/aio.h"
+#include "common/status.h"
+#include "common/string.h"
+#include "os/file.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <errno.h>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+#ifdef UDB_WITH_IO_URING
+#include <atomic>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace udb {
+// The requests of one AsyncIo::Run not completed yet. Each Run has its own
+// so that a completion only wakes up the thread waiting for it.
+struct IoWaiter {
+  std::mutex mutex_;
+  std::condition_variable finished_;
+  int pending_ = 0;
+};
+
+AsyncIo::~AsyncIo() {}
+
+void AsyncIo::Finish(IoRequest *request, int error) {
+  if (request->done_) {
+    request->error_ = error;
+    request->finished_ = true;
+    request->done_(request);
+    return;
+  }
+
+  // The waiter is gone once it sees the last request finished, so it is
+  // notified under its lock.
+  IoWaiter *waiter = request->waiter_;
+  std::lock_guard<std::mutex> lock(waiter->mutex_);
+  request->error_ = error;
+  request->finished_ = true;
+  if (--waiter->pending_ == 0) {
+    waiter->finished_.notify_one();
+  }
+}
+
+// Run the request with pread or pwrite, return the errno if fail.
+static int Execute(IoRequest *request) {
+  int fd = request->file_->Fd();
+  char *buf = request->buf_;
+  uint64_t offset = request->offset_;
+  size_t n = request->size_;
+
+  while (n > 0) {
+    ssize_t r = request->write_ ? ::pwrite(fd, buf, n, offset)
+                                : ::pread(fd, buf, n, offset);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    if (r == 0) {
+      if (request->write_) {
+        return EIO;
+      }
+      // Reached the end of file, the rest is zero.
+      memset(buf, 0, n);
+      break;
+    }
+    buf += r;
+    offset += r;
+    n -= r;
+  }
+  return 0;
+}
+
+Code AsyncIo::Run(IoRequest **requests, int n) {
+  if (n == 1) {
+    // A single request gains nothing from another thread.
+    requests[0]->error_ = Execute(requests[0]);
+    requests[0]->finished_ = true;
+  } else if (n > 1) {
+    IoWaiter waiter;
+    waiter.pending_ = n;
+    for (int i = 0; i < n; ++i) {
+      requests[i]->waiter_ = &waiter;
+    }
+    Submit(requests, n);
+    std::unique_lock<std::mutex> lock(waiter.mutex_);
+    waiter.finished_.wait(lock, [&] { return waiter.pending_ == 0; });
+  }
+
+  // The error status is thread local, so it is saved by the waiter.
+  for (int i = 0; i < n; ++i) {
+    IoRequest *request = requests[i];
+    request->waiter_ = nullptr;
+    if (request->error_ != 0) {
+      return SaveErrorStatus(Status(
+          kIOError,
+          FormatString("%s file %s fail: %s",
+                       request->write_ ? "write" : "read",
+                       request->file_->Path().c_str(),
+                       strerror(request->error_))));
+    }
+  }
+  return kOk;
+}
+
+// Requests are queued to a pool of threads, each runs one at a time.
+class ThreadPoolIo : public AsyncIo {
+public:
+  explicit ThreadPoolIo(int threads) : stop_(false) {
+    for (int i = 0; i < threads; ++i) {
+      threads_.emplace_back([this] { Work(); });
+    }
+  }
+
+  ~ThreadPoolIo() override {
+    {
+      std::lock_guard<std::mutex> lock(queueMutex_);
+      stop_ = true;
+    }
+    queued_.notify_all();
+    for (std::thread &thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Submit(IoRequest **requests, int n) override {
+    {
+      std::lock_guard<std::mutex> lock(queueMutex_);
+      for (int i = 0; i < n; ++i) {
+        requests[i]->finished_ = false;
+        queue_.push_back(requests[i]);
+      }
+    }
+    queued_.notify_all();
+  }
+
+  const char *Name() const override { return "threads"; }
+
+private:
+  void Work() {
+    while (true) {
+      IoRequest *request;
+      {
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        queued_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          return;
+        }
+        request = queue_.front();
+        queue_.pop_front();
+      }
+      Finish(request, Execute(request));
+    }
+  }
+
+  std::mutex queueMutex_;
+  std::condition_variable queued_;
+  std::deque<IoRequest *> queue_;
+  std::vector<std::thread> threads_;
+  bool stop_;
+};
+
+#ifdef UDB_WITH_IO_URING
+// io_uring through the raw system calls. Any thread may submit, one
+// thread reaps the completions and finishes the requests.
+class IoUring : public AsyncIo {
+public:
+  IoUring()
+      : fd_(-1), ring_(nullptr), ringSize_(0), sqes_(nullptr), inflight_(0),
+        maxInflight_(0), broken_(0) {}
+
+  ~IoUring() override {
+    if (reaper_.joinable()) {
+      // A request without buffer tells the reaper to stop.
+      IoRequest *stop = nullptr;
+      Submit(&stop, 1);
+      reaper_.join();
+    }
+    if (sqes_) {
+      ::munmap(sqes_, sqEntries_ * sizeof(io_uring_sqe));
+    }
+    if (ring_) {
+      ::munmap(ring_, ringSize_);
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  // Set up the ring, return false if the kernel does not support it.
+  bool Init(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = ::syscall(__NR_io_uring_setup, entries, &params);
+    if (fd_ < 0) {
+      return false;
+    }
+    // Only map the rings once, kernels older than 5.4 are not supported.
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+      return false;
+    }
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ringSize_ = std::max(sqSize, cqSize);
+    void *ring = ::mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+      return false;
+    }
+    ring_ = static_cast<char *>(ring);
+    void *sqes = ::mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe),
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                        IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return false;
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+    sqEntries_ = params.sq_entries;
+    sqHead_ = reinterpret_cast<unsigned *>(ring_ + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(ring_ + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned *>(ring_ + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned *>(ring_ + params.sq_off.array);
+    cqHead_ = reinterpret_cast<unsigned *>(ring_ + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(ring_ + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned *>(ring_ + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(ring_ + params.cq_off.cqes);
+
+    // Never have more requests in flight than the completion queue holds.
+    maxInflight_ = params.cq_entries;
+    reaper_ = std::thread([this] { Reap(); });
+    return true;
+  }
+
+  void Submit(IoRequest **requests, int n) override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    int queued = 0;
+
+    for (int i = 0; i < n; ++i) {
+      // Hand the queued entries to the kernel before waiting for room,
+      // they may be all the requests in flight.
+      if (inflight_ >= maxInflight_ && queued > 0) {
+        Enter(queued);
+        queued = 0;
+      }
+      room_.wait(lock,
+                 [this] { return broken_ != 0 || inflight_ < maxInflight_; });
+      if (broken_ != 0) {
+        // The reaper is gone, nothing completes any more.
+        if (requests[i]) {
+          failed_.push_back(std::make_pair(requests[i], broken_));
+        }
+        continue;
+      }
+      if (requests[i]) {
+        requests[i]->finished_ = false;
+        pending_.insert(requests[i]);
+      }
+      Prepare(requests[i]);
+      ++inflight_;
+      ++queued;
+      // The submission queue is empty after every enter.
+      if (queued == static_cast<int>(sqEntries_)) {
+        Enter(queued);
+        queued = 0;
+      }
+    }
+    if (queued > 0) {
+      Enter(queued);
+    }
+
+    // Finish the requests the kernel did not take without the lock.
+    std::vector<std::pair<IoRequest *, int>> failed;
+    failed.swap(failed_);
+    lock.unlock();
+    for (auto &iter : failed) {
+      Finish(iter.first, iter.second);
+    }
+  }
+
+  const char *Name() const override { return "io_uring"; }
+
+private:
+  void Prepare(IoRequest *request) {
+    unsigned tail = *sqTail_;
+    unsigned index = tail & sqMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    if (request) {
+      sqe->opcode = request->write_ ? IORING_OP_WRITE : IORING_OP_READ;
+      sqe->fd = request->file_->Fd();
+      sqe->off = request->offset_;
+      sqe->addr = reinterpret_cast<uint64_t>(request->buf_);
+      sqe->len = request->size_;
+    } else {
+      sqe->opcode = IORING_OP_NOP;
+    }
+    sqe->user_data = reinterpret_cast<uint64_t>(request);
+    sqArray_[index] = index;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+  }
+
+  void Enter(int n) {
+    while (n > 0) {
+      int r = ::syscall(__NR_io_uring_enter, fd_, n, 0, 0, nullptr, 0);
+      if (r < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+          continue;
+        }
+        // Consumed entries fail with their own completion, fail the rest.
+        FailQueued(errno);
+        return;
+      }
+      n -= r;
+    }
+  }
+
+  // Drop the entries the kernel did not take, the submitter finishes
+  // their requests.
+  void FailQueued(int error) {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    unsigned tail = *sqTail_;
+    for (; head != tail; ++head) {
+      io_uring_sqe *sqe = &sqes_[sqArray_[head & sqMask_]];
+      auto *request = reinterpret_cast<IoRequest *>(sqe->user_data);
+      --inflight_;
+      if (request) {
+        pending_.erase(request);
+        failed_.push_back(std::make_pair(request, error));
+      }
+    }
+    __atomic_store_n(sqTail_, *sqHead_, __ATOMIC_RELEASE);
+  }
+
+  void Reap() {
+    std::vector<std::pair<IoRequest *, int>> completed;
+
+    while (true) {
+      int r = ::syscall(__NR_io_uring_enter, fd_, 0, 1,
+                        IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (r < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        // The ring is unusable, e.g. EBADF or EFAULT.
+        Fail(errno);
+        return;
+      }
+
+      unsigned head = *cqHead_;
+      unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+      bool stop = false;
+      completed.clear();
+      for (; head != tail; ++head) {
+        io_uring_cqe *cqe = &cqes_[head & cqMask_];
+        auto *request = reinterpret_cast<IoRequest *>(cqe->user_data);
+        int res = cqe->res;
+        __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+        if (!request) {
+          stop = true;
+        }
+        completed.push_back(std::make_pair(request, res));
+      }
+
+      if (!completed.empty()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        inflight_ -= completed.size();
+        for (auto &iter : completed) {
+          pending_.erase(iter.first);
+        }
+        room_.notify_all();
+      }
+      for (auto &iter : completed) {
+        if (iter.first) {
+          Complete(iter.first, iter.second);
+        }
+      }
+      if (stop) {
+        return;
+      }
+    }
+  }
+
+  // Fail the requests in flight with the error of the ring, and those
+  // submitted from now on.
+  void Fail(int error) {
+    std::vector<IoRequest *> pending;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      broken_ = error;
+      pending.assign(pending_.begin(), pending_.end());
+      pending_.clear();
+      inflight_ = 0;
+      room_.notify_all();
+    }
+    for (IoRequest *request : pending) {
+      Finish(request, error);
+    }
+  }
+
+  void Complete(IoRequest *request, int res) {
+    if (res < 0) {
+      Finish(request, -res);
+      return;
+    }
+
+    size_t done = res;
+    if (done < request->size_) {
+      if (request->write_ || done > 0) {
+        // Short transfers only happen at the end of file for regular
+        // files, finish the rest synchronously.
+        IoRequest rest(request->file_, request->write_,
+                       request->offset_ + done, request->buf_ + done,
+                       request->size_ - done);
+        Finish(request, Execute(&rest));
+        return;
+      }
+      // Reached the end of file, the rest is zero.
+      memset(request->buf_, 0, request->size_);
+    }
+    Finish(request, 0);
+  }
+
+  int fd_;
+  char *ring_;
+  size_t ringSize_;
+  io_uring_sqe *sqes_;
+  unsigned sqEntries_;
+  unsigned *sqHead_;
+  unsigned *sqTail_;
+  unsigned sqMask_;
+  unsigned *sqArray_;
+  unsigned *cqHead_;
+  unsigned *cqTail_;
+  unsigned cqMask_;
+  io_uring_cqe *cqes_;
+
+  // Protected by mutex_.
+  std::mutex mutex_;
+  std::condition_variable room_;
+  int inflight_;
+  int maxInflight_;
+  std::vector<std::pair<IoRequest *, int>> failed_; // Not taken by the kernel.
+  std::unordered_set<IoRequest *> pending_;          // Taken by the kernel.
+  int broken_; // The errno that stopped the reaper, 0 while it runs.
+
+  std::thread reaper_;
+};
+
+// Entries of the submission queue.
+static const unsigned kRingEntries = 256;
+#endif
+
+AsyncIo *AsyncIo::Create(int threads) {
+#ifdef UDB_WITH_IO_URING
+  IoUring *ring = new IoUring();
+  if (ring->Init(kRingEntries)) {
+    return ring;
+  }
+  delete ring;
+#endif
+  return new ThreadPoolIo(std::max(threads, 1));
+}
+} // namespace udb
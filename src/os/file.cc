@@ -0,0 +1,137 @@
+#include "os/file.h"
+#include "common/metrics.h"
+#include "common/status.h"
+#include "common/string.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace udb {
+static Code IOError(const std::string &path, const char *op) {
+  return SaveErrorStatus(Status(
+      kIOError, FormatString("%s file %s fail: %s", op, path.c_str(),
+                             strerror(errno))));
+}
+
+File::File(const std::string &path) : path_(path), fd_(-1) {}
+
+File::~File() { Close(); }
+
+Code File::Open(bool create) {
+  int flags = O_RDWR | O_CLOEXEC;
+  if (create) {
+    flags |= O_CREAT;
+  }
+
+  fd_ = ::open(path_.c_str(), flags, 0644);
+  if (fd_ < 0) {
+    return IOError(path_, "open");
+  }
+  return kOk;
+}
+
+void File::Close() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+Code File::Read(uint64_t offset, char *buf, size_t n) {
+  while (n > 0) {
+    ssize_t r = ::pread(fd_, buf, n, offset);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return IOError(path_, "read");
+    }
+    if (r == 0) {
+      // Reached the end of file, the rest is zero.
+      memset(buf, 0, n);
+      break;
+    }
+    buf += r;
+    offset += r;
+    n -= r;
+  }
+  return kOk;
+}
+
+Code File::Write(uint64_t offset, const char *buf, size_t n) {
+  while (n > 0) {
+    ssize_t r = ::pwrite(fd_, buf, n, offset);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return IOError(path_, "write");
+    }
+    buf += r;
+    offset += r;
+    n -= r;
+  }
+  return kOk;
+}
+
+Code File::Sync() {
+  MetricsTimer timer(kSyncMicros);
+  RecordTick(kFileSyncs);
+  if (::fdatasync(fd_) != 0) {
+    return IOError(path_, "sync");
+  }
+  return kOk;
+}
+
+Code File::Size(uint64_t *size) {
+  struct stat st;
+  if (::fstat(fd_, &st) != 0) {
+    return IOError(path_, "stat");
+  }
+  *size = st.st_size;
+  return kOk;
+}
+
+Code File::Truncate(uint64_t size) {
+  if (::ftruncate(fd_, size) != 0) {
+    return IOError(path_, "truncate");
+  }
+  return kOk;
+}
+
+Code File::PunchHole(uint64_t offset, uint64_t n) {
+  if (::fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset,
+                  n) != 0 &&
+      errno != EOPNOTSUPP) {
+    return IOError(path_, "punch hole in");
+  }
+  return kOk;
+}
+
+Code File::Map(uint64_t size, char **base) {
+  void *addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+  if (addr == MAP_FAILED) {
+    return IOError(path_, "mmap");
+  }
+  *base = static_cast<char *>(addr);
+  return kOk;
+}
+
+void File::Unmap(char *base, uint64_t size) { ::munmap(base, size); }
+
+void File::Advise(uint64_t offset, uint64_t n) {
+  ::posix_fadvise(fd_, offset, n, POSIX_FADV_WILLNEED);
+}
+
+void File::AdviseMap(char *addr, uint64_t n) {
+  // madvise wants an address aligned to the OS page.
+  static const uintptr_t osPageSize = ::sysconf(_SC_PAGESIZE);
+  uintptr_t start = reinterpret_cast<uintptr_t>(addr) & ~(osPageSize - 1);
+  n += reinterpret_cast<uintptr_t>(addr) - start;
+  ::madvise(reinterpret_cast<void *>(start), n, MADV_WILLNEED);
+}
+} // namespace udb
@@ -0,0 +1,13 @@
+#include "os/os.h"
+
+#include <sys/resource.h>
+
+namespace udb {
+uint64_t Os::AddressSpaceLimit() {
+  struct rlimit limit;
+  if (::getrlimit(RLIMIT_AS, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY) {
+    return UINT64_MAX;
+  }
+  return limit.rlim_cur;
+}
+} // namespace udb
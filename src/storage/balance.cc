@@ -0,0 +1,429 @@
+#include "storage/balance.h"
+#include "buffer/buffer_manager.h"
+#include "buffer/mem_page.h"
+#include "common/debug.h"
+#include "common/metrics.h"
+#include "storage/btree.h"
+#include "storage/cursor.h"
+#include "storage/txn_impl.h"
+
+#include <algorithm>
+
+namespace udb {
+// The shortest key not less than left and less than right, the keys not
+// greater than it are on the left page. Only for keys in memcmp order.
+static std::string Separator(const Slice &left, const Slice &right) {
+  size_t n = std::min(left.Size(), right.Size());
+  size_t i = 0;
+  while (i < n && left[i] == right[i]) {
+    ++i;
+  }
+  // The first i + 1 bytes of right are greater than left, and less than
+  // right unless they are all of it.
+  if (i + 1 < right.Size()) {
+    return std::string(right.Data(), i + 1);
+  }
+  return std::string(left.Data(), left.Size());
+}
+
+Balancer::Balancer(TxnImpl *txn, Cursor *cursor)
+    : txn_(txn), cursor_(cursor) {}
+
+Code Balancer::Insert(int index, const CellData &cell, bool replace) {
+  int depth = cursor_->Depth();
+  std::vector<Level> levels(depth + 1);
+  Code code = kOk;
+
+  int level = depth;
+  MemPage *page = cursor_->PathPage(level);
+  Level *lv = &levels[level];
+  Load(page, &lv->node_);
+  std::vector<CellData> &cells = lv->node_.cells_;
+  if (replace) {
+    cells[index] = cell;
+  } else {
+    cells.insert(cells.begin() + index, cell);
+  }
+  bool append = !replace && index + 1 == static_cast<int>(cells.size());
+
+  // Go up while the pages overflow, locking the parents which take the
+  // separators. Nothing is changed yet.
+  while (page->SpaceNeeded(lv->node_.cells_) > page->UsableSize()) {
+    lv->split_ = true;
+    if (level == 0 && page->SpaceNeeded(lv->node_.cells_) <=
+                          page->PageSize()) {
+      // Only page 1 is smaller than the others.
+      lv->at_ = 0;
+      break;
+    }
+    code = Split(page, append, lv);
+    if (code != kOk || level == 0) {
+      break;
+    }
+    code = cursor_->MarkDirty(level - 1);
+    if (code != kOk) {
+      break;
+    }
+
+    PageNo left = page->MemPageNo();
+    int child = cursor_->PathChild(level - 1);
+    page = cursor_->PathPage(--level);
+    lv = &levels[level];
+    Load(page, &lv->node_);
+    std::vector<CellData> &parent = lv->node_.cells_;
+    Slice separator(levels[level + 1].separator_);
+    parent.insert(parent.begin() + child, CellData{separator, Slice(), left});
+    append = child + 1 == static_cast<int>(parent.size());
+  }
+  if (code != kOk) {
+    return code;
+  }
+
+  // Take the new pages before changing any, so that a failure leaves the
+  // tree as it was.
+  for (int i = level; i <= depth && code == kOk; ++i) {
+    lv = &levels[i];
+    if (!lv->split_) {
+      continue;
+    }
+    page = cursor_->PathPage(i);
+    int n = i == 0 && lv->at_ > 0 ? 2 : 1;
+    for (int j = 0; j < n && code == kOk; ++j) {
+      code = Pager->AllocatePage(cursor_->Tree()->PageFlags(page->IsLeaf()),
+                                 txn_->Snapshot(), &lv->pages_[j],
+                                 page->MemPageNo());
+    }
+  }
+  bool allocated = code == kOk;
+
+  // Change the pages bottom-up, each split points the parent at the new
+  // page after the one split.
+  for (int i = depth; i >= level && code == kOk; --i) {
+    page = cursor_->PathPage(i);
+    lv = &levels[i];
+    if (!lv->split_) {
+      code = WritePage(page, lv->node_.cells_, lv->node_.right_);
+    } else if (i == 0) {
+      code = WriteRoot(lv, page);
+    } else {
+      code = WriteSplit(*lv, page, lv->pages_[0]);
+      Link(page, lv->pages_[0]);
+      SetChild(&levels[i - 1].node_, cursor_->PathChild(i - 1) + 1,
+               lv->pages_[0]->MemPageNo());
+    }
+  }
+
+  for (Level &l : levels) {
+    if (code == kOk && l.split_) {
+      RecordTick(kPageSplits);
+    }
+    for (MemPage *p : l.pages_) {
+      if (p == nullptr) {
+        continue;
+      }
+      if (!allocated) {
+        Pager->FreePage(p->MemPageNo(), txn_->Snapshot());
+      }
+      Pager->ReleasePage(p);
+    }
+  }
+  cursor_->Reset();
+  return code;
+}
+
+Code Balancer::Underflow() {
+  int depth = cursor_->Depth();
+  int level = depth;
+  bool merged = true;
+  Code code = kOk;
+
+  while (level > 0 && merged) {
+    MemPage *page = cursor_->PathPage(level);
+    if (page->UsableSize() - page->FreeSpace() >= page->UsableSize() / 4) {
+      break;
+    }
+    code = Merge(level, &merged);
+    if (code != kOk) {
+      break;
+    }
+    --level;
+  }
+  if (code == kOk && depth > 0 && level == 0 && merged) {
+    code = CollapseRoot();
+  }
+
+  // Another writer has the pages, they are merged some other time.
+  if (code == kBusy || code == kConflict) {
+    code = kOk;
+  }
+  cursor_->Reset();
+  return code;
+}
+
+Code Balancer::Split(const MemPage *page, bool append, Level *lv) const {
+  const std::vector<CellData> &cells = lv->node_.cells_;
+  std::span<const CellData> all(cells);
+  int n = cells.size();
+  bool leaf = page->IsLeaf();
+
+  // The right page of an internal split has a cell and the right child.
+  int low = 1;
+  int high = leaf ? n - 1 : n - 2;
+  if (low > high) {
+    return kPageFull;
+  }
+
+  int at = high;
+  if (!append) {
+    int total = 0;
+    for (const CellData &cell : cells) {
+      total += page->CellSpace(cell);
+    }
+    int half = 0;
+    for (at = 0; at < n && half < total / 2; ++at) {
+      half += page->CellSpace(cells[at]);
+    }
+    at = std::clamp(at, low, high);
+  }
+
+  // A prefix may not shrink both halves alike, move the split until both
+  // of them fit.
+  auto leftFits = [&](int k) {
+    return page->SpaceNeeded(all.first(k)) <= page->PageSize();
+  };
+  auto rightFits = [&](int k) {
+    return page->SpaceNeeded(all.subspan(leaf ? k : k + 1)) <=
+           page->PageSize();
+  };
+  while (at > low && !leftFits(at)) {
+    --at;
+  }
+  while (at < high && !rightFits(at)) {
+    ++at;
+  }
+  if (!leftFits(at) || !rightFits(at)) {
+    return kPageFull;
+  }
+
+  lv->at_ = at;
+  if (leaf && cursor_->Tree()->Order().IsBytewise()) {
+    lv->separator_ = Separator(cells[at - 1].key_, cells[at].key_);
+  } else if (leaf) {
+    // Any other order only knows the keys it is given.
+    const Slice &left = cells[at - 1].key_;
+    lv->separator_.assign(left.Data(), left.Size());
+  } else {
+    lv->separator_.assign(cells[at].key_.Data(), cells[at].key_.Size());
+  }
+  return kOk;
+}
+
+Code Balancer::WritePage(MemPage *page, std::span<const CellData> cells,
+                         PageNo right) const {
+  if (!page->IsLeaf()) {
+    page->SetRightChild(right);
+  }
+  return page->Rebuild(cells);
+}
+
+Code Balancer::WriteSplit(const Level &lv, MemPage *left,
+                          MemPage *right) const {
+  std::span<const CellData> all(lv.node_.cells_);
+  Code code;
+
+  // The cells may point into the left page, write it last.
+  if (left->IsLeaf()) {
+    code = WritePage(right, all.subspan(lv.at_), kInvalidPageNo);
+    if (code == kOk) {
+      code = WritePage(left, all.first(lv.at_), kInvalidPageNo);
+    }
+  } else {
+    code = WritePage(right, all.subspan(lv.at_ + 1), lv.node_.right_);
+    if (code == kOk) {
+      code = WritePage(left, all.first(lv.at_), all[lv.at_].leftChild_);
+    }
+  }
+  return code;
+}
+
+Code Balancer::WriteRoot(Level *lv, MemPage *root) {
+  Code code;
+
+  // The cells point into the root, write the children first.
+  if (lv->at_ == 0) {
+    code = WritePage(lv->pages_[0], lv->node_.cells_, lv->node_.right_);
+    if (code != kOk) {
+      return code;
+    }
+    root->Format(cursor_->Tree()->PageFlags(false));
+    root->SetRightChild(lv->pages_[0]->MemPageNo());
+    return kOk;
+  }
+
+  code = WriteSplit(*lv, lv->pages_[0], lv->pages_[1]);
+  if (code != kOk) {
+    return code;
+  }
+  Link(lv->pages_[0], lv->pages_[1]);
+  CellData separator{Slice(lv->separator_), Slice(),
+                     lv->pages_[0]->MemPageNo()};
+  root->Format(cursor_->Tree()->PageFlags(false));
+  return WritePage(root, std::span<const CellData>(&separator, 1),
+                   lv->pages_[1]->MemPageNo());
+}
+
+Code Balancer::Merge(int level, bool *merged) {
+  uint64_t snapshot = txn_->Snapshot();
+  MemPage *sibling;
+  PageNo siblingNo;
+  Code code;
+
+  *merged = false;
+  code = cursor_->MarkDirty(level - 1);
+  if (code != kOk) {
+    return code;
+  }
+  MemPage *page = cursor_->PathPage(level);
+  MemPage *parent = cursor_->PathPage(level - 1);
+  int child = cursor_->PathChild(level - 1);
+
+  // The pages separated by the index-th cell of the parent, the page and
+  // its right sibling unless it is the right child.
+  int index = child < parent->CellNumber() ? child : child - 1;
+  if (index < 0) {
+    return kOk;
+  }
+  code = parent->ChildPageNo(index == child ? child + 1 : index, &siblingNo);
+  if (code != kOk) {
+    return code;
+  }
+  code = Pager->GetPage(siblingNo, snapshot, &sibling);
+  if (code != kOk) {
+    return code;
+  }
+  code = Pager->MarkDirty(&sibling, snapshot);
+  if (code != kOk) {
+    Pager->ReleasePage(sibling);
+    return code;
+  }
+  MemPage *left = index == child ? page : sibling;
+  MemPage *right = index == child ? sibling : page;
+
+  Node leftNode, rightNode, parentNode;
+  Level lv;
+  std::vector<CellData> &cells = lv.node_.cells_;
+  Load(left, &leftNode);
+  Load(right, &rightNode);
+  Load(parent, &parentNode);
+  cells = leftNode.cells_;
+  if (!left->IsLeaf()) {
+    // The separator of the pages comes down between their cells.
+    cells.push_back(CellData{parentNode.cells_[index].key_, Slice(),
+                             leftNode.right_});
+  }
+  cells.insert(cells.end(), rightNode.cells_.begin(), rightNode.cells_.end());
+  lv.node_.right_ = rightNode.right_;
+
+  if (left->SpaceNeeded(cells) <= left->UsableSize()) {
+    // The left page takes all the cells and the place of the right one in
+    // the parent, so that the leaf before it keeps its link.
+    code = WritePage(left, cells, lv.node_.right_);
+    if (code == kOk) {
+      if (left->IsLinked()) {
+        left->SetSibling(right->Sibling());
+      }
+      parent->DropCell(index);
+      parent->SetChildPageNo(index, left->MemPageNo());
+      Pager->FreePage(right->MemPageNo(), snapshot);
+      RecordTick(kPageMerges);
+      *merged = true;
+    }
+  } else if (Split(right, false, &lv) == kOk) {
+    // Share the cells evenly, the parent takes the new separator if it
+    // has room for it.
+    parentNode.cells_[index].key_ = Slice(lv.separator_);
+    if (parent->SpaceNeeded(parentNode.cells_) <= parent->UsableSize()) {
+      Own(&lv.node_);
+      Own(&parentNode);
+      code = WriteSplit(lv, left, right);
+      if (code == kOk) {
+        code = WritePage(parent, parentNode.cells_, parentNode.right_);
+      }
+    }
+  }
+  Pager->ReleasePage(sibling);
+  return code;
+}
+
+Code Balancer::CollapseRoot() {
+  uint64_t snapshot = txn_->Snapshot();
+  MemPage *root = cursor_->PathPage(0);
+  MemPage *child;
+  Node node;
+  Code code;
+
+  if (root->IsLeaf() || root->CellNumber() > 0) {
+    return kOk;
+  }
+  code = Pager->GetPage(root->RightChild(), snapshot, &child);
+  if (code != kOk) {
+    return code;
+  }
+  code = Pager->MarkDirty(&child, snapshot);
+  if (code != kOk) {
+    Pager->ReleasePage(child);
+    return code;
+  }
+
+  // An internal root takes a few bytes more than a leaf, page 1 may not
+  // have room for the child either. The tree is one level lower then.
+  Load(child, &node);
+  if (root->SpaceNeeded(node.cells_) <= root->UsableSize()) {
+    root->Format(cursor_->Tree()->PageFlags(child->IsLeaf()));
+    code = WritePage(root, node.cells_, node.right_);
+    if (code == kOk) {
+      Pager->FreePage(child->MemPageNo(), snapshot);
+    }
+  }
+  Pager->ReleasePage(child);
+  return code;
+}
+
+void Balancer::Load(MemPage *page, Node *node) {
+  page->GetCells(&node->cells_, &node->keys_);
+  node->right_ = page->IsLeaf() ? kInvalidPageNo : page->RightChild();
+}
+
+void Balancer::Own(Node *node) {
+  size_t size = 0;
+  for (const CellData &cell : node->cells_) {
+    size += cell.key_.Size() + cell.value_.Size();
+  }
+  // Reserve all at once, the slices point into the buffer.
+  node->buffer_.clear();
+  node->buffer_.reserve(size);
+  for (CellData &cell : node->cells_) {
+    size_t start = node->buffer_.size();
+    node->buffer_.append(cell.key_.Data(), cell.key_.Size());
+    node->buffer_.append(cell.value_.Data(), cell.value_.Size());
+    const char *data = node->buffer_.data() + start;
+    cell.key_ = Slice(data, cell.key_.Size());
+    cell.value_ = Slice(data + cell.key_.Size(), cell.value_.Size());
+  }
+}
+
+void Balancer::Link(MemPage *left, MemPage *right) {
+  if (left->IsLinked()) {
+    right->SetSibling(left->Sibling());
+    left->SetSibling(right->MemPageNo());
+  }
+}
+
+void Balancer::SetChild(Node *node, int index, PageNo no) {
+  if (index < static_cast<int>(node->cells_.size())) {
+    node->cells_[index].leftChild_ = no;
+  } else {
+    node->right_ = no;
+  }
+}
+} // namespace udb
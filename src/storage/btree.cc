@@ -1,31 +1,45 @@
 #include "storage/btree.h"
+#include "common/string.h"
+#include "storage/hash_index.h"
 
 namespace udb {
 
-BTree::BTree(const Options &options, const std::string &name) {}
+BTree::BTree(PageNo root, const std::string &name, const KeyOrder &order,
+             int hashCapacity)
+    : root_(root), name_(name), order_(order), deleted_(false),
+      hash_(hashCapacity > 0 ? new HashIndex(hashCapacity) : nullptr) {}
 
-BTree::~BTree() {}
+BTree::~BTree() { delete hash_; }
 
-Txn *BTree::Begin(bool write) { return nullptr; }
+Status BTree::Write(TxnImpl *txn, const Slice &key, const Slice &value) {
+  return txn->Write(this, key, value);
+}
 
-Status BTree::Write(Txn *txn, const Slice &key, const Slice &value) {
-  Status status;
-  return status;
+Status BTree::Delete(TxnImpl *txn, const Slice &key) {
+  return txn->Delete(this, key);
 }
 
-Status BTree::Delete(Txn *txn, const Slice &key) {
-  Status status;
-  return status;
+Status BTree::Get(TxnImpl *txn, const Slice &key, Slice *value) {
+  return txn->Get(this, key, value);
 }
 
-Status BTree::Get(Txn *txn, const Slice &key, std::string *value) {
-  Status status;
-  return status;
+char BTree::PageFlags(bool isLeaf) const {
+  return DBInstance->PageFlags(isLeaf, order_.kind_);
 }
 
-Status BTree::Commit(Txn *) {
-  Status status;
-  return status;
+Code BTree::CheckKey(const Slice &key) const {
+  if (deleted_) {
+    return SaveErrorStatus(Status(
+        kNotFound, FormatString("tree %s has been deleted", name_.c_str())));
+  }
+  if ((order_.kind_ == kU64Order || order_.kind_ == kIntKeyOrder) &&
+      key.Size() != kU64KeySize) {
+    return SaveErrorStatus(Status(
+        kInvalidArgument,
+        FormatString("key of %zu bytes, tree %s takes 8-byte keys",
+                     key.Size(), name_.c_str())));
+  }
+  return kOk;
 }
 
-} // namespace udb
\ No newline at end of file
+} // namespace udb
@@ -0,0 +1,289 @@
+#include "storage/bulk_loader.h"
+#include "buffer/buffer_manager.h"
+#include "buffer/mem_page.h"
+#include "common/bytes.h"
+#include "common/string.h"
+#include "storage/btree.h"
+#include "storage/cell.h"
+#include "storage/page_layout.h"
+#include "storage/txn_impl.h"
+
+#include <algorithm>
+
+namespace udb {
+BulkLoader::BulkLoader(TxnImpl *txn, BTree *tree, int fillPercent)
+    : txn_(txn), tree_(tree), pageSize_(Pager->PageSize()),
+      fillPercent_(fillPercent),
+      prefixPages_((tree->PageFlags(true) & kPrefixPage) != 0),
+      intKeyPages_((tree->PageFlags(true) & kIntKeyPage) != 0),
+      linkedLeaves_((tree->PageFlags(true) & kLinkedPage) != 0),
+      batchPages_(std::max(Pager->FrameNumber() / 4, 1)),
+      lastLeaf_(nullptr), overflow_(txn->Snapshot()) {}
+
+BulkLoader::~BulkLoader() {
+  for (MemPage *page : finished_) {
+    Pager->ReleasePage(page);
+  }
+  if (lastLeaf_) {
+    Pager->ReleasePage(lastLeaf_);
+  }
+}
+
+Code BulkLoader::Load(KVIterator *iter) {
+  MemPage *root;
+  bool first = true;
+  Code code;
+
+  code = Pager->GetPage(tree_->Root(), txn_->Snapshot(), &root);
+  if (code != kOk) {
+    return code;
+  }
+  bool empty = root->IsLeaf() && root->CellNumber() == 0;
+  Pager->ReleasePage(root);
+  if (!empty) {
+    return SaveErrorStatus(
+        Status(kInvalidArgument, FormatString("bulk load into non-empty tree %s",
+                                              tree_->Name().c_str())));
+  }
+
+  for (; iter->Valid(); iter->Next()) {
+    Slice key = iter->Key();
+    code = tree_->CheckKey(key);
+    if (code != kOk) {
+      return code;
+    }
+    if (!first && tree_->Order().Compare(key, lastKey_) <= 0) {
+      return SaveErrorStatus(
+          Status(kInvalidArgument, "keys of bulk load are not ascending"));
+    }
+    code = Add(0, key, iter->Value(), kInvalidPageNo);
+    if (code != kOk) {
+      return code;
+    }
+    lastKey_.assign(key.Data(), key.Size());
+    first = false;
+  }
+
+  code = Finish();
+  if (code != kOk) {
+    return code;
+  }
+  return WriteFinished();
+}
+
+Code BulkLoader::Add(int level, const Slice &key, const Slice &value,
+                     PageNo child) {
+  if (level == static_cast<int>(levels_.size())) {
+    levels_.push_back(Level{std::string(), {}, 0, 0, 0});
+  }
+
+  int keySize = key.Size();
+  int keySizeLen = intKeyPages_ ? 0 : VarintLen(keySize);
+  int cellSize = 2;
+  Slice local = value;
+  PageNo overflow = kInvalidPageNo;
+  if (level == 0) {
+    // Spill a large value to an overflow chain first.
+    uint64_t localSize = LocalValueSize(pageSize_, keySize, value.Size());
+    if (localSize < value.Size()) {
+      Code code = overflow_.Write(
+          Slice(value.Data() + localSize, value.Size() - localSize), &overflow);
+      if (code != kOk) {
+        return code;
+      }
+      local = Slice(value.Data(), localSize);
+      cellSize += 4;
+    }
+    cellSize += VarintLen(value.Size()) + keySizeLen + keySize + local.Size();
+  } else {
+    cellSize += 4 + keySizeLen + keySize;
+  }
+
+  Level *lv = &levels_[level];
+  if (!lv->cells_.empty()) {
+    // Estimate the page with the prefix the key leaves, stripping the
+    // prefix can only shrink the key size varints.
+    int prefixSize = 0;
+    if (prefixPages_) {
+      const char *firstKey = &lv->buffer_[lv->cells_[0].keyOffset_];
+      int n = std::min(lv->prefixSize_, keySize);
+      while (prefixSize < n && firstKey[prefixSize] == key[prefixSize]) {
+        ++prefixSize;
+      }
+    }
+    int count = lv->cells_.size() + 1;
+    int used = lv->size_ + cellSize - count * prefixSize +
+               (prefixPages_ ? 2 + prefixSize : 0);
+    int headerSize = level > 0        ? kInternalPageHeaderSize
+                     : linkedLeaves_ ? kLinkedLeafPageHeaderSize
+                                     : kLeafPageHeaderSize;
+
+    if (used > (pageSize_ - headerSize) * fillPercent_ / 100) {
+      Code code = FinishPage(level);
+      if (code != kOk) {
+        return code;
+      }
+      // The levels may have grown.
+      lv = &levels_[level];
+    } else {
+      lv->prefixSize_ = prefixSize;
+    }
+  }
+  if (lv->cells_.empty()) {
+    lv->prefixSize_ = keySize;
+  }
+
+  PendingCell cell;
+  cell.keyOffset_ = lv->buffer_.size();
+  cell.keySize_ = keySize;
+  lv->buffer_.append(key.Data(), key.Size());
+  cell.valueOffset_ = lv->buffer_.size();
+  cell.valueSize_ = local.Size();
+  lv->buffer_.append(local.Data(), local.Size());
+  cell.child_ = child;
+  cell.overflow_ = overflow;
+  cell.overflowSize_ = value.Size() - local.Size();
+  lv->cells_.push_back(cell);
+  lv->size_ += cellSize;
+  return kOk;
+}
+
+Code BulkLoader::FinishPage(int level) {
+  MemPage *page;
+  Code code;
+
+  code = Pager->AllocatePage(tree_->PageFlags(level == 0),
+                             txn_->Snapshot(), &page);
+  if (code != kOk) {
+    return code;
+  }
+  PageNo pageNo = page->MemPageNo();
+  if (level > 0) {
+    finished_.push_back(page);
+  } else {
+    if (lastLeaf_) {
+      if (linkedLeaves_) {
+        lastLeaf_->SetSibling(pageNo);
+      }
+      finished_.push_back(lastLeaf_);
+    }
+    lastLeaf_ = page;
+  }
+
+  code = WritePage(level, page);
+  if (code == kPageFull) {
+    return SaveErrorStatus(
+        Status(kPageFull, "the entry is too large for a page"));
+  }
+
+  // The last key of the page separates it from its right sibling.
+  Level &lv = levels_[level];
+  const PendingCell &last = lv.cells_.back();
+  std::string separator = lv.buffer_.substr(last.keyOffset_, last.keySize_);
+  ++lv.pages_;
+  lv.buffer_.clear();
+  lv.cells_.clear();
+  lv.size_ = 0;
+
+  if (static_cast<int>(finished_.size()) >= batchPages_) {
+    code = WriteFinished();
+    if (code != kOk) {
+      return code;
+    }
+  }
+  return Add(level + 1, separator, Slice(), pageNo);
+}
+
+Code BulkLoader::WritePage(int level, MemPage *page) {
+  const Level &lv = levels_[level];
+  std::vector<CellData> cells;
+  int n = lv.cells_.size();
+
+  if (level > 0) {
+    --n;
+    page->SetRightChild(lv.cells_[n].child_);
+  }
+  cells.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    const PendingCell &cell = lv.cells_[i];
+    cells.push_back(
+        CellData{Slice(&lv.buffer_[cell.keyOffset_], cell.keySize_),
+                 Slice(&lv.buffer_[cell.valueOffset_], cell.valueSize_),
+                 cell.child_, cell.overflow_, cell.overflowSize_});
+  }
+  return page->Rebuild(cells);
+}
+
+Code BulkLoader::Finish() {
+  Code code;
+
+  // Finishing a page adds a cell to the level above, so levels_ may grow
+  // while looping.
+  for (size_t level = 0; level < levels_.size(); ++level) {
+    if (levels_[level].cells_.empty()) {
+      continue;
+    }
+    if (level + 1 == levels_.size() && levels_[level].pages_ == 0) {
+      code = WriteRoot(level);
+      if (code != kPageFull) {
+        return code;
+      }
+      // The root page may be smaller(page 1 has the file header), put the
+      // cells into a new page under the root instead.
+    }
+    code = FinishPage(level);
+    if (code != kOk) {
+      return code;
+    }
+  }
+  if (lastLeaf_) {
+    finished_.push_back(lastLeaf_);
+    lastLeaf_ = nullptr;
+  }
+  return kOk;
+}
+
+Code BulkLoader::WriteRoot(int level) {
+  MemPage *root;
+  Code code;
+
+  code = Pager->GetPage(tree_->Root(), txn_->Snapshot(), &root);
+  if (code != kOk) {
+    return code;
+  }
+  code = Pager->MarkDirty(&root, txn_->Snapshot());
+  if (code != kOk) {
+    Pager->ReleasePage(root);
+    return code;
+  }
+
+  root->Format(tree_->PageFlags(level == 0));
+  code = WritePage(level, root);
+  if (code == kPageFull) {
+    root->Format(tree_->PageFlags(true));
+  }
+  Pager->ReleasePage(root);
+  return code;
+}
+
+Code BulkLoader::WriteFinished() {
+  uint64_t lsn;
+
+  Code code = overflow_.Flush();
+  if (code != kOk || finished_.empty()) {
+    return code;
+  }
+
+  // No committed page refers to them until the root is written, so they
+  // can go into the log ahead of the transaction and leave the pool.
+  code = Pager->CommitPages(finished_, &lsn);
+  for (MemPage *page : finished_) {
+    Pager->ReleasePage(page);
+  }
+  finished_.clear();
+  if (code != kOk) {
+    return code;
+  }
+  return Pager->Sync(lsn);
+}
+} // namespace udb
@@ -0,0 +1,223 @@
+#include "storage/catalog.h"
+#include "buffer/buffer_manager.h"
+#include "buffer/mem_page.h"
+#include "common/bytes.h"
+#include "common/string.h"
+#include "storage/btree.h"
+#include "storage/cell.h"
+#include "storage/cursor.h"
+#include "storage/overflow.h"
+#include "storage/page_layout.h"
+#include "storage/txn_impl.h"
+
+namespace udb {
+// Bytes of an entry before the name of the comparator.
+static const size_t kTreeInfoSize = 5;
+
+Catalog::Catalog(TxnImpl *txn) : txn_(txn), cursor_(txn->cursor_) {}
+
+Code Catalog::Find(const std::string &name, TreeInfo *info) {
+  BTree *tree;
+  Code code = Open(false, &tree);
+  if (code != kOk) {
+    return code;
+  }
+  if (tree == nullptr) {
+    return kNotFound;
+  }
+  code = cursor_->MoveTo(tree, name);
+  if (code != kOk) {
+    return code;
+  }
+  if (cursor_->Location() != Equal) {
+    return kNotFound;
+  }
+  return ReadInfo(info);
+}
+
+Code Catalog::Create(const std::string &name, TreeInfo *info,
+                     bool *created) {
+  uint64_t snapshot = txn_->Snapshot();
+  PageNo root = kInvalidPageNo;
+  bool found = false;
+  BTree *tree;
+
+  Code code = Open(true, &tree);
+  if (code != kOk) {
+    return code;
+  }
+
+  // The leaf of the name stays locked from the lookup to the insert, so
+  // no other writer adds the name in between.
+  do {
+    code = txn_->MoveToWrite(tree, name);
+    if (code != kOk) {
+      break;
+    }
+    if (cursor_->Location() == Equal) {
+      found = true;
+      code = ReadInfo(info);
+      break;
+    }
+    if (root == kInvalidPageNo) {
+      MemPage *page;
+      code = Pager->AllocatePage(DBInstance->PageFlags(true, info->order_),
+                                 snapshot, &page);
+      if (code != kOk) {
+        break;
+      }
+      root = page->MemPageNo();
+      Pager->ReleasePage(page);
+    }
+
+    std::string value(kTreeInfoSize, '\0');
+    Put4Byte(&value[0], root);
+    value[4] = static_cast<char>(info->order_);
+    value += info->comparator_;
+    code = txn_->Put(CellData{name, value, kInvalidPageNo});
+  } while (code == kConflict);
+
+  if (root != kInvalidPageNo && (found || code != kOk)) {
+    Pager->FreePage(root, snapshot);
+  } else if (code == kOk && !found) {
+    info->root_ = root;
+  }
+  *created = code == kOk && !found;
+  return code;
+}
+
+Code Catalog::Remove(const std::string &name, TreeInfo *info) {
+  Code code = Find(name, info);
+  if (code != kOk) {
+    return code;
+  }
+  Status status = txn_->Delete(cursor_->Tree(), name);
+  if (!status.Ok()) {
+    return SaveErrorStatus(status);
+  }
+  return FreeTree(info->root_);
+}
+
+Code Catalog::Roots(std::vector<PageNo> *roots) {
+  BTree *tree;
+
+  roots->assign(1, DBInstance->DefaultTree()->Root());
+  Code code = Open(false, &tree);
+  if (code != kOk || tree == nullptr) {
+    return code;
+  }
+  roots->push_back(tree->Root());
+
+  code = cursor_->MoveTo(tree, Slice());
+  while (code == kOk && (code = cursor_->Next()) == kOk) {
+    TreeInfo info;
+    code = ReadInfo(&info);
+    if (code == kOk) {
+      roots->push_back(info.root_);
+    }
+  }
+  cursor_->Reset();
+  return code == kNotFound ? kOk : code;
+}
+
+Code Catalog::Open(bool create, BTree **tree) {
+  uint64_t snapshot = txn_->Snapshot();
+  PageNo root;
+  MemPage *page;
+  Code code;
+
+  *tree = nullptr;
+  do {
+    code = Pager->GetPage(1, snapshot, &page);
+    if (code != kOk) {
+      return code;
+    }
+    root = Get4Byte(&page->Data()[kFileHeaderCatalogRootOffset]);
+    if (root != kInvalidPageNo || !create) {
+      Pager->ReleasePage(page);
+      break;
+    }
+
+    // Page 1 is locked for the header, a writer creating the catalog at
+    // the same time waits for this one and finds it then.
+    code = Pager->MarkDirty(&page, snapshot);
+    if (code == kOk) {
+      MemPage *rootPage;
+      code = Pager->AllocatePage(DBInstance->PageFlags(true), snapshot,
+                                 &rootPage);
+      if (code == kOk) {
+        root = rootPage->MemPageNo();
+        Put4Byte(&page->Data()[kFileHeaderCatalogRootOffset], root);
+        Pager->ReleasePage(rootPage);
+      }
+    }
+    Pager->ReleasePage(page);
+  } while (code == kConflict);
+
+  if (code == kOk && root != kInvalidPageNo) {
+    *tree = DBInstance->Tree("catalog", root, KeyOrder());
+  }
+  return code;
+}
+
+Code Catalog::FreeTree(PageNo root) {
+  uint64_t snapshot = txn_->Snapshot();
+  std::vector<PageNo> stack{root};
+  Code code;
+
+  while (!stack.empty()) {
+    MemPage *page;
+    PageNo no = stack.back();
+    stack.pop_back();
+    code = Pager->GetPage(no, snapshot, &page);
+    if (code != kOk) {
+      return code;
+    }
+
+    if (!page->IsLeaf()) {
+      for (int i = 0; i <= page->CellNumber() && code == kOk; ++i) {
+        PageNo child;
+        code = page->ChildPageNo(i, &child);
+        if (code == kOk) {
+          stack.push_back(child);
+        }
+      }
+    } else {
+      Cell cell;
+      for (int i = 0; i < page->CellNumber() && code == kOk; ++i) {
+        code = page->GetCell(i, &cell);
+        if (code == kOk && cell.Overflow() != kInvalidPageNo) {
+          code = FreeOverflow(cell.Overflow(),
+                              cell.PayloadSize() - cell.LocalSize(), snapshot);
+        }
+      }
+    }
+    Pager->ReleasePage(page);
+    if (code != kOk) {
+      return code;
+    }
+    Pager->FreePage(no, snapshot);
+    if (stack.size() > static_cast<size_t>(Pager->PageCount())) {
+      return SaveErrorStatus(
+          Status(kCorrupt, FormatString("tree %u has a loop", root)));
+    }
+  }
+  return kOk;
+}
+
+Code Catalog::ReadInfo(TreeInfo *info) {
+  cursor_->GetCell();
+  Cell *cell = cursor_->MutCell();
+  const char *p = cell->Payload();
+  uint64_t size = cell->PayloadSize();
+
+  if (cell->Overflow() != kInvalidPageNo || size < kTreeInfoSize ||
+      static_cast<uint8_t>(p[4]) > kIntKeyOrder) {
+    return SaveErrorStatus(Status(kCorrupt, "invalid catalog entry"));
+  }
+  info->root_ = Get4Byte(p);
+  info->order_ = static_cast<KeyOrderKind>(p[4]);
+  info->comparator_.assign(p + kTreeInfoSize, size - kTreeInfoSize);
+  return kOk;
+}
+} // namespace udb
@@ -0,0 +1,105 @@
+#include "storage/cell.h"
+#include "common/bytes.h"
+#include "storage/comparator.h"
+#include "storage/page_layout.h"
+
+namespace udb {
+uint64_t LocalValueSize(int pageSize, int keySize, uint64_t valueSize) {
+  // The same thresholds as the index b-trees of sqlite.
+  int maxLocal = (pageSize - 12) * 64 / 255 - 23;
+  int minLocal = (pageSize - 12) * 32 / 255 - 23;
+  int chunk = pageSize - kOverflowHeaderSize;
+  uint64_t total = keySize + valueSize;
+
+  if (total <= static_cast<uint64_t>(maxLocal)) {
+    return valueSize;
+  }
+  uint64_t local = minLocal + (total - minLocal) % chunk;
+  if (local > static_cast<uint64_t>(maxLocal)) {
+    local = minLocal;
+  }
+  // The key is never spilled.
+  return local > static_cast<uint64_t>(keySize) ? local - keySize : 0;
+}
+
+Cell::Cell() { Reset(); }
+
+Cell::~Cell() {}
+
+void Cell::Reset() {
+  prefix_ = nullptr;
+  prefixSize_ = 0;
+  keySize_ = 0;
+  payLoadSize_ = 0;
+  key_ = nullptr;
+  payload_ = nullptr;
+  localSize_ = 0;
+  cellSize_ = 0;
+  leftChild_ = kInvalidPageNo;
+  overflow_ = kInvalidPageNo;
+  type_ = InvalidCell;
+}
+
+Code Cell::ParseFrom(const char *data, bool isLeaf, int pageSize,
+                     const char *prefix, uint16_t prefixSize, bool intKey) {
+  const char *p = data;
+  uint64_t size;
+
+  prefix_ = prefix;
+  prefixSize_ = prefixSize;
+
+  if (intKey) {
+    // The key has a fixed size and place, see page_layout.h.
+    keySize_ = kU64KeySize;
+    if (isLeaf) {
+      type_ = LeafCell;
+      leftChild_ = kInvalidPageNo;
+      key_ = p;
+      p += kU64KeySize;
+      p += GetVarint(p, &size);
+      payLoadSize_ = size;
+    } else {
+      type_ = InternalCell;
+      leftChild_ = Get4Byte(p);
+      key_ = p + 4;
+      p = key_ + kU64KeySize;
+      payLoadSize_ = 0;
+    }
+    payload_ = p;
+  } else {
+    if (isLeaf) {
+      type_ = LeafCell;
+      leftChild_ = kInvalidPageNo;
+      p += GetVarint(p, &size);
+      payLoadSize_ = size;
+    } else {
+      type_ = InternalCell;
+      leftChild_ = Get4Byte(p);
+      p += 4;
+      payLoadSize_ = 0;
+    }
+    p += GetVarint(p, &size);
+    keySize_ = static_cast<uint16_t>(size);
+
+    key_ = p;
+    payload_ = p + keySize_;
+  }
+  localSize_ = static_cast<uint16_t>(
+      isLeaf ? LocalValueSize(pageSize, prefixSize_ + keySize_, payLoadSize_)
+             : 0);
+  overflow_ = kInvalidPageNo;
+  p = payload_ + localSize_;
+  if (localSize_ < payLoadSize_) {
+    overflow_ = Get4Byte(p);
+    p += 4;
+  }
+  cellSize_ = static_cast<uint16_t>(p - data);
+
+  return kOk;
+}
+
+void Cell::AppendKey(std::string *key) const {
+  key->append(prefix_, prefixSize_);
+  key->append(key_, keySize_);
+}
+} // namespace udb
@@ -0,0 +1,81 @@
+#include "storage/comparator.h"
+
+namespace udb {
+namespace {
+class BytewiseComparatorImpl : public Comparator {
+public:
+  int Compare(const Slice &a, const Slice &b) const override {
+    return a.Compare(b.Data(), b.Size());
+  }
+
+  const char *Name() const override { return "udb.BytewiseComparator"; }
+};
+
+class U64ComparatorImpl : public Comparator {
+public:
+  int Compare(const Slice &a, const Slice &b) const override {
+    uint64_t x = U64Key(a.Data());
+    uint64_t y = U64Key(b.Data());
+    return x < y ? -1 : x > y;
+  }
+
+  const char *Name() const override { return "udb.U64Comparator"; }
+};
+
+class ReverseBytewiseComparatorImpl : public Comparator {
+public:
+  int Compare(const Slice &a, const Slice &b) const override {
+    return b.Compare(a.Data(), a.Size());
+  }
+
+  const char *Name() const override {
+    return "udb.ReverseBytewiseComparator";
+  }
+};
+} // namespace
+
+const Comparator *BytewiseComparator() {
+  static const BytewiseComparatorImpl comparator;
+  return &comparator;
+}
+
+const Comparator *U64Comparator() {
+  static const U64ComparatorImpl comparator;
+  return &comparator;
+}
+
+const Comparator *ReverseBytewiseComparator() {
+  static const ReverseBytewiseComparatorImpl comparator;
+  return &comparator;
+}
+
+KeyOrder KeyOrder::Of(const Comparator *comparator) {
+  KeyOrder order;
+  if (comparator == nullptr || comparator == BytewiseComparator()) {
+    return order;
+  }
+  order.comparator_ = comparator;
+  if (comparator == U64Comparator()) {
+    order.kind_ = kU64Order;
+  } else if (comparator == ReverseBytewiseComparator()) {
+    order.kind_ = kReverseOrder;
+  } else {
+    order.kind_ = kCustomOrder;
+  }
+  return order;
+}
+
+const Comparator *KeyOrder::Builtin(KeyOrderKind kind) {
+  switch (kind) {
+  case kBytewiseOrder:
+    return BytewiseComparator();
+  case kU64Order:
+  case kIntKeyOrder:
+    return U64Comparator();
+  case kReverseOrder:
+    return ReverseBytewiseComparator();
+  default:
+    return nullptr;
+  }
+}
+} // namespace udb
@@ -2,22 +2,49 @@
 #include "buffer/buffer_manager.h"
 #include "buffer/mem_page.h"
 #include "common/debug.h"
+#include "common/metrics.h"
 #include "common/string.h"
 #include "storage/btree.h"
+#include "storage/hash_index.h"
+#include "storage/txn_impl.h"
+
+#include <algorithm>
+#include <vector>
 
 namespace udb {
-Cursor::Cursor(TxnImpl *txn) { Reset(); }
+// Leaves hinted by the first readahead of a scan, and at most.
+static const int kMinReadahead = 4;
+static const int kMaxReadahead = 64;
+
+Cursor::Cursor(TxnImpl *txn) : txn_(txn), curIndex_(-1), detached_(false) {
+  Reset();
+}
 
-Cursor::~Cursor() {}
+Cursor::~Cursor() { Reset(); }
 
 void Cursor::Reset() {
+  // Unpin the pages in the stack.
+  for (int i = 0; i <= curIndex_; ++i) {
+    Pager->ReleasePage(pageStack_[i]);
+  }
+
   tree_ = nullptr;
   root_ = kInvalidPageNo;
   location_ = Invalid;
   cellIndex_ = -1;
   curIndex_ = -1;
+  detached_ = false;
   page_ = nullptr;
+  cell_.Reset();
   key_.Clear();
+  ResetReadahead();
+}
+
+void Cursor::ResetReadahead() {
+  raParent_ = kInvalidPageNo;
+  raDir_ = 0;
+  raWindow_ = 0;
+  raNext_ = 0;
 }
 
 bool Cursor::IsReseted() const {
@@ -26,16 +53,34 @@ bool Cursor::IsReseted() const {
 }
 
 void Cursor::GetCell() {
+  Assert(location_ == Equal);
   if (cell_.IsEmpty()) {
+    page_->GetCell(cellIndex_, &cell_);
   }
 }
 
-Code Cursor::MoveTo(BTree *tree, const Slice &key) {
-  Assert(IsReseted());
+Code Cursor::MarkDirty() { return MarkDirty(curIndex_); }
 
-  MemPage *page;
+Code Cursor::MarkDirty(int level) {
+  Assert(level >= 0 && level <= curIndex_);
+  Code code = Pager->MarkDirty(&pageStack_[level], txn_->Snapshot());
+  if (code == kConflict) {
+    // Read the whole path again on the next move.
+    Reset();
+  }
+  if (code != kOk) {
+    return code;
+  }
+  if (level == curIndex_) {
+    // The cell points into the old image.
+    page_ = pageStack_[level];
+    cell_.Reset();
+  }
+  return kOk;
+}
+
+Code Cursor::MoveTo(BTree *tree, const Slice &key) {
   Code code;
-  PageNo childNo;
 
   // First initialize the cursor.
   if (tree_ && tree->Root() != tree_->Root()) {
@@ -44,19 +89,174 @@ Code Cursor::MoveTo(BTree *tree, const Slice &key) {
   tree_ = tree;
   key_ = key;
   root_ = tree->Root();
+  ResetReadahead();
+  RecordTick(kCursorSeeks);
+
+  // Second move to the root page of btree, then search the key in the
+  // tree. A writer starts again if a page it went through has been
+  // committed by another writer meanwhile.
+  do {
+    code = MoveToRoot();
+    if (code == kOk) {
+      code = Descend(key);
+    }
+  } while (code == kConflict);
+  return code;
+}
+
+Code Cursor::MoveToHashed(BTree *tree, const Slice &key) {
+  HashIndex *hash = tree->Hash();
+  if (hash == nullptr || txn_->write_) {
+    return MoveTo(tree, key);
+  }
+  hash->RecordLookup();
+  if (!hash->IsActive()) {
+    return MoveTo(tree, key);
+  }
+
+  // The entry holds if the page the snapshot reads is the version it was
+  // made from and still has the key there. The page may have been freed
+  // and left as it was, so no commit may have freed pages between the
+  // snapshot of the entry and this one. The last free is read after the
+  // entry, which was added after any free its snapshot sees.
+  uint64_t snapshot = txn_->Snapshot();
+  HashIndex::Entry entry;
+  MemPage *page = nullptr;
+  if (hash->Find(key, &entry)) {
+    uint64_t lastFree = Pager->LastFreeLsn();
+    if (entry.snapshot_ >= lastFree && snapshot >= lastFree &&
+        Pager->GetPage(entry.page_, snapshot, &page) == kOk &&
+        (page->Version() != entry.version_ || !page->IsLeaf() ||
+         entry.index_ >= page->CellNumber() ||
+         page->CompareCell(entry.index_, key, tree->Order()) != 0)) {
+      Pager->ReleasePage(page);
+      page = nullptr;
+    }
+  }
+  if (page != nullptr) {
+    Reset();
+    tree_ = tree;
+    key_ = key;
+    root_ = tree->Root();
+    pageStack_[0] = page_ = page;
+    curIndex_ = 0;
+    detached_ = true;
+    cellIndex_ = entry.index_;
+    location_ = Equal;
+    RecordTick(kCursorSeeks);
+    RecordTick(kPagesVisited);
+    RecordTick(kHashHits);
+    return kOk;
+  }
+
+  RecordTick(kHashMisses);
+  Code code = MoveTo(tree, key);
+  if (code == kOk && location_ == Equal) {
+    hash->Insert(key, HashIndex::Entry{page_->MemPageNo(), cellIndex_,
+                                       page_->Version(), snapshot});
+  }
+  return code;
+}
+
+Code Cursor::Seek(BTree *tree, const Slice &key) {
+  Code code;
+  do {
+    code = MoveTo(tree, key);
+    if (code == kOk && location_ != Equal) {
+      code = Next();
+    }
+  } while (code == kConflict);
+  return code;
+}
+
+Code Cursor::SeekToFirst(BTree *tree) { return SeekToEdge(tree, 1); }
+
+Code Cursor::SeekToLast(BTree *tree) { return SeekToEdge(tree, -1); }
+
+Code Cursor::SeekToEdge(BTree *tree, int dir) {
+  Code code;
+
+  if (tree_ && tree->Root() != tree_->Root()) {
+    Reset();
+  }
+  tree_ = tree;
+  key_.Clear();
+  root_ = tree->Root();
+  ResetReadahead();
+  RecordTick(kCursorSeeks);
 
-  // Second move to the root page of btree.
-  code = MoveToRoot();
+  // Start again on a conflict as MoveTo, and skip the leaves emptied by
+  // deletes.
+  do {
+    cell_.Reset();
+    code = MoveToRoot();
+    if (code == kOk && !page_->IsLeaf()) {
+      childCell_[0] = dir > 0 ? 0 : page_->CellNumber();
+      code = DescendEdge(dir);
+    }
+    if (code == kOk && page_->CellNumber() == 0) {
+      code = StepLeaf(dir);
+    } else if (code == kOk) {
+      cellIndex_ = dir > 0 ? 0 : page_->CellNumber() - 1;
+      location_ = Equal;
+    }
+  } while (code == kConflict);
   if (code != kOk) {
-    return code;
+    location_ = Invalid;
+  }
+  return code;
+}
+
+Code Cursor::MoveNear(BTree *tree, const Slice &key) {
+  if (tree_ != tree || curIndex_ < 0 || detached_) {
+    return MoveTo(tree, key);
+  }
+
+  // Climb up until the key is inside the subtree, the key is after all
+  // the keys left of the path already.
+  int level = curIndex_;
+  while (level > 0 && !InSubtree(level, key)) {
+    --level;
+  }
+  for (int i = level + 1; i <= curIndex_; ++i) {
+    Pager->ReleasePage(pageStack_[i]);
+  }
+  curIndex_ = level;
+  page_ = pageStack_[level];
+  key_ = key;
+  ResetReadahead();
+
+  Code code = Descend(key);
+  if (code == kConflict) {
+    return MoveTo(tree, key);
+  }
+  return code;
+}
+
+bool Cursor::InSubtree(int level, const Slice &key) const {
+  // The max key of a subtree is the separator of the nearest ancestor
+  // not reached through its right child.
+  for (int i = level - 1; i >= 0; --i) {
+    MemPage *parent = pageStack_[i];
+    if (childCell_[i] < parent->CellNumber()) {
+      return parent->CompareCell(childCell_[i], key, tree_->Order()) <= 0;
+    }
   }
+  return true;
+}
 
-  // Third search the key in the tree.
+Code Cursor::Descend(const Slice &key) {
+  MemPage *page;
+  Code code;
+  PageNo childNo;
+
+  cell_.Reset();
   while (true) {
     page = page_;
 
     // Search the key in the page
-    code = page->Search(key, this, &childNo, &location_, &cellIndex_);
+    code = page->Search(key, tree_->Order(), &childNo, &location_,
+                        &cellIndex_);
     if (code != kOk) {
       return code;
     }
@@ -67,17 +267,24 @@ Code Cursor::MoveTo(BTree *tree, const Slice &key) {
     }
 
     // check if or not has reached the max depth of tree
-    if (curIndex_ >= kTreeMaxDepth) {
+    if (curIndex_ >= kTreeMaxDepth - 2) {
       return SaveErrorStatus(Status(
           kCursorOverflow,
-          FormatString("Cursor has overflowed when searching key {} in tree {}",
-                       key.String(), tree_->Name())));
+          FormatString("Cursor has overflowed when searching key %s in tree %s",
+                       key.String().c_str(), tree_->Name().c_str())));
     }
 
+    childCell_[curIndex_] = (location_ == Right || page->CellNumber() == 0)
+                                ? page->CellNumber()
+                                : cellIndex_;
     code = MoveToChild(childNo);
     if (code != kOk) {
       break;
     }
+    code = ValidateParent();
+    if (code != kOk) {
+      break;
+    }
   }
 
   // When out of the loop:
@@ -88,19 +295,271 @@ Code Cursor::MoveTo(BTree *tree, const Slice &key) {
   return code;
 }
 
+Code Cursor::Next() { return Step(1); }
+
+Code Cursor::Prev() { return Step(-1); }
+
+Code Cursor::Step(int dir) {
+  if (location_ == Invalid) {
+    return kNotFound;
+  }
+
+  // Left and Right positions lie between cells.
+  int index = cellIndex_;
+  if (location_ == Equal || (location_ == Left) == (dir < 0)) {
+    index += dir;
+  }
+  cell_.Reset();
+  if (index >= 0 && index < page_->CellNumber()) {
+    cellIndex_ = index;
+    location_ = Equal;
+    return kOk;
+  }
+  return StepLeaf(dir);
+}
+
+Code Cursor::StepLeaf(int dir) {
+  Code code;
+
+  // Only a linked leaf has a sibling to step to without the path.
+  if (detached_ && (dir < 0 || !page_->IsLinked())) {
+    code = Attach();
+    if (code != kOk) {
+      location_ = Invalid;
+      return code;
+    }
+  }
+  do {
+    if (dir > 0) {
+      bool stepped;
+      code = StepSibling(&stepped);
+      if (code != kOk) {
+        location_ = Invalid;
+        return code;
+      }
+      if (stepped) {
+        continue;
+      }
+    }
+
+    // Climb to the nearest parent with a child next to the path.
+    int level = curIndex_ - 1;
+    while (level >= 0) {
+      int index = childCell_[level] + dir;
+      if (index >= 0 && index <= pageStack_[level]->CellNumber()) {
+        break;
+      }
+      --level;
+    }
+    if (level < 0) {
+      location_ = Invalid;
+      return kNotFound;
+    }
+    for (int i = level + 1; i <= curIndex_; ++i) {
+      Pager->ReleasePage(pageStack_[i]);
+    }
+    curIndex_ = level;
+    page_ = pageStack_[level];
+    childCell_[level] += dir;
+
+    code = DescendEdge(dir);
+    if (code != kOk) {
+      location_ = Invalid;
+      return code;
+    }
+    Readahead(dir);
+    // Leaves emptied by deletes are skipped.
+  } while (page_->CellNumber() == 0);
+
+  cellIndex_ = dir > 0 ? 0 : page_->CellNumber() - 1;
+  location_ = Equal;
+  return kOk;
+}
+
+Code Cursor::StepSibling(bool *stepped) {
+  uint64_t snapshot = txn_->Snapshot();
+  Code code;
+
+  // A writer does not see the siblings other writers link meanwhile, it
+  // takes the path validating each parent.
+  *stepped = false;
+  if (txn_->write_ || !page_->IsLinked()) {
+    return kOk;
+  }
+  // Within the parent the path costs a page as well, and keeps the
+  // readahead going.
+  if (!detached_ && curIndex_ > 0 &&
+      childCell_[curIndex_ - 1] < pageStack_[curIndex_ - 1]->CellNumber()) {
+    return kOk;
+  }
+  PageNo sibling = page_->Sibling();
+  if (sibling == kInvalidPageNo) {
+    return kNotFound;
+  }
+  // A cold leaf is read through the path, the next parent hints the
+  // leaves after it. An empty leaf has no key to find it by.
+  if (!Pager->IsCached(sibling, snapshot)) {
+    if (!detached_) {
+      return kOk;
+    }
+    if (page_->CellNumber() > 0) {
+      return Attach();
+    }
+  }
+
+  MemPage *page;
+  code = Pager->GetPage(sibling, snapshot, &page);
+  if (code != kOk) {
+    return code;
+  }
+  for (int i = 0; i <= curIndex_; ++i) {
+    Pager->ReleasePage(pageStack_[i]);
+  }
+  curIndex_ = 0;
+  pageStack_[0] = page_ = page;
+  detached_ = true;
+  ResetReadahead();
+  RecordTick(kPagesVisited);
+  *stepped = true;
+  return kOk;
+}
+
+Code Cursor::Attach() {
+  // Any key of the leaf leads to it, the snapshot of a reader does not
+  // change.
+  Cell cell;
+  Code code = page_->GetCell(0, &cell);
+  if (code != kOk) {
+    return code;
+  }
+  seekKey_.clear();
+  cell.AppendKey(&seekKey_);
+  return MoveTo(tree_, seekKey_);
+}
+
+Code Cursor::DescendEdge(int dir) {
+  Code code;
+  PageNo childNo;
+
+  while (true) {
+    code = page_->ChildPageNo(childCell_[curIndex_], &childNo);
+    if (code == kOk) {
+      code = MoveToChild(childNo);
+    }
+    if (code == kOk) {
+      code = ValidateParent();
+    }
+    if (code != kOk || page_->IsLeaf()) {
+      return code;
+    }
+    if (curIndex_ >= kTreeMaxDepth - 2) {
+      return SaveErrorStatus(Status(
+          kCursorOverflow,
+          FormatString("Cursor has overflowed when stepping in tree %s",
+                       tree_->Name().c_str())));
+    }
+    childCell_[curIndex_] = dir > 0 ? 0 : page_->CellNumber();
+  }
+}
+
+void Cursor::Readahead(int dir) {
+  if (curIndex_ < 1) {
+    return;
+  }
+  MemPage *parent = pageStack_[curIndex_ - 1];
+  int index = childCell_[curIndex_ - 1];
+
+  // A new parent or direction starts hinting next to the leaf, the window
+  // is kept as the scan goes on.
+  if (parent->MemPageNo() != raParent_ || dir != raDir_) {
+    if (dir != raDir_) {
+      raWindow_ = 0;
+    }
+    raParent_ = parent->MemPageNo();
+    raDir_ = dir;
+    raNext_ = index + dir;
+  }
+
+  // Hinted leaves still ahead of the cursor.
+  int ahead = (raNext_ - index) * dir - 1;
+  if (ahead > raWindow_ / 2) {
+    return;
+  }
+  raWindow_ = raWindow_ == 0 ? kMinReadahead
+                             : std::min(raWindow_ * 2, kMaxReadahead);
+
+  PageNo pages[kMaxReadahead];
+  int n = 0;
+  for (; n < raWindow_ && raNext_ >= 0 && raNext_ <= parent->CellNumber();
+       ++n, raNext_ += dir) {
+    if (parent->ChildPageNo(raNext_, &pages[n]) != kOk) {
+      break;
+    }
+  }
+  Pager->Readahead(pages, n, txn_->Snapshot());
+}
+
+int Cursor::PrefetchLeaves(std::span<const Slice> keys) {
+  if (curIndex_ < 1) {
+    return 0;
+  }
+
+  int level = curIndex_ - 1;
+  MemPage *parent = pageStack_[level];
+  PageNo last = page_->MemPageNo();
+  PageNo childNo;
+  CursorLocation location;
+  int cellIndex;
+  std::vector<PageNo> leaves;
+  int n = 0;
+
+  for (; n < static_cast<int>(keys.size()); ++n) {
+    if (!InSubtree(level, keys[n]) ||
+        parent->Search(keys[n], tree_->Order(), &childNo, &location,
+                       &cellIndex) != kOk) {
+      break;
+    }
+    // Neighbouring keys share leaves, read each leaf once.
+    if (childNo != last) {
+      leaves.push_back(childNo);
+      last = childNo;
+    }
+  }
+  // The leaves are read at once.
+  Pager->Readahead(leaves.data(), static_cast<int>(leaves.size()),
+                   txn_->Snapshot());
+  return n;
+}
+
 Code Cursor::MoveToRoot() {
   Assert(root_ != kInvalidPageNo);
 
-  Code code;
+  Code code = kOk;
+
+  // The leaf of a detached cursor is not under the root in the stack.
+  if (detached_) {
+    Pager->ReleasePage(pageStack_[0]);
+    curIndex_ = -1;
+    detached_ = false;
+  }
 
   // Load the root page of b-tree
 
   if (curIndex_ >= 0) {
-    // curIndex_ >= 0 means that the root has been loaded.
+    // curIndex_ >= 0 means that the root has been loaded,
+    // unpin the pages below it.
+    for (int i = 1; i <= curIndex_; ++i) {
+      Pager->ReleasePage(pageStack_[i]);
+    }
     page_ = pageStack_[0];
-  } else {
+  }
+  if (curIndex_ >= 0 && !Pager->IsLatest(page_, txn_->Snapshot())) {
+    Pager->ReleasePage(page_);
+    curIndex_ = -1;
+  }
+  if (curIndex_ < 0) {
     // else load the page from pager
-    code = Pager->GetPage(root_, &page_);
+    code = Pager->GetPage(root_, txn_->Snapshot(), &page_);
     if (code != kOk) {
       return code;
     }
@@ -108,6 +567,7 @@ Code Cursor::MoveToRoot() {
   Assert(page_->MemPageNo() == root_);
   curIndex_ = 0;
   pageStack_[curIndex_] = page_;
+  RecordTick(kPagesVisited);
 
   return code;
 }
@@ -117,20 +577,24 @@ Code Cursor::MoveToChild(PageNo chidNo) {
 
   Code code;
 
-  code = Pager->GetPage(root_, &page_);
+  code = Pager->GetPage(chidNo, txn_->Snapshot(), &page_);
   if (code != kOk) {
     return code;
   }
   pageStack_[++curIndex_] = page_;
+  RecordTick(kPagesVisited);
+  return kOk;
 }
 
-void Cursor::ParseCell() {}
-
-void Cursor::Reset() {
-  root_ = kInvalidPageNo;
-  tree_ = nullptr;
-  page_ = nullptr;
-  curIndex_ = cellIndex_ = -1;
+Code Cursor::ValidateParent() {
+  // The child was read after the parent, if the parent is still the
+  // latest version the child is the one it points to.
+  if (!Pager->IsLatest(pageStack_[curIndex_ - 1], txn_->Snapshot())) {
+    return kConflict;
+  }
+  return kOk;
 }
 
-} // namespace udb
\ No newline at end of file
+void Cursor::ParseCell() {}
+
+} // namespace udb
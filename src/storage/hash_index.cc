@@ -0,0 +1,121 @@
+#include "storage/hash_index.h"
+
+#include <algorithm>
+#include <string_view>
+
+namespace udb {
+static const uint64_t kTagMask = 0xffffffff;
+static const uint64_t kSequenceOne = uint64_t(1) << 32;
+
+HashIndex::HashIndex(int capacity)
+    : mask_(0), score_(0), active_(false), buckets_(nullptr) {
+  size_t buckets = 1;
+  while (buckets * 2 < static_cast<size_t>(capacity)) {
+    buckets *= 2;
+  }
+  mask_ = buckets - 1;
+}
+
+HashIndex::~HashIndex() { delete[] buckets_.load(); }
+
+void HashIndex::RecordLookup() {
+  int score = score_.load(std::memory_order_relaxed);
+  if (score >= kBuildScore) {
+    return;
+  }
+  score_.store(score + 1, std::memory_order_relaxed);
+  if (score + 1 < kBuildScore) {
+    return;
+  }
+  if (buckets_.load(std::memory_order_acquire) == nullptr) {
+    Bucket *buckets = new Bucket[mask_ + 1]();
+    Bucket *expected = nullptr;
+    if (!buckets_.compare_exchange_strong(expected, buckets,
+                                          std::memory_order_acq_rel)) {
+      delete[] buckets;
+    }
+  }
+  active_.store(true, std::memory_order_relaxed);
+}
+
+void HashIndex::RecordWrite() {
+  int score = score_.load(std::memory_order_relaxed);
+  if (score == 0) {
+    return;
+  }
+  score = std::max(score - kWriteWeight, 0);
+  score_.store(score, std::memory_order_relaxed);
+  if (score == 0) {
+    active_.store(false, std::memory_order_relaxed);
+  }
+}
+
+uint64_t HashIndex::Hash(const Slice &key) {
+  // The low bits pick the bucket, the high ones are the tag.
+  return std::hash<std::string_view>()(std::string_view(key.Data(),
+                                                        key.Size()));
+}
+
+bool HashIndex::Find(const Slice &key, Entry *entry) const {
+  Bucket *buckets = buckets_.load(std::memory_order_acquire);
+  if (buckets == nullptr) {
+    return false;
+  }
+  uint64_t hash = Hash(key);
+  for (const Slot &slot : buckets[hash & mask_].slots_) {
+    uint64_t tag = slot.tag_.load(std::memory_order_acquire);
+    if ((tag & kSequenceOne) != 0 || (tag & kTagMask) != (hash >> 32)) {
+      continue;
+    }
+    uint64_t location = slot.location_.load(std::memory_order_relaxed);
+    entry->version_ = slot.version_.load(std::memory_order_relaxed);
+    entry->snapshot_ = slot.snapshot_.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.tag_.load(std::memory_order_relaxed) != tag) {
+      return false;
+    }
+    entry->page_ = static_cast<PageNo>(location >> 32);
+    entry->index_ = static_cast<int>(location & kTagMask);
+    return entry->page_ != kInvalidPageNo;
+  }
+  return false;
+}
+
+void HashIndex::Insert(const Slice &key, const Entry &entry) {
+  Bucket *buckets = buckets_.load(std::memory_order_acquire);
+  if (buckets == nullptr) {
+    return;
+  }
+  uint64_t hash = Hash(key);
+  Bucket &bucket = buckets[hash & mask_];
+
+  // The slot of the key if it has one, else an empty one, else the one
+  // the hash picks.
+  Slot *slot = &bucket.slots_[(hash >> 31) & 1];
+  for (Slot &s : bucket.slots_) {
+    if ((s.tag_.load(std::memory_order_relaxed) & kTagMask) == (hash >> 32)) {
+      slot = &s;
+      break;
+    }
+    if (s.location_.load(std::memory_order_relaxed) == 0) {
+      slot = &s;
+    }
+  }
+
+  // The entry is dropped if another reader is writing the slot.
+  uint64_t tag = slot->tag_.load(std::memory_order_relaxed);
+  if ((tag & kSequenceOne) != 0 ||
+      !slot->tag_.compare_exchange_strong(tag, tag + kSequenceOne,
+                                          std::memory_order_relaxed)) {
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->location_.store(static_cast<uint64_t>(entry.page_) << 32 |
+                            static_cast<uint32_t>(entry.index_),
+                        std::memory_order_relaxed);
+  slot->version_.store(entry.version_, std::memory_order_relaxed);
+  slot->snapshot_.store(entry.snapshot_, std::memory_order_relaxed);
+  uint64_t sequence = (tag >> 32) + 2;
+  slot->tag_.store(sequence << 32 | (hash >> 32), std::memory_order_release);
+}
+} // namespace udb
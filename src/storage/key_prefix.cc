@@ -0,0 +1,144 @@
+#include "storage/key_prefix.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UDB_SIMD_SEARCH 1
+#endif
+
+namespace udb {
+// Binary search down to this many prefixes, then count them with SIMD
+// compares, which is branch free and scans whole cache lines.
+static const int kScanWidth = 32;
+
+// Interpolate down to this many keys of an intkey page, then count them.
+static const int kIntKeyScanWidth = 8;
+
+static int CountLessScalar(const uint32_t *prefixes, int n, uint32_t key) {
+  int count = 0;
+  for (int i = 0; i < n; ++i) {
+    count += prefixes[i] < key;
+  }
+  return count;
+}
+
+#ifdef UDB_SIMD_SEARCH
+// SSE2 and AVX2 only have signed 32-bit compares, flipping the sign bit
+// of both sides gives the unsigned order.
+static const uint32_t kSignBit = 0x80000000;
+
+static int CountLessSse2(const uint32_t *prefixes, int n, uint32_t key) {
+  const __m128i sign = _mm_set1_epi32(kSignBit);
+  const __m128i k = _mm_set1_epi32(key ^ kSignBit);
+  int count = 0;
+  int i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&prefixes[i]));
+    __m128i lt = _mm_cmpgt_epi32(k, _mm_xor_si128(v, sign));
+    count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(lt)));
+  }
+  return count + CountLessScalar(&prefixes[i], n - i, key);
+}
+
+__attribute__((target("avx2"))) static int
+CountLessAvx2(const uint32_t *prefixes, int n, uint32_t key) {
+  const __m256i sign = _mm256_set1_epi32(kSignBit);
+  const __m256i k = _mm256_set1_epi32(key ^ kSignBit);
+  int count = 0;
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&prefixes[i]));
+    __m256i lt = _mm256_cmpgt_epi32(k, _mm256_xor_si256(v, sign));
+    count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(lt)));
+  }
+  return count + CountLessSse2(&prefixes[i], n - i, key);
+}
+
+typedef int (*CountLessFunc)(const uint32_t *, int, uint32_t);
+
+static CountLessFunc ChooseCountLess() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return CountLessAvx2;
+  }
+  return CountLessSse2;
+}
+
+static const CountLessFunc CountLess = ChooseCountLess();
+#else
+#define CountLess CountLessScalar
+#endif
+
+int PrefixLowerBound(const uint32_t *prefixes, int n, uint32_t key) {
+  int low = 0;
+  int high = n;
+
+  while (high - low > kScanWidth) {
+    int mid = (low + high) / 2;
+    if (prefixes[mid] < key) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low + CountLess(&prefixes[low], high - low, key);
+}
+
+int PrefixUpperBound(const uint32_t *prefixes, int n, uint32_t key) {
+  if (key == UINT32_MAX) {
+    return n;
+  }
+  return PrefixLowerBound(prefixes, n, key + 1);
+}
+
+int IntKeyLowerBound(const uint64_t *keys, int n, uint64_t key) {
+  int low = 0;
+  int high = n;
+
+  while (high - low > kIntKeyScanWidth) {
+    uint64_t first = keys[low];
+    uint64_t last = keys[high - 1];
+    if (key <= first) {
+      return low;
+    }
+    if (key > last) {
+      return high;
+    }
+
+    // Guess the place of the key from the spread of the keys, dense ids
+    // are found at the first guess.
+    int size = high - low;
+    unsigned __int128 offset =
+        static_cast<unsigned __int128>(key - first) * (size - 1);
+    int guess = low + static_cast<int>(offset / (last - first));
+    if (keys[guess] == key) {
+      return guess;
+    }
+    if (keys[guess] < key) {
+      low = guess + 1;
+    } else {
+      high = guess;
+    }
+
+    // Skewed keys halve the range as well, so that they take at most
+    // twice the steps of a binary search.
+    if (high - low > size / 2) {
+      int mid = (low + high) / 2;
+      if (keys[mid] < key) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+  }
+
+  // Count the keys left below the key without branching on them.
+  int count = 0;
+  for (int i = low; i < high; ++i) {
+    count += keys[i] < key;
+  }
+  return low + count;
+}
+} // namespace udb
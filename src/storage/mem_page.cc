@@ -3,20 +3,32 @@
 #include "buffer/mem_page.h"
 #include "common/bytes.h"
 #include "common/debug.h"
+#include "common/metrics.h"
 #include "common/string.h"
 #include "storage/cell.h"
+#include "storage/comparator.h"
 #include "storage/cursor.h"
+#include "storage/key_prefix.h"
 #include "storage/page.h"
 #include "storage/page_layout.h"
 
+#include <string.h>
+
 namespace udb {
 
-MemPage::MemPage() {}
+MemPage::MemPage()
+    : page_(nullptr), pageNo_(kInvalidPageNo), headerOffset_(0),
+      headerSize_(0), cellNum_(0), isLeaf_(false), data_(nullptr),
+      pageSize_(0), version_(kDbFileVersion), isOverflow_(false),
+      isPrefixPage_(false), isIntKeyPage_(false), isLinked_(false),
+      prefix_(nullptr), prefixSize_(0), prefixAreaSize_(0), freeSpace_(-1) {}
 
 Code MemPage::InitFromPage(Page *page) {
   PageNo pageNo = page->DiskPageNo();
   char *data = page->Data();
 
+  pageSize_ = page->Size();
+
   // If this page 1 then read the file header.
   if (pageNo == 1) {
     headerOffset_ = kPage1HeaderOffset;
@@ -30,132 +42,666 @@ Code MemPage::InitFromPage(Page *page) {
     return code;
   }
 
+  page_ = page;
+  pageNo_ = pageNo;
   data_ = data;
+  isOverflow_ = false;
+  freeSpace_ = -1;
+  BuildSearchIndex();
   return code;
 }
 
-// Search the key in the page.
-// If not reached the leaf page, return child page no in pageNo and kOk.
-// Return error otherwise.
-Code MemPage::Search(const Slice &key, Cursor *cursor, PageNo *pageNo,
-                     CursorLocation *location, int *cellIndex) {
-  Cell cell;
-  int compare;
-  Code code;
+void MemPage::InitOverflow(Page *page) {
+  page_ = page;
+  pageNo_ = page->DiskPageNo();
+  data_ = page->Data();
+  pageSize_ = page->Size();
+  headerOffset_ = 0;
+  headerSize_ = 0;
+  cellNum_ = 0;
+  isLeaf_ = false;
+  isOverflow_ = true;
+  isPrefixPage_ = false;
+  isIntKeyPage_ = false;
+  isLinked_ = false;
+  prefix_ = nullptr;
+  prefixSize_ = 0;
+  prefixAreaSize_ = 0;
+  freeSpace_ = 0;
+  prefixes_.clear();
+  intKeys_.clear();
+}
 
-  *pageNo = kInvalidPageNo;
+PageNo MemPage::NextOverflow() const {
+  Assert(isOverflow_);
+  return Get4Byte(data_);
+}
 
-  // Fast path: compare with the low and high cell.
+void MemPage::SetNextOverflow(PageNo no) {
+  Assert(isOverflow_);
+  Put4Byte(data_, no);
+}
 
-  // Compare with the low cell of the page.
-  code = GetCell(0, &cell);
-  if (code != kOk) {
-    return code;
+void MemPage::Format(Page *page, char flags) {
+  page_ = page;
+  pageNo_ = page->DiskPageNo();
+  data_ = page->Data();
+  pageSize_ = page->Size();
+  headerOffset_ = pageNo_ == 1 ? kPage1HeaderOffset : 0;
+  isLeaf_ = (flags & kPageTypeMask) == kLeafPage;
+  isOverflow_ = false;
+  isLinked_ = (flags & kLinkedPage) != 0;
+  headerSize_ = !isLeaf_   ? kInternalPageHeaderSize
+                : isLinked_ ? kLinkedLeafPageHeaderSize
+                            : kLeafPageHeaderSize;
+
+  char *header = &data_[headerOffset_];
+  memset(header, 0, headerSize_);
+  header[kPageFlagHeaderOffset] = flags;
+
+  isPrefixPage_ = (flags & kPrefixPage) != 0;
+  isIntKeyPage_ = (flags & kIntKeyPage) != 0;
+  prefixSize_ = 0;
+  prefix_ = &header[headerSize_ + 2];
+  prefixAreaSize_ = 0;
+  if (isPrefixPage_) {
+    put2byte(&header[headerSize_], 0);
+    prefixAreaSize_ = 2;
   }
-  Assert(cell->IsLeafPageCell() == isLeaf_);
-  compare = key.Compare(cell.Key(), cell.KeySize());
-  if (compare <= 0) {
-    // key is not bigger than low bound, move to left child of first cell.
-    *pageNo = cell.LeftChild();
-    *location = (compare == 0) ? Equal : Left;
+
+  SetCellNumber(0);
+  SetContentStart(pageSize_);
+  freeSpace_ = pageSize_ - kCellPtrOffet;
+  prefixes_.clear();
+  intKeys_.clear();
+}
+
+PageNo MemPage::RightChild() const {
+  Assert(!isLeaf_);
+  return Get4Byte(&data_[headerOffset_ + kRightChildPageNoHeaderOffset]);
+}
+
+void MemPage::SetRightChild(PageNo no) {
+  Assert(!isLeaf_);
+  Put4Byte(&data_[headerOffset_ + kRightChildPageNoHeaderOffset], no);
+}
+
+PageNo MemPage::Sibling() const {
+  Assert(isLinked_);
+  return Get4Byte(&data_[headerOffset_ + kRightSiblingHeaderOffset]);
+}
+
+void MemPage::SetSibling(PageNo no) {
+  Assert(isLinked_);
+  Put4Byte(&data_[headerOffset_ + kRightSiblingHeaderOffset], no);
+}
+
+Code MemPage::ChildPageNo(int i, PageNo *no) const {
+  Assert(!isLeaf_ && i >= 0 && i <= cellNum_);
+  if (i == cellNum_) {
+    *no = RightChild();
     return kOk;
   }
-
-  // Compare with the upper cell of the page.
-  code = GetCell(cellNum_ - 1, &cell);
+  Cell cell;
+  Code code = GetCell(i, &cell);
   if (code != kOk) {
     return code;
   }
-  Assert(cell->IsLeafPageCell() == isLeaf_);
-  compare = key.Compare(cell.Key(), cell.KeySize());
-  if (compare == 0) {
-    // Equal to up bound, move to the left child of last cell.
-    *pageNo = cell.LeftChild();
-    *location = Equal;
-    *cellIndex = cellNum_ - 1;
-    return kOk;
+  *no = cell.LeftChild();
+  return kOk;
+}
+
+void MemPage::SetChildPageNo(int i, PageNo no) {
+  Assert(!isLeaf_ && i >= 0 && i <= cellNum_);
+  Assert(version_ == kDirtyVersion);
+  if (i == cellNum_) {
+    SetRightChild(no);
+    return;
   }
+  // The left child is the first field of an internal cell.
+  int offset = get2byte(&data_[kCellPtrOffet + 2 * i]);
+  Put4Byte(&data_[offset], no);
+}
 
-  if (compare > 0) {
-    // bigger than up bound, move to right child of the page.
-    *pageNo = Get4Byte(&data_[headerOffset_ + kRightChildPageNoHeaderOffset]);
-    *location = Right;
-    *cellIndex = cellNum_ - 1;
-    return kOk;
+void MemPage::SetCellOverflow(int i, PageNo no) {
+  Assert(isLeaf_ && version_ == kDirtyVersion);
+  Cell cell;
+  GetCell(i, &cell);
+  Assert(cell.Overflow() != kInvalidPageNo);
+  // The overflow page number ends the cell.
+  char *end = const_cast<char *>(cell.Payload()) + cell.LocalSize();
+  Put4Byte(end, no);
+}
+
+int MemPage::ContentStart() const {
+  int offset = get2byte(&data_[headerOffset_ + kCellContentHeaderOffset]);
+  return offset == 0 ? 65536 : offset;
+}
+
+void MemPage::SetContentStart(int offset) {
+  // 65536 is written as 0.
+  put2byte(&data_[headerOffset_ + kCellContentHeaderOffset], offset);
+}
+
+void MemPage::SetCellNumber(int cellNum) {
+  cellNum_ = cellNum;
+  put2byte(&data_[headerOffset_ + kCellNumberHeaderOffset], cellNum);
+}
+
+void MemPage::BuildSearchIndex() {
+  Cell cell;
+
+  if (isIntKeyPage_) {
+    // The keys are at a fixed place in the cells.
+    const char *cellPtrAry = &data_[kCellPtrOffet];
+    int keyOffset = isLeaf_ ? 0 : 4;
+    intKeys_.resize(cellNum_);
+    for (int i = 0; i < cellNum_; ++i) {
+      int offset = get2byte(&cellPtrAry[2 * i]);
+      intKeys_[i] = U64Key(&data_[offset + keyOffset]);
+    }
+    prefixes_.clear();
+    return;
+  }
+
+  intKeys_.clear();
+  prefixes_.resize(cellNum_);
+  for (int i = 0; i < cellNum_; ++i) {
+    GetCell(i, &cell);
+    prefixes_[i] = KeyPrefix(cell.Key(), cell.KeySize());
+  }
+}
+
+namespace {
+// The comparisons of a key to the cells of a page, one per kind of order.
+// Each returns the order of the key to the key of the cell.
+struct BytewiseCompare {
+  int operator()(const Cell &cell) const {
+    return suffix_.Compare(cell.Key(), cell.KeySize());
+  }
+  Slice suffix_; // The key after the prefix of the page.
+};
+
+// A single integer compare, instead of a memcmp of the bytes.
+struct U64Compare {
+  int operator()(const Cell &cell) const {
+    uint64_t key = U64Key(cell.Key());
+    return key_ < key ? -1 : key_ > key;
+  }
+  uint64_t key_;
+};
+
+struct ReverseCompare {
+  int operator()(const Cell &cell) const {
+    return -key_.Compare(cell.Key(), cell.KeySize());
+  }
+  Slice key_;
+};
+
+struct CustomCompare {
+  int operator()(const Cell &cell) const {
+    return comparator_->Compare(key_, Slice(cell.Key(), cell.KeySize()));
   }
+  Slice key_;
+  const Comparator *comparator_;
+};
+} // namespace
+
+// Search the key in the page.
+// If not reached the leaf page, return child page no in pageNo and kOk.
+// Return error otherwise.
+Code MemPage::Search(const Slice &key, const KeyOrder &order, PageNo *pageNo,
+                     CursorLocation *location, int *cellIndex) {
+  int compare;
+  Slice suffix;
+  int low, high;
 
-  // Now that the key is between (low, high)
+  *pageNo = kInvalidPageNo;
 
-  // Binary search for the key
-  int low = 0;
-  int high = cellNum_ - 1;
-  int mid;
+  switch (order.kind_) {
+  case kIntKeyOrder:
+    if (isIntKeyPage_) {
+      return SearchIntKey(U64Key(key.Data()), pageNo, location, cellIndex);
+    }
+    [[fallthrough]];
+  case kU64Order:
+    return SearchCells(U64Compare{U64Key(key.Data())}, 0, cellNum_ - 1,
+                       pageNo, location, cellIndex);
+  case kReverseOrder:
+    return SearchCells(ReverseCompare{key}, 0, cellNum_ - 1, pageNo,
+                       location, cellIndex);
+  case kCustomOrder:
+    return SearchCells(CustomCompare{key, order.comparator_}, 0,
+                       cellNum_ - 1, pageNo, location, cellIndex);
+  default:
+    break;
+  }
+
+  // The cells of a prefix page only store the keys after the prefix, a key
+  // without the prefix is before or after all of them.
+  compare = ComparePrefix(key, &suffix);
+  if (compare < 0) {
+    low = 0;
+    high = -1;
+  } else if (compare > 0) {
+    low = cellNum_;
+    high = cellNum_ - 1;
+  } else {
+    // Find the cells whose prefix equals the key prefix, the key is after
+    // all the cells before them and before all the cells after them.
+    uint32_t prefix = KeyPrefix(suffix.Data(), suffix.Size());
+    low = PrefixLowerBound(prefixes_.data(), cellNum_, prefix);
+    high = PrefixUpperBound(prefixes_.data(), cellNum_, prefix) - 1;
+  }
+  return SearchCells(BytewiseCompare{suffix}, low, high, pageNo, location,
+                     cellIndex);
+}
+
+template <class Compare>
+Code MemPage::SearchCells(const Compare &compare, int low, int high,
+                          PageNo *pageNo, CursorLocation *location,
+                          int *cellIndex) {
+  Cell cell;
+  Code code;
+  int probes = 0;
+
+  // Binary search for the key, low ends at the first cell not less than
+  // the key.
   while (low <= high) {
-    mid = (high + low) / 2;
+    int mid = (high + low) / 2;
+    ++probes;
     code = GetCell(mid, &cell);
     if (code != kOk) {
       return code;
     }
-    Assert(cell->IsLeafPageCell() == isLeaf_);
-    compare = key.Compare(cell.Key(), cell.KeySize());
-    if (compare == 0) {
+    Assert(cell.IsLeafPageCell() == isLeaf_);
+    int c = compare(cell);
+    if (c == 0) {
+      RecordTick(kSearchProbes, probes);
       *pageNo = cell.LeftChild();
       *location = Equal;
       *cellIndex = mid;
       return kOk;
-    } else if (compare < 0) {
+    } else if (c < 0) {
       high = mid - 1;
-      *location = Left;
     } else {
       low = mid + 1;
-      *location = Right;
     }
   }
+  RecordTick(kSearchProbes, probes);
 
-  *cellIndex = mid;
+  if (low == cellNum_) {
+    // bigger than up bound, move to right child of the page.
+    if (!isLeaf_) {
+      *pageNo = RightChild();
+    }
+    *location = cellNum_ > 0 ? Right : Left;
+    *cellIndex = cellNum_ > 0 ? cellNum_ - 1 : 0;
+    return kOk;
+  }
+
+  // The key is less than the cell at low, move to its left child.
+  if (!isLeaf_) {
+    code = GetCell(low, &cell);
+    if (code != kOk) {
+      return code;
+    }
+    *pageNo = cell.LeftChild();
+  }
+  *location = Left;
+  *cellIndex = low;
+  return kOk;
+}
+
+Code MemPage::SearchIntKey(uint64_t key, PageNo *pageNo,
+                           CursorLocation *location, int *cellIndex) {
+  // The keys of a page are distinct, the bound is the key if it is there.
+  int low = IntKeyLowerBound(intKeys_.data(), cellNum_, key);
+  if (!isLeaf_) {
+    Code code = ChildPageNo(low, pageNo);
+    if (code != kOk) {
+      return code;
+    }
+  }
+  if (low < cellNum_ && intKeys_[low] == key) {
+    *location = Equal;
+    *cellIndex = low;
+  } else if (low == cellNum_) {
+    *location = cellNum_ > 0 ? Right : Left;
+    *cellIndex = cellNum_ > 0 ? cellNum_ - 1 : 0;
+  } else {
+    *location = Left;
+    *cellIndex = low;
+  }
   return kOk;
 }
 
 Code MemPage::ReadPageHeader(char *data, PageNo pageNo) {
-  char flag;
+  const char known = kPageTypeMask | kPrefixPage | kIntKeyPage | kLinkedPage;
+  char flag, type;
 
   flag = data[headerOffset_ + kPageFlagHeaderOffset];
-  if (flag != kInternalPage && flag != kLeafPage) {
+  type = flag & kPageTypeMask;
+  if ((type != kInternalPage && type != kLeafPage) || (flag & ~known) != 0 ||
+      ((flag & kPrefixPage) != 0 && (flag & kIntKeyPage) != 0) ||
+      ((flag & kLinkedPage) != 0 && type != kLeafPage)) {
     return SaveErrorStatus(
-        Status(kCorrupt, FormatString("wrong page flag for page {}", pageNo)));
+        Status(kCorrupt, FormatString("wrong page flag for page %u", pageNo)));
   }
 
   cellNum_ = get2byte(&data[headerOffset_ + kCellNumberHeaderOffset]);
   if (cellNum_ < 0) {
     return SaveErrorStatus(Status(
-        kCorrupt, FormatString("wrong cell number for page {}", pageNo)));
+        kCorrupt, FormatString("wrong cell number for page %u", pageNo)));
   }
-  if (flag == kLeafPage) {
+  isLinked_ = (flag & kLinkedPage) != 0;
+  if (type == kLeafPage) {
     isLeaf_ = true;
-    headerSize_ = kLeafPageHeaderSize;
+    headerSize_ = isLinked_ ? kLinkedLeafPageHeaderSize : kLeafPageHeaderSize;
   } else {
     isLeaf_ = false;
     headerSize_ = kInternalPageHeaderSize;
   }
 
+  // The prefix follows the page header.
+  isPrefixPage_ = (flag & kPrefixPage) != 0;
+  isIntKeyPage_ = (flag & kIntKeyPage) != 0;
+  prefixSize_ = 0;
+  prefixAreaSize_ = 0;
+  prefix_ = &data[headerOffset_ + headerSize_ + 2];
+  if (isPrefixPage_) {
+    prefixSize_ = get2byte(&data[headerOffset_ + headerSize_]);
+    prefixAreaSize_ = 2 + prefixSize_;
+  }
+  if (kCellPtrOffet + 2 * cellNum_ > pageSize_) {
+    return SaveErrorStatus(Status(
+        kCorrupt, FormatString("wrong page header for page %u", pageNo)));
+  }
+
   return kOk;
 }
 
-Code MemPage::GetCell(int i, Cell *cell) {
+Code MemPage::GetCell(int i, Cell *cell) const {
   Assert(i >= 0 && i < cellNum_);
-  Assert(cell->IsInvalid());
-  unsigned char *cellPtrAry = &(data_[kCellPtrOffet]);
-  unsigned char *cellContent;
+  const char *cellPtrAry = &data_[kCellPtrOffet];
+  int offset = get2byte(&cellPtrAry[2 * i]);
 
-  return cell->ParseFrom(cellContent);
+  return cell->ParseFrom(&data_[offset], isLeaf_, pageSize_, prefix_,
+                         prefixSize_, isIntKeyPage_);
 }
 
-void MemPage::ParseCell(Cursor *cursor) {
-  int cellIndex = cursor->CellIndex();
+int MemPage::CompareCell(int i, const Slice &key,
+                         const KeyOrder &order) const {
+  Slice suffix;
+  Cell cell;
+
+  if (!order.IsBytewise()) {
+    GetCell(i, &cell);
+    return order.Compare(key, Slice(cell.Key(), cell.KeySize()));
+  }
+  int compare = ComparePrefix(key, &suffix);
+  if (compare != 0) {
+    return compare;
+  }
+  GetCell(i, &cell);
+  return suffix.Compare(cell.Key(), cell.KeySize());
+}
+
+int MemPage::ComparePrefix(const Slice &key, Slice *suffix) const {
+  if (prefixSize_ == 0) {
+    *suffix = key;
+    return 0;
+  }
+
+  size_t n = std::min<size_t>(key.Size(), prefixSize_);
+  int compare = memcmp(key.Data(), prefix_, n);
+  if (compare != 0) {
+    return compare;
+  }
+  if (key.Size() < prefixSize_) {
+    return -1;
+  }
+  *suffix = Slice(key.Data() + prefixSize_, key.Size() - prefixSize_);
+  return 0;
+}
+
+int MemPage::FreeSpace() const {
+  if (freeSpace_ < 0) {
+    // Count the bytes used, dropped cells leave holes the content start
+    // does not tell about.
+    int used = kCellPtrOffet + 2 * cellNum_;
+    Cell cell;
+    for (int i = 0; i < cellNum_; ++i) {
+      GetCell(i, &cell);
+      used += cell.CellSize();
+    }
+    freeSpace_ = pageSize_ - used;
+  }
+  return freeSpace_;
+}
+
+int MemPage::CellDataSize(const CellData &cell, int prefixSize) const {
+  int keySize = cell.key_.Size() - prefixSize;
+  // The key of an intkey page has a fixed size.
+  int keySizeLen = isIntKeyPage_ ? 0 : VarintLen(keySize);
+
+  if (isLeaf_) {
+    uint64_t valueSize = cell.value_.Size() + cell.overflowSize_;
+    return VarintLen(valueSize) + keySizeLen + keySize + cell.value_.Size() +
+           (cell.overflowSize_ > 0 ? 4 : 0);
+  }
+  return 4 + keySizeLen + keySize;
+}
+
+void MemPage::WriteCell(char *p, const CellData &cell, int prefixSize) const {
+  int keySize = cell.key_.Size() - prefixSize;
+
+  if (isIntKeyPage_) {
+    Assert(keySize == kU64KeySize);
+    if (isLeaf_) {
+      memcpy(p, cell.key_.Data(), kU64KeySize);
+      p += kU64KeySize;
+      p += PutVarint(p, cell.value_.Size() + cell.overflowSize_);
+    } else {
+      Put4Byte(p, cell.leftChild_);
+      memcpy(p + 4, cell.key_.Data(), kU64KeySize);
+      return;
+    }
+    memcpy(p, cell.value_.Data(), cell.value_.Size());
+    if (cell.overflowSize_ > 0) {
+      Put4Byte(p + cell.value_.Size(), cell.overflow_);
+    }
+    return;
+  }
 
+  if (isLeaf_) {
+    p += PutVarint(p, cell.value_.Size() + cell.overflowSize_);
+  } else {
+    Put4Byte(p, cell.leftChild_);
+    p += 4;
+  }
+  p += PutVarint(p, keySize);
+  memcpy(p, cell.key_.Data() + prefixSize, keySize);
+  if (isLeaf_) {
+    p += keySize;
+    memcpy(p, cell.value_.Data(), cell.value_.Size());
+    if (cell.overflowSize_ > 0) {
+      Put4Byte(p + cell.value_.Size(), cell.overflow_);
+    }
+  }
+}
+
+Code MemPage::InsertCell(int index, const CellData &cell) {
+  Assert(index >= 0 && index <= cellNum_);
+  Assert(version_ == kDirtyVersion);
+
+  std::vector<CellData> cells;
+  std::string keys;
+  Slice suffix;
+
+  // A key without the prefix, or no room after the last cell pointer.
+  // Rebuild the page with the new cell, which takes a shorter prefix or
+  // reclaims the space of dropped cells. A full prefix page may still
+  // take the cell with a longer prefix.
+  bool hasPrefix = ComparePrefix(cell.key_, &suffix) == 0;
+  int size = CellDataSize(cell, prefixSize_) + 2;
+  if (!hasPrefix || ContentStart() - (kCellPtrOffet + 2 * cellNum_) < size) {
+    if (hasPrefix && !isPrefixPage_ && FreeSpace() < size) {
+      return kPageFull;
+    }
+    GetCells(&cells, &keys);
+    cells.insert(cells.begin() + index, cell);
+    return Rebuild(cells);
+  }
+
+  int offset = ContentStart() - (size - 2);
+  WriteCell(&data_[offset], cell, prefixSize_);
+  SetContentStart(offset);
+
+  char *cellPtrAry = &data_[kCellPtrOffet];
+  memmove(&cellPtrAry[2 * (index + 1)], &cellPtrAry[2 * index],
+          2 * (cellNum_ - index));
+  put2byte(&cellPtrAry[2 * index], offset);
+  SetCellNumber(cellNum_ + 1);
+
+  if (freeSpace_ >= 0) {
+    freeSpace_ -= size;
+  }
+  if (isIntKeyPage_) {
+    intKeys_.insert(intKeys_.begin() + index, U64Key(cell.key_.Data()));
+  } else {
+    prefixes_.insert(prefixes_.begin() + index,
+                     KeyPrefix(suffix.Data(), suffix.Size()));
+  }
+  return kOk;
+}
+
+void MemPage::DropCell(int index) {
+  Assert(index >= 0 && index < cellNum_);
+  Assert(version_ == kDirtyVersion);
+
+  Cell cell;
+  char *cellPtrAry = &data_[kCellPtrOffet];
+  int offset = get2byte(&cellPtrAry[2 * index]);
+
+  GetCell(index, &cell);
+  if (offset == ContentStart()) {
+    SetContentStart(offset + cell.CellSize());
+  }
+  if (freeSpace_ >= 0) {
+    freeSpace_ += cell.CellSize() + 2;
+  }
+
+  memmove(&cellPtrAry[2 * index], &cellPtrAry[2 * (index + 1)],
+          2 * (cellNum_ - index - 1));
+  SetCellNumber(cellNum_ - 1);
+  if (isIntKeyPage_) {
+    intKeys_.erase(intKeys_.begin() + index);
+  } else {
+    prefixes_.erase(prefixes_.begin() + index);
+  }
+}
+
+void MemPage::GetCells(std::vector<CellData> *cells, std::string *keys) const {
+  Cell cell;
+
+  cells->clear();
+  cells->reserve(cellNum_);
+  if (prefixSize_ > 0) {
+    // Reserve all at once, the slices point into keys.
+    keys->clear();
+    keys->reserve(static_cast<size_t>(cellNum_) * prefixSize_ + pageSize_);
+  }
+
+  for (int i = 0; i < cellNum_; ++i) {
+    GetCell(i, &cell);
+    Slice key(cell.Key(), cell.KeySize());
+    if (prefixSize_ > 0) {
+      size_t start = keys->size();
+      cell.AppendKey(keys);
+      key = Slice(keys->data() + start, cell.FullKeySize());
+    }
+    cells->push_back(CellData{key, Slice(cell.Payload(), cell.LocalSize()),
+                              cell.LeftChild(), cell.Overflow(),
+                              cell.PayloadSize() - cell.LocalSize()});
+  }
+}
+
+int MemPage::CommonPrefix(std::span<const CellData> cells) const {
+  int prefixSize = 0;
+
+  // The keys are sorted, so the common prefix of the first and the last
+  // key is the common prefix of all.
+  if (isPrefixPage_ && cells.size() >= 2) {
+    const Slice &first = cells.front().key_;
+    const Slice &last = cells.back().key_;
+    size_t n = std::min(first.Size(), last.Size());
+    while (prefixSize < static_cast<int>(n) &&
+           first[prefixSize] == last[prefixSize]) {
+      ++prefixSize;
+    }
+  }
+  return prefixSize;
+}
+
+int MemPage::SpaceNeeded(std::span<const CellData> cells) const {
+  int prefixSize = CommonPrefix(cells);
+  int used = headerSize_ + (isPrefixPage_ ? 2 + prefixSize : 0) +
+             2 * static_cast<int>(cells.size());
+  for (const CellData &cell : cells) {
+    used += CellDataSize(cell, prefixSize);
+  }
+  return used;
+}
+
+Code MemPage::Rebuild(std::span<const CellData> cells) {
+  Assert(version_ == kDirtyVersion);
+
+  int num = static_cast<int>(cells.size());
+  int prefixSize = CommonPrefix(cells);
+  int areaSize = isPrefixPage_ ? 2 + prefixSize : 0;
+  int used = headerOffset_ + SpaceNeeded(cells);
+  if (used > pageSize_) {
+    return kPageFull;
+  }
+
+  // The cells may point into the page, build the image aside.
+  std::vector<char> image(pageSize_);
+  memcpy(image.data(), data_, headerOffset_ + headerSize_);
+  char *header = &image[headerOffset_];
+  if (isPrefixPage_) {
+    put2byte(&header[headerSize_], prefixSize);
+    if (prefixSize > 0) {
+      memcpy(&header[headerSize_ + 2], cells.front().key_.Data(), prefixSize);
+    }
+  }
+
+  char *cellPtrAry = &header[headerSize_ + areaSize];
+  int offset = pageSize_;
+  for (int i = 0; i < num; ++i) {
+    offset -= CellDataSize(cells[i], prefixSize);
+    WriteCell(&image[offset], cells[i], prefixSize);
+    put2byte(&cellPtrAry[2 * i], offset);
+  }
+  put2byte(&header[kFirstFreeblockHeaderOffset], 0);
+  put2byte(&header[kCellNumberHeaderOffset], num);
+  put2byte(&header[kCellContentHeaderOffset], offset);
+  header[kFragmentedBytesHeaderOffset] = 0;
+  memcpy(&data_[headerOffset_], header, pageSize_ - headerOffset_);
+
+  cellNum_ = num;
+  prefixSize_ = prefixSize;
+  prefixAreaSize_ = isPrefixPage_ ? 2 + prefixSize : 0;
+  prefix_ = &data_[headerOffset_ + headerSize_ + 2];
+  freeSpace_ = pageSize_ - used;
+  BuildSearchIndex();
+  return kOk;
+}
+
+void MemPage::ParseCell(Cursor *cursor) {
   // Do some sanity checking.
   Assert(cursor->isValid());
-  Assert(cellIndex >= 0 && cellIndex < cellNum_);
+  Assert(cursor->CellIndex() >= 0 && cursor->CellIndex() < cellNum_);
 
   if (isLeaf_) {
     ParseLeafPageCell(cursor);
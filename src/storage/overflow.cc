@@ -0,0 +1,192 @@
+#include "storage/overflow.h"
+#include "buffer/buffer_manager.h"
+#include "buffer/mem_page.h"
+#include "common/debug.h"
+#include "common/string.h"
+#include "storage/cursor.h"
+#include "storage/page_layout.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace udb {
+// Overflow pages hinted at a time while streaming a value.
+static const int kOverflowReadahead = 64;
+
+Code FreeOverflow(PageNo first, uint64_t size, uint64_t snapshot) {
+  uint64_t chunk = Pager->PageSize() - kOverflowHeaderSize;
+  uint64_t n = (size + chunk - 1) / chunk;
+  PageNo no = first;
+
+  for (uint64_t i = 0; i < n; ++i) {
+    MemPage *page;
+    if (no <= 1 || no > Pager->PageCount() || Pager->IsFreePage(no)) {
+      return SaveErrorStatus(Status(
+          kCorrupt, FormatString("invalid overflow page %u", no)));
+    }
+    Code code = Pager->GetOverflowPage(no, snapshot, &page);
+    if (code != kOk) {
+      return code;
+    }
+    PageNo next = page->NextOverflow();
+    Pager->ReleasePage(page);
+    Pager->FreePage(no, snapshot);
+    no = next;
+  }
+  return kOk;
+}
+
+OverflowWriter::OverflowWriter(uint64_t snapshot)
+    : snapshot_(snapshot), batchPages_(std::max(Pager->FrameNumber() / 4, 1)) {}
+
+OverflowWriter::~OverflowWriter() {
+  for (MemPage *page : pages_) {
+    Pager->ReleasePage(page);
+  }
+}
+
+Code OverflowWriter::Write(const Slice &data, PageNo *first) {
+  size_t chunk = Pager->PageSize() - kOverflowHeaderSize;
+  int n = (data.Size() + chunk - 1) / chunk;
+  PageNo no = kInvalidPageNo;
+  int run = 0;
+  MemPage *prev = nullptr;
+  Code code;
+
+  for (int i = 0; i < n; ++i, ++no, --run) {
+    MemPage *page;
+    if (run == 0) {
+      no = Pager->AllocatePartialRun(n - i, snapshot_, &run);
+    }
+    code = Pager->NewOverflowPage(no, &page);
+    if (code != kOk) {
+      return code;
+    }
+    if (i == 0) {
+      *first = no;
+    }
+    if (prev) {
+      prev->SetNextOverflow(page->MemPageNo());
+    }
+    pages_.push_back(page);
+
+    size_t offset = i * chunk;
+    size_t size = std::min(chunk, data.Size() - offset);
+    memcpy(page->Data() + kOverflowHeaderSize, data.Data() + offset, size);
+    prev = page;
+
+    if (static_cast<int>(pages_.size()) > batchPages_) {
+      code = Flush(pages_.size() - 1);
+      if (code != kOk) {
+        return code;
+      }
+    }
+  }
+  return kOk;
+}
+
+Code OverflowWriter::Flush() { return Flush(pages_.size()); }
+
+Code OverflowWriter::Flush(size_t n) {
+  uint64_t lsn;
+
+  if (n == 0) {
+    return kOk;
+  }
+  std::vector<MemPage *> pages(pages_.begin(), pages_.begin() + n);
+  Code code = Pager->CommitPages(pages, &lsn);
+  for (MemPage *page : pages) {
+    Pager->ReleasePage(page);
+  }
+  pages_.erase(pages_.begin(), pages_.begin() + n);
+  if (code != kOk) {
+    return code;
+  }
+  return Pager->Sync(lsn);
+}
+
+ValueStream::ValueStream(uint64_t snapshot)
+    : snapshot_(snapshot), page_(nullptr), localRead_(false),
+      next_(kInvalidPageNo), hinted_(kInvalidPageNo), size_(0), remain_(0) {}
+
+ValueStream::~ValueStream() { Release(); }
+
+void ValueStream::Release() {
+  if (page_) {
+    Pager->ReleasePage(page_);
+    page_ = nullptr;
+  }
+}
+
+Code ValueStream::Open(Cursor *cursor) {
+  Assert(cursor->Location() == Equal);
+
+  // Copy the local bytes, a write of the transaction may rebuild the leaf
+  // while the stream is open.
+  cursor->GetCell();
+  Cell *cell = cursor->MutCell();
+  local_.assign(cell->Payload(), cell->LocalSize());
+  localRead_ = false;
+  next_ = cell->Overflow();
+  hinted_ = next_;
+  size_ = cell->PayloadSize();
+  remain_ = size_;
+  return kOk;
+}
+
+Status ValueStream::Next(Slice *chunk) {
+  if (NextChunk(chunk) != kOk) {
+    return GetErrorStatus();
+  }
+  return Status();
+}
+
+Code ValueStream::NextChunk(Slice *chunk) {
+  if (!localRead_) {
+    localRead_ = true;
+    if (!local_.empty()) {
+      *chunk = Slice(local_.data(), local_.size());
+      remain_ -= local_.size();
+      return kOk;
+    }
+  }
+  if (remain_ == 0) {
+    Release();
+    *chunk = Slice();
+    return kOk;
+  }
+  // Not bounded by the page count, a reader still sees the pages a vacuum
+  // has cut off after its snapshot.
+  if (next_ == kInvalidPageNo) {
+    return SaveErrorStatus(Status(
+        kCorrupt, FormatString("overflow chain ends at page %u with %llu "
+                               "bytes of the value left",
+                               next_, (unsigned long long)remain_)));
+  }
+
+  // The chain was allocated in a row, so hint the pages after this one
+  // as if they were contiguous.
+  size_t size = Pager->PageSize() - kOverflowHeaderSize;
+  if (next_ >= hinted_) {
+    PageNo pages[kOverflowReadahead];
+    uint64_t left = (remain_ + size - 1) / size;
+    int n = static_cast<int>(std::min<uint64_t>(left, kOverflowReadahead));
+    for (int i = 0; i < n; ++i) {
+      pages[i] = next_ + i;
+    }
+    Pager->Hint(pages, n, snapshot_);
+    hinted_ = next_ + n;
+  }
+
+  Release();
+  Code code = Pager->GetOverflowPage(next_, snapshot_, &page_);
+  if (code != kOk) {
+    return code;
+  }
+  size = std::min<uint64_t>(size, remain_);
+  *chunk = Slice(page_->Data() + kOverflowHeaderSize, size);
+  remain_ -= size;
+  next_ = page_->NextOverflow();
+  return kOk;
+}
+} // namespace udb
@@ -0,0 +1,239 @@
+#include "storage/parallel_scan.h"
+#include "buffer/buffer_manager.h"
+#include "buffer/mem_page.h"
+#include "storage/btree.h"
+#include "storage/cell.h"
+#include "storage/cursor.h"
+#include "storage/txn_impl.h"
+
+#include <thread>
+
+namespace udb {
+// Parts queued for each thread at the start, so that threads finishing
+// early have parts to steal before any is cut.
+static const int kPartsPerThread = 4;
+
+// Entries scanned between two looks at the waiting workers.
+static const int kCutInterval = 256;
+
+// The index of the child of the internal page the key descends to.
+static Code ChildIndex(MemPage *page, const Slice &key, const KeyOrder &order,
+                       int *index) {
+  PageNo child;
+  CursorLocation location;
+  Code code = page->Search(key, order, &child, &location, index);
+  if (code == kOk && (location == Right || page->CellNumber() == 0)) {
+    *index = page->CellNumber();
+  }
+  return code;
+}
+
+ParallelScanner::ParallelScanner(TxnImpl *txn, BTree *tree,
+                                 const ScanCallback &callback)
+    : txn_(txn), tree_(tree), callback_(callback), queued_(0), busy_(0),
+      stop_(false), idle_(0) {}
+
+Status ParallelScanner::Run(const Slice &start, const Slice &end,
+                            int threads) {
+  std::vector<std::string> keys;
+  if (Cut(start, end, threads * kPartsPerThread, &keys) != kOk) {
+    return GetErrorStatus();
+  }
+
+  // Each thread starts with neighbouring parts.
+  int parts = keys.size() + 1;
+  queues_.resize(threads);
+  for (int i = 0; i < parts; ++i) {
+    Part part{i == 0 ? start.String() : keys[i - 1],
+              i + 1 == parts ? end.String() : keys[i]};
+    queues_[static_cast<int64_t>(i) * threads / parts].push_back(part);
+  }
+  queued_ = parts;
+
+  std::vector<std::thread> workers;
+  for (int i = 1; i < threads; ++i) {
+    workers.emplace_back([this, i] { Work(i); });
+  }
+  Work(0);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  return status_;
+}
+
+Code ParallelScanner::Cut(const Slice &start, const Slice &end, int parts,
+                          std::vector<std::string> *keys) const {
+  uint64_t snapshot = txn_->Snapshot();
+  const KeyOrder &order = tree_->Order();
+  std::vector<PageNo> pages{tree_->Root()};
+  std::vector<std::string> separators;
+  Code code;
+
+  // Go down a level while the range has too few separators, the pages of
+  // a level in the range are at most as many as the parts then. The
+  // separators of a level are those of its pages, with the ones of the
+  // level above between the pages.
+  while (static_cast<int>(separators.size()) < parts - 1) {
+    std::vector<PageNo> children;
+    std::vector<std::string> next;
+    bool leaves = false;
+
+    for (size_t i = 0; i < pages.size() && !leaves; ++i) {
+      MemPage *page;
+      code = Pager->GetPage(pages[i], snapshot, &page);
+      if (code != kOk) {
+        return code;
+      }
+      leaves = page->IsLeaf();
+      int first = 0;
+      int last = leaves ? -1 : page->CellNumber();
+      if (!leaves && !start.Empty()) {
+        code = ChildIndex(page, start, order, &first);
+      }
+      if (code == kOk && !leaves && !end.Empty()) {
+        code = ChildIndex(page, end, order, &last);
+      }
+      for (int j = first; j <= last && code == kOk; ++j) {
+        PageNo child;
+        code = page->ChildPageNo(j, &child);
+        children.push_back(child);
+        if (code == kOk && j < last) {
+          Cell cell;
+          code = page->GetCell(j, &cell);
+          next.emplace_back();
+          cell.AppendKey(&next.back());
+        }
+      }
+      Pager->ReleasePage(page);
+      if (code != kOk) {
+        return code;
+      }
+      if (i + 1 < pages.size()) {
+        next.push_back(separators[i]);
+      }
+    }
+    if (leaves || children.empty()) {
+      break;
+    }
+    pages.swap(children);
+    separators.swap(next);
+  }
+
+  // The separators next to the ends may be out of the range.
+  std::vector<std::string> inside;
+  for (std::string &key : separators) {
+    if ((start.Empty() || order.Compare(key, start) > 0) &&
+        (end.Empty() || order.Compare(key, end) < 0)) {
+      inside.push_back(std::move(key));
+    }
+  }
+
+  // Take every n-th separator, the subtrees between them have about the
+  // same number of leaves.
+  keys->clear();
+  int n = inside.size();
+  if (n < parts) {
+    keys->swap(inside);
+    return kOk;
+  }
+  for (int i = 1; i < parts; ++i) {
+    keys->push_back(std::move(inside[static_cast<int64_t>(i) * n / parts]));
+  }
+  return kOk;
+}
+
+void ParallelScanner::Work(int worker) {
+  Cursor cursor(txn_);
+  Part part;
+
+  while (Take(worker, &part)) {
+    Code code = Scan(worker, &cursor, &part);
+    cursor.Reset();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (code != kOk && status_.Ok()) {
+      status_ = GetErrorStatus();
+      stop_ = true;
+    }
+    if (--busy_ == 0 && queued_ == 0) {
+      wake_.notify_all();
+    } else if (stop_) {
+      wake_.notify_all();
+    }
+  }
+}
+
+bool ParallelScanner::Take(int worker, Part *part) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  int n = queues_.size();
+
+  while (!stop_) {
+    if (queued_ > 0) {
+      // The own queue from the front, the others from the back, so that
+      // a thread goes on with the keys next to the ones it scanned.
+      std::deque<Part> *queue = &queues_[worker];
+      bool own = !queue->empty();
+      for (int i = 1; i < n && queue->empty(); ++i) {
+        queue = &queues_[(worker + i) % n];
+      }
+      *part = std::move(own ? queue->front() : queue->back());
+      if (own) {
+        queue->pop_front();
+      } else {
+        queue->pop_back();
+      }
+      --queued_;
+      ++busy_;
+      return true;
+    }
+    if (busy_ == 0) {
+      return false;
+    }
+    ++idle_;
+    wake_.wait(lock);
+    --idle_;
+  }
+  return false;
+}
+
+void ParallelScanner::Queue(int worker, Part part) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  queues_[worker].push_back(std::move(part));
+  ++queued_;
+  wake_.notify_one();
+}
+
+Code ParallelScanner::Scan(int worker, Cursor *cursor, Part *part) {
+  Slice end(part->end_);
+  bool cuttable = true;
+  int count = 0;
+
+  auto visit = [&](const Slice &key, const Slice &value) {
+    if (stop_.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    if (!callback_(key, value)) {
+      stop_ = true;
+      wake_.notify_all();
+      return false;
+    }
+
+    // Queue the second half of the rest for a waiting worker.
+    if (++count % kCutInterval != 0 || !cuttable ||
+        idle_.load(std::memory_order_relaxed) == 0) {
+      return true;
+    }
+    std::vector<std::string> keys;
+    if (Cut(key, end, 2, &keys) != kOk || keys.empty()) {
+      // The rest is in a leaf or two, or a page could not be read.
+      cuttable = false;
+      return true;
+    }
+    Queue(worker, Part{keys[0], part->end_});
+    part->end_ = std::move(keys[0]);
+    end = Slice(part->end_);
+    return true;
+  };
+  return txn_->ScanRange(cursor, tree_, part->start_, end, visit);
+}
+} // namespace udb
@@ -1,67 +1,621 @@
 #include "storage/txn_impl.h"
+#include "buffer/buffer_manager.h"
 #include "buffer/mem_page.h"
+#include "common/string.h"
+#include "storage/balance.h"
+#include "storage/btree.h"
+#include "storage/bulk_loader.h"
+#include "storage/catalog.h"
 #include "storage/cursor.h"
+#include "storage/hash_index.h"
+#include "storage/overflow.h"
+#include "storage/parallel_scan.h"
+#include "storage/vacuum.h"
+
+#include <algorithm>
+#include <string.h>
 
 namespace udb {
-TxnImpl::TxnImpl(bool write, int lockIndex)
-    : write_(write), lockIndex_(lockIndex), cursor_(new Cursor(this)) {}
+// Ended transactions kept by each thread for its next ones.
+static const size_t kTxnPoolSize = 16;
+
+namespace {
+struct TxnPool {
+  ~TxnPool() {
+    for (TxnImpl *txn : txns_) {
+      delete txn;
+    }
+  }
+  std::vector<TxnImpl *> txns_;
+};
+} // namespace
+
+static thread_local TxnPool gTxnPool;
+
+TxnImpl::TxnImpl(bool write, int lockIndex, uint64_t snapshot)
+    : write_(write), lockIndex_(lockIndex), snapshot_(snapshot),
+      cursor_(new Cursor(this)) {}
 
 TxnImpl::~TxnImpl() { delete cursor_; }
 
-Status TxnImpl::OpenTree(const std::string &name, BTree **,
-                         bool createIfNotExists) {
-  Status status;
+TxnImpl *TxnImpl::New(bool write, int lockIndex, uint64_t snapshot) {
+  std::vector<TxnImpl *> &txns = gTxnPool.txns_;
+  if (txns.empty()) {
+    return new TxnImpl(write, lockIndex, snapshot);
+  }
+  TxnImpl *txn = txns.back();
+  txns.pop_back();
+  txn->write_ = write;
+  txn->lockIndex_ = lockIndex;
+  txn->snapshot_ = snapshot;
+  txn->error_ = Status();
+  txn->reads_.clear();
+  txn->created_.clear();
+  txn->deleted_.clear();
+  return txn;
+}
+
+void TxnImpl::Free(TxnImpl *txn) {
+  std::vector<TxnImpl *> &txns = gTxnPool.txns_;
+  txn->End();
+  if (txns.size() >= kTxnPoolSize) {
+    delete txn;
+    return;
+  }
+  txns.push_back(txn);
+}
+
+void TxnImpl::End() {
+  cursor_->Reset();
+  arena_.Reset();
+}
+
+void TxnImpl::RecordRead(MemPage *page) {
+  if (!write_ || page == nullptr || page->Version() == kDirtyVersion) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(readsMutex_);
+  reads_.emplace(page->MemPageNo(), page->Version());
+}
+
+void TxnImpl::RolledBack() {
+  for (auto &tree : created_) {
+    DBInstance->DeleteTree(tree.first, tree.second);
+  }
+  for (auto &tree : deleted_) {
+    DBInstance->RestoreTree(tree.first, tree.second);
+  }
+  created_.clear();
+  deleted_.clear();
+}
+
+Status TxnImpl::Fail(const Status &status) {
+  error_ = status;
   return status;
-};
+}
+
+Status TxnImpl::OpenTree(const std::string &name, const TreeOptions &options,
+                         BTree **tree, bool createIfNotExists) {
+  const Comparator *comparator = options.comparator_;
+  TreeInfo info;
+
+  *tree = nullptr;
+  if (name.empty() || name.size() > kMaxTreeNameSize) {
+    return Status(kInvalidArgument, "tree name must be 1 to 64 bytes");
+  }
+  if (comparator && strlen(comparator->Name()) > kMaxTreeNameSize) {
+    return Status(kInvalidArgument, "comparator name over 64 bytes");
+  }
+  if (options.intKey_ && comparator && comparator != U64Comparator()) {
+    return Status(kInvalidArgument, "intkey tree with a comparator");
+  }
+
+  Catalog catalog(this);
+  Code code = catalog.Find(name, &info);
+  if (code == kNotFound) {
+    if (!createIfNotExists) {
+      return Status(kNotFound,
+                    FormatString("tree %s not found", name.c_str()));
+    }
+    if (!write_) {
+      return Status(kReadOnly, "create a tree in a read transaction");
+    }
+    KeyOrder order = KeyOrder::Of(options.intKey_ ? U64Comparator()
+                                                  : comparator);
+    info.order_ = options.intKey_ ? kIntKeyOrder : order.kind_;
+    info.comparator_ = order.comparator_->Name();
+    if (!error_.Ok()) {
+      return error_;
+    }
+    bool created;
+    code = catalog.Create(name, &info, &created);
+    if (code != kOk) {
+      return Fail(GetErrorStatus());
+    }
+    if (created) {
+      created_.emplace_back(name, info.root_);
+    }
+  }
+  if (code != kOk) {
+    return GetErrorStatus();
+  }
+
+  // The keys are already in the order the tree was created with.
+  if (comparator == nullptr) {
+    comparator = KeyOrder::Builtin(info.order_);
+  }
+  if (comparator == nullptr || info.comparator_ != comparator->Name()) {
+    return Status(kInvalidArgument,
+                  FormatString("tree %s needs the comparator %s",
+                               name.c_str(), info.comparator_.c_str()));
+  }
+  KeyOrder order = KeyOrder::Of(comparator);
+  if (info.order_ == kIntKeyOrder) {
+    order.kind_ = kIntKeyOrder;
+  }
+  *tree = DBInstance->Tree(name, info.root_, order);
+  return Status();
+}
 
 Status TxnImpl::DeleteTree(const std::string &name) {
-  Status status;
-  return status;
+  TreeInfo info;
+
+  if (!write_) {
+    return Status(kReadOnly, "delete a tree in a read transaction");
+  }
+  if (!error_.Ok()) {
+    return error_;
+  }
+
+  // The pages of the tree are freed, do not keep any pinned.
+  cursor_->Reset();
+  if (DBInstance->RunAlone() != kOk) {
+    return GetErrorStatus();
+  }
+  Catalog catalog(this);
+  Code code = catalog.Remove(name, &info);
+  if (code == kNotFound) {
+    return Status(kNotFound, FormatString("tree %s not found", name.c_str()));
+  }
+  if (code != kOk) {
+    return Fail(GetErrorStatus());
+  }
+  DBInstance->DeleteTree(name, info.root_);
+  deleted_.emplace_back(name, info.root_);
+  return Status();
+}
+
+BTree *TxnImpl::Tree(BTree *tree) const {
+  return tree ? tree : DBInstance->DefaultTree();
 }
 
 Status TxnImpl::Write(BTree *tree, const Slice &key, const Slice &value) {
-  CursorLocation location;
   Code code;
-  MemPage *page = nullptr;
-  int cellSize = 0;
+
+  if (!write_) {
+    return Status(kReadOnly, "write in a read transaction");
+  }
+  if (!error_.Ok()) {
+    return error_;
+  }
+  tree = Tree(tree);
+  if (tree->CheckKey(key) != kOk) {
+    return GetErrorStatus();
+  }
+  if (tree->Hash()) {
+    tree->Hash()->RecordWrite();
+  }
+
+  // Spill the value beyond its local bytes to a new overflow chain, the
+  // cell only keeps the head of the value and the first page.
+  CellData data{key, value, kInvalidPageNo};
+  OverflowWriter overflow(snapshot_);
+  uint64_t local = LocalValueSize(Pager->PageSize(), key.Size(), value.Size());
+  if (local < value.Size()) {
+    code = overflow.Write(Slice(value.Data() + local, value.Size() - local),
+                          &data.overflow_);
+    if (code != kOk) {
+      return Fail(GetErrorStatus());
+    }
+    data.value_ = Slice(value.Data(), local);
+    data.overflowSize_ = value.Size() - local;
+  }
+
+  // A split may find a parent committed by another writer meanwhile, the
+  // key is looked up again then.
+  do {
+    code = MoveToWrite(tree, key);
+    if (code == kOk) {
+      code = Put(data);
+    }
+  } while (code == kConflict);
+
+  if (code == kPageFull) {
+    return Fail(Status(kPageFull, "the entry is too large for a page"));
+  }
+  if (code != kOk) {
+    return Fail(GetErrorStatus());
+  }
+  return Status();
+}
+
+Status TxnImpl::Delete(BTree *tree, const Slice &key) {
+  Code code;
+
+  if (!write_) {
+    return Status(kReadOnly, "delete in a read transaction");
+  }
+  if (!error_.Ok()) {
+    return error_;
+  }
+  tree = Tree(tree);
+  if (tree->CheckKey(key) != kOk) {
+    return GetErrorStatus();
+  }
+  if (tree->Hash()) {
+    tree->Hash()->RecordWrite();
+  }
 
   code = cursor_->MoveTo(tree, key);
+  if (code != kOk) {
+    return Fail(GetErrorStatus());
+  }
+  if (cursor_->Location() != Equal) {
+    return Status();
+  }
+  code = cursor_->MarkDirty();
+  if (code == kConflict) {
+    // Locate the key again in the latest version of the page.
+    code = MoveToWrite(tree, key);
+    if (code == kOk && cursor_->Location() != Equal) {
+      return Status();
+    }
+  }
+  if (code != kOk) {
+    return Fail(GetErrorStatus());
+  }
+  cursor_->GetCell();
+  Cell *cell = cursor_->MutCell();
+  PageNo overflow = cell->Overflow();
+  uint64_t overflowSize = cell->PayloadSize() - cell->LocalSize();
+  cursor_->Page()->DropCell(cursor_->CellIndex());
+  if (overflow != kInvalidPageNo &&
+      FreeOverflow(overflow, overflowSize, snapshot_) != kOk) {
+    return Fail(GetErrorStatus());
+  }
+  Balancer balancer(this, cursor_);
+  if (balancer.Underflow() != kOk) {
+    return Fail(GetErrorStatus());
+  }
+  return Status();
+}
+
+Status TxnImpl::Get(BTree *tree, const Slice &key, Slice *value) {
+  tree = Tree(tree);
+  Code code = tree->CheckKey(key);
+  if (code == kOk) {
+    code = cursor_->MoveToHashed(tree, key);
+  }
   if (code != kOk) {
     return GetErrorStatus();
   }
-  Assert(cursor_->IsValid());
-  location = cursor_->Location();
+  return ReadValue(value);
+}
+
+Status TxnImpl::GetStream(BTree *tree, const Slice &key,
+                          ValueReader **reader) {
+  tree = Tree(tree);
+  Code code = tree->CheckKey(key);
+  if (code == kOk) {
+    code = cursor_->MoveTo(tree, key);
+  }
+  if (code != kOk) {
+    return GetErrorStatus();
+  }
+  RecordRead(cursor_->Page());
+  if (cursor_->Location() != Equal) {
+    return Status(kNotFound, "key not found");
+  }
+  ValueStream *stream = new ValueStream(snapshot_);
+  if (stream->Open(cursor_) != kOk) {
+    delete stream;
+    return GetErrorStatus();
+  }
+  *reader = stream;
+  return Status();
+}
+
+void TxnImpl::MultiGet(BTree *tree, std::span<const Slice> keys,
+                       std::vector<Slice> *values,
+                       std::vector<Status> *statuses) {
+  size_t n = keys.size();
+  std::vector<size_t> order(n);
+  std::vector<Slice> sorted(n);
+  size_t prefetched = 0;
+
+  values->assign(n, Slice());
+  statuses->assign(n, Status());
+  tree = Tree(tree);
+
+  // Keys not fitting the tree are left out of the walk.
+  size_t valid = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (tree->CheckKey(keys[i]) == kOk) {
+      order[valid++] = i;
+    } else {
+      (*statuses)[i] = GetErrorStatus();
+    }
+  }
+  n = valid;
+  order.resize(n);
+  sorted.resize(n);
+
+  const KeyOrder &keyOrder = tree->Order();
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return keyOrder.Compare(keys[a], keys[b]) < 0;
+  });
+  for (size_t i = 0; i < n; ++i) {
+    sorted[i] = keys[order[i]];
+  }
+
+  // Start from the root, the cursor may be anywhere in the tree.
+  cursor_->Reset();
+  for (size_t i = 0; i < n; ++i) {
+    size_t k = order[i];
+    Code code = cursor_->MoveNear(tree, sorted[i]);
+    if (code != kOk) {
+      (*statuses)[k] = GetErrorStatus();
+      cursor_->Reset();
+      continue;
+    }
+
+    // Once at a new parent, hint the leaves of the next keys under it so
+    // they are read while this one is served.
+    if (i >= prefetched) {
+      std::span<const Slice> next(sorted.data() + i + 1, n - i - 1);
+      prefetched = i + 1 + cursor_->PrefetchLeaves(next);
+    }
+    (*statuses)[k] = ReadValue(&(*values)[k]);
+  }
+}
+
+Status TxnImpl::Scan(BTree *tree, const Slice &start, const Slice &end,
+                     const ScanCallback &callback) {
+  tree = Tree(tree);
+  if (CheckRange(tree, start, end) != kOk ||
+      ScanRange(cursor_, tree, start, end, callback) != kOk) {
+    return GetErrorStatus();
+  }
+  return Status();
+}
+
+Status TxnImpl::ParallelScan(BTree *tree, const Slice &start,
+                             const Slice &end, int threads,
+                             const ScanCallback &callback) {
+  if (threads <= 0) {
+    return Status(kInvalidArgument, "parallel scan with no threads");
+  }
+  tree = Tree(tree);
+  if (CheckRange(tree, start, end) != kOk) {
+    return GetErrorStatus();
+  }
+  ParallelScanner scanner(this, tree, callback);
+  return scanner.Run(start, end, threads);
+}
+
+Code TxnImpl::CheckRange(BTree *tree, const Slice &start,
+                         const Slice &end) const {
+  Code code = kOk;
+  if (!start.Empty()) {
+    code = tree->CheckKey(start);
+  }
+  if (code == kOk && !end.Empty()) {
+    code = tree->CheckKey(end);
+  }
+  return code;
+}
+
+Code TxnImpl::ScanRange(Cursor *cursor, BTree *tree, const Slice &start,
+                        const Slice &end, const ScanCallback &callback) {
+  std::string key;
+  std::string value;
+  Code code;
+
+  // A writer records each leaf it goes through, see RecordRead.
+  code = start.Empty() ? cursor->SeekToFirst(tree) : cursor->Seek(tree, start);
+  MemPage *leaf = cursor->Page();
+  RecordRead(leaf);
+  while (code == kOk) {
+    if (cursor->Page() != leaf) {
+      leaf = cursor->Page();
+      RecordRead(leaf);
+    }
+    cursor->GetCell();
+    Cell *cell = cursor->MutCell();
+
+    // A writer keeps the key to find its place again after a conflict.
+    Slice k(cell->Key(), cell->KeySize());
+    if (write_ || cell->PrefixSize() > 0) {
+      key.clear();
+      cell->AppendKey(&key);
+      k = Slice(key);
+    }
+    if (!end.Empty() && tree->Order().Compare(k, end) >= 0) {
+      break;
+    }
+
+    Slice v(cell->Payload(), cell->PayloadSize());
+    if (cell->Overflow() != kInvalidPageNo) {
+      ValueStream stream(snapshot_);
+      Slice chunk;
+      value.clear();
+      code = stream.Open(cursor);
+      while (code == kOk && (code = stream.NextChunk(&chunk)) == kOk &&
+             !chunk.Empty()) {
+        value.append(chunk.Data(), chunk.Size());
+      }
+      if (code != kOk) {
+        break;
+      }
+      v = Slice(value);
+    }
+    if (!callback(k, v)) {
+      break;
+    }
+
+    // Another writer may commit a page on the way, go on after the key.
+    code = cursor->Next();
+    while (code == kConflict) {
+      code = cursor->MoveTo(tree, key);
+      if (code == kOk) {
+        code = cursor->Next();
+      }
+    }
+  }
+  return code == kNotFound ? kOk : code;
+}
+
+Status TxnImpl::BulkLoad(BTree *tree, KVIterator *iter, int fillPercent) {
+  if (!write_) {
+    return Status(kReadOnly, "bulk load in a read transaction");
+  }
+  if (!error_.Ok()) {
+    return error_;
+  }
+  if (fillPercent < 10 || fillPercent > 100) {
+    return Status(kInvalidArgument, "fill percent must be in [10, 100]");
+  }
+
+  // The root page is rewritten, do not keep it pinned.
+  cursor_->Reset();
+  if (DBInstance->RunAlone() != kOk) {
+    return GetErrorStatus();
+  }
+  BulkLoader loader(this, Tree(tree), fillPercent);
+  if (loader.Load(iter) != kOk) {
+    return Fail(GetErrorStatus());
+  }
+  return Status();
+}
+
+Status TxnImpl::IncrementalVacuum(int maxPages, int *pages) {
+  *pages = 0;
+  if (!write_) {
+    return Status(kReadOnly, "vacuum in a read transaction");
+  }
+  if (!error_.Ok()) {
+    return error_;
+  }
+  if (maxPages <= 0) {
+    return Status(kInvalidArgument, "vacuum of no pages");
+  }
+
+  // Pages are moved, do not keep any pinned.
+  cursor_->Reset();
+  if (DBInstance->RunAlone() != kOk) {
+    return GetErrorStatus();
+  }
+  Vacuum vacuum(this);
+  if (vacuum.Run(maxPages, pages) != kOk) {
+    return Fail(GetErrorStatus());
+  }
+  return Status();
+}
+
+Code TxnImpl::MoveToWrite(BTree *tree, const Slice &key) {
+  Code code;
+  do {
+    code = cursor_->MoveTo(tree, key);
+    if (code == kOk) {
+      code = cursor_->MarkDirty();
+    }
+  } while (code == kConflict);
+  return code;
+}
+
+Code TxnImpl::Put(const CellData &data) {
+  CursorLocation location = cursor_->Location();
+  int index = cursor_->CellIndex();
+  MemPage *page = cursor_->Page();
+  Code code;
 
   // If the cursor is currently pointing to the the entry, check whether
   // the size of the entry is the same as the new content, if so then use the
   // overwrite optimization.
   if (location == Equal) {
     cursor_->GetCell();
-    if (cursor_->PayloadSize() == value.Size()) {
-      return cursor_->Overwrite(key, value);
+    Cell *cell = cursor_->MutCell();
+    if (cell->PayloadSize() == data.value_.Size() &&
+        cell->Overflow() == kInvalidPageNo && data.overflowSize_ == 0) {
+      memcpy(const_cast<char *>(cell->Payload()), data.value_.Data(),
+             data.value_.Size());
+      return kOk;
     }
+
+    // Replace the cell in one rebuild, so that the old entry stays if the
+    // new one does not fit.
+    PageNo oldOverflow = cell->Overflow();
+    uint64_t oldSize = cell->PayloadSize() - cell->LocalSize();
+    std::vector<CellData> cells;
+    std::string keys;
+    page->GetCells(&cells, &keys);
+    cells[index] = data;
+    code = page->Rebuild(cells);
+    if (code == kPageFull) {
+      Balancer balancer(this, cursor_);
+      code = balancer.Insert(index, data, true);
+    }
+    if (code == kOk && oldOverflow != kInvalidPageNo) {
+      code = FreeOverflow(oldOverflow, oldSize, snapshot_);
+    }
+    return code;
+  }
+
+  if (location == Right) {
+    ++index;
+  }
+  code = page->InsertCell(index, data);
+  if (code == kPageFull) {
+    Balancer balancer(this, cursor_);
+    code = balancer.Insert(index, data, false);
+  }
+  return code;
+}
+
+Status TxnImpl::ReadValue(Slice *value) {
+  // A key not found is a read too, of the leaf it would be in.
+  RecordRead(cursor_->Page());
+  if (cursor_->Location() != Equal) {
+    return Status(kNotFound, "key not found");
   }
 
-  page = cursor_->Page();
-  if (page->FreeSpace() <= 0) {
+  // The page is unpinned once the cursor moves on.
+  cursor_->GetCell();
+  Cell *cell = cursor_->MutCell();
+  if (cell->Overflow() == kInvalidPageNo) {
+    char *copy = arena_.Allocate(cell->PayloadSize());
+    memcpy(copy, cell->Payload(), cell->PayloadSize());
+    *value = Slice(copy, cell->PayloadSize());
+    return Status();
   }
 
-  // pack key value into tmp space as a cell
-  code = FillInCell(key, value, &tmpSpace[0], &cellSize);
+  // Assemble the chunks of a value on an overflow chain.
+  ValueStream stream(snapshot_);
+  Slice chunk;
+  char *copy = nullptr;
+  size_t size = 0;
+  Code code = stream.Open(cursor_);
+  if (code == kOk) {
+    copy = arena_.Allocate(stream.Size());
+    while ((code = stream.NextChunk(&chunk)) == kOk && !chunk.Empty()) {
+      memcpy(copy + size, chunk.Data(), chunk.Size());
+      size += chunk.Size();
+    }
+  }
   if (code != kOk) {
     return GetErrorStatus();
   }
-
+  *value = Slice(copy, size);
   return Status();
 }
-
-Status TxnImpl::Delete(BTree *, const Slice &key) {
-  Status status;
-  return status;
-}
-
-Status TxnImpl::Get(BTree *, const Slice &key, Slice *value) {
-  Status status;
-  return status;
-}
-} // namespace udb
\ No newline at end of file
+} // namespace udb
@@ -1,40 +1,438 @@
 #include "storage/udb_impl.h"
+#include "buffer/buffer_manager.h"
+#include "buffer/mem_page.h"
+#include "common/bytes.h"
+#include "common/compression.h"
+#include "common/limits.h"
+#include "common/metrics.h"
+#include "common/string.h"
+#include "os/file.h"
 #include "storage/btree.h"
+#include "storage/page_layout.h"
 #include "storage/txn_impl.h"
+#include "wal/wal.h"
+
+#include <stdio.h>
+#include <string.h>
 
 namespace udb {
 
-DBImpl::DBImpl(const Options &options, const std::string &path) {}
+static DBImpl *gDBImpl = nullptr;
+
+// Entries of the adaptive hash index of each tree per frame of the buffer
+// pool, a cached leaf holds many hot keys.
+static const int kHashEntriesPerFrame = 16;
+
+Options::Options() = default;
+
+DBImpl::DBImpl(const Options &options, const std::string &path)
+    : options_(options), path_(path), pager_(nullptr),
+      pageFormat_(kPlainPageFormat), writers_(0), alone_(false),
+      default_tree_(nullptr), stopDump_(false) {
+  gDBImpl = this;
+}
+
+DBImpl::~DBImpl() {
+  if (dumper_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(dumpMutex_);
+      stopDump_ = true;
+    }
+    dumpWake_.notify_all();
+    dumper_.join();
+  }
+  if (gDBImpl == this) {
+    gDBImpl = nullptr;
+  }
+  for (auto &iter : tree_map_) {
+    delete iter.second;
+  }
+  for (BTree *tree : deleted_trees_) {
+    delete tree;
+  }
+  delete default_tree_;
+  delete pager_;
+}
+
+DBImpl *DBImpl::Instance() { return gDBImpl; }
+
+Status DBImpl::Open() {
+  int pageSize = options_.pageSize_;
+  if (pageSize < kMinPageSize || pageSize > kMaxPageSize ||
+      (pageSize & (pageSize - 1)) != 0) {
+    return Status(kInvalidArgument,
+                  FormatString("page size %d is not a power of 2 in [%d, %d]",
+                               pageSize, kMinPageSize, kMaxPageSize));
+  }
+
+  // An existing database keeps the page size it was created with.
+  CollectMetrics(&baseStats_);
+  Code code = ReadPageSize(&pageSize);
+  if (code != kOk) {
+    return GetErrorStatus();
+  }
+  if (pageSize != 0) {
+    options_.pageSize_ = pageSize;
+  }
+  pager_ = new BufferManager(options_, path_);
+  code = pager_->Open();
+  if (code == kOk) {
+    code = pager_->PageCount() == 0 ? CreateFileHeader() : ReadFileHeader();
+  }
+  if (code != kOk) {
+    return GetErrorStatus();
+  }
+  default_tree_ = new BTree(1, "default", KeyOrder(), HashCapacity());
+  if (options_.statsDumpPeriodSec_ > 0) {
+    dumper_ = std::thread([this] { DumpStats(); });
+  }
+  return Status();
+}
+
+void DBImpl::GetStats(Stats *stats) {
+  *stats = Stats();
+  CollectMetrics(stats);
+  SubtractMetrics(baseStats_, stats);
+}
+
+void DBImpl::DumpStats() {
+  std::unique_lock<std::mutex> lock(dumpMutex_);
+  auto period = std::chrono::seconds(options_.statsDumpPeriodSec_);
+
+  while (!dumpWake_.wait_for(lock, period, [this] { return stopDump_; })) {
+    Stats stats;
+    GetStats(&stats);
+    fprintf(stderr, "udb stats:\n%s", stats.ToString().c_str());
+  }
+}
+
+int DBImpl::HashCapacity() const {
+  if (!options_.adaptiveHashIndex_) {
+    return 0;
+  }
+  return pager_->FrameNumber() * kHashEntriesPerFrame;
+}
+
+BTree *DBImpl::Tree(const std::string &name, PageNo root,
+                     const KeyOrder &order) {
+  std::lock_guard<std::mutex> lock(treeMutex_);
+  BTree *&tree = tree_map_[{name, root}];
+  if (tree == nullptr) {
+    tree = new BTree(root, name, order, HashCapacity());
+  }
+  return tree;
+}
+
+void DBImpl::DeleteTree(const std::string &name, PageNo root) {
+  std::lock_guard<std::mutex> lock(treeMutex_);
+  auto iter = tree_map_.find({name, root});
+  if (iter == tree_map_.end()) {
+    return;
+  }
+  // The root page may come back as the root of a new tree of the name.
+  iter->second->SetDeleted(true);
+  deleted_trees_.push_back(iter->second);
+  tree_map_.erase(iter);
+}
+
+void DBImpl::RestoreTree(const std::string &name, PageNo root) {
+  std::lock_guard<std::mutex> lock(treeMutex_);
+  for (auto iter = deleted_trees_.rbegin(); iter != deleted_trees_.rend();
+       ++iter) {
+    BTree *tree = *iter;
+    if (tree->Name() == name && tree->Root() == root) {
+      tree->SetDeleted(false);
+      tree_map_[{name, root}] = tree;
+      deleted_trees_.erase(std::next(iter).base());
+      return;
+    }
+  }
+}
+
+char DBImpl::PageFlags(bool isLeaf, KeyOrderKind order) const {
+  char flags = isLeaf ? kLeafPage : kInternalPage;
+  if ((pageFormat_ & kPrefixPageFormat) != 0 && order == kBytewiseOrder) {
+    flags |= kPrefixPage;
+  }
+  if ((pageFormat_ & kLinkedLeafFormat) != 0 && isLeaf) {
+    flags |= kLinkedPage;
+  }
+  if (order == kIntKeyOrder) {
+    flags |= kIntKeyPage;
+  }
+  return flags;
+}
+
+Code DBImpl::CreateFileHeader() {
+  MemPage *page;
+  uint64_t snapshot;
+  uint64_t lsn;
+  int pageSize = pager_->PageSize();
+
+  pageFormat_ =
+      options_.prefixCompression_ ? kPrefixPageFormat : kPlainPageFormat;
+  pageFormat_ |= kLinkedLeafFormat;
+  if (options_.compression_ != kNoCompression) {
+    if (!CompressionSupported(options_.compression_)) {
+      return SaveErrorStatus(Status(
+          kInvalidArgument,
+          FormatString("compression %s is not built in",
+                       CompressionName(options_.compression_))));
+    }
+    // A smaller page takes one block anyway, compressed or not.
+    if (pageSize < kMinCompressedPageSize) {
+      return SaveErrorStatus(Status(
+          kInvalidArgument,
+          FormatString("compression needs a page size of at least %d, not %d",
+                       kMinCompressedPageSize, pageSize)));
+    }
+    pageFormat_ |= kCompressedPageFormat;
+  }
+  Code code = pager_->BeginWrite(&snapshot);
+  if (code != kOk) {
+    return code;
+  }
+  code = pager_->AllocatePage(PageFlags(true), snapshot, &page);
+  if (code != kOk) {
+    pager_->Rollback(snapshot);
+    return code;
+  }
+
+  char *header = page->Data();
+  memset(header, 0, kPage1HeaderOffset);
+  memcpy(&header[kFileHeaderStringOffset], kFileHeaderString,
+         sizeof(kFileHeaderString));
+  put2byte(&header[kFileHeaderPageSizeOffset],
+           pageSize == 65536 ? 1 : pageSize);
+  header[kFileHeaderPageFormatOffset] = pageFormat_;
+  header[kFileHeaderCompressionOffset] = options_.compression_;
+  pager_->ReleasePage(page);
+  pager_->SetCompression(options_.compression_);
+
+  code = pager_->Commit(snapshot, ReadSet(), &lsn);
+  if (code != kOk) {
+    return code;
+  }
+  return pager_->Sync(lsn);
+}
 
-DBImpl::~DBImpl() {}
+Code DBImpl::ReadPageSize(int *pageSize) {
+  File file(path_);
+  char header[kPage1HeaderOffset];
+  uint64_t size;
+
+  // The file has no header until the first checkpoint, then the log has
+  // the page size.
+  Code code = file.Open(true);
+  if (code == kOk) {
+    code = file.Size(&size);
+  }
+  if (code != kOk) {
+    return code;
+  }
+  if (size < kPage1HeaderOffset) {
+    code = Wal::ReadPageSize(path_, pageSize);
+  } else {
+    code = file.Read(0, header, kPage1HeaderOffset);
+    *pageSize = get2byte(&header[kFileHeaderPageSizeOffset]);
+    if (*pageSize == 1) {
+      *pageSize = 65536;
+    }
+    // Not a udb file, which ReadFileHeader tells.
+    if (memcmp(&header[kFileHeaderStringOffset], kFileHeaderString,
+               sizeof(kFileHeaderString)) != 0) {
+      *pageSize = 0;
+    }
+  }
+  if (code != kOk || *pageSize == 0) {
+    return code;
+  }
+  if (*pageSize < kMinPageSize || *pageSize > kMaxPageSize ||
+      (*pageSize & (*pageSize - 1)) != 0) {
+    return SaveErrorStatus(Status(
+        kCorrupt, FormatString("invalid page size %d of the file", *pageSize)));
+  }
+  return kOk;
+}
+
+Code DBImpl::ReadFileHeader() {
+  MemPage *page;
+  Code code = pager_->GetPage(1, kLatestSnapshot, &page);
+  if (code != kOk) {
+    return code;
+  }
+
+  const char *header = page->Data();
+  int pageSize = get2byte(&header[kFileHeaderPageSizeOffset]);
+  uint8_t format = header[kFileHeaderPageFormatOffset];
+  CompressionType compression =
+      static_cast<CompressionType>(header[kFileHeaderCompressionOffset]);
+  if (pageSize == 1) {
+    pageSize = 65536;
+  }
+
+  if (memcmp(&header[kFileHeaderStringOffset], kFileHeaderString,
+             sizeof(kFileHeaderString)) != 0) {
+    code = SaveErrorStatus(Status(kCorrupt, "not a udb database file"));
+  } else if (pageSize != pager_->PageSize()) {
+    code = SaveErrorStatus(Status(
+        kCorrupt, FormatString("page size %d of the file does not match %d",
+                               pageSize, pager_->PageSize())));
+  } else if ((format & ~(kPrefixPageFormat | kLinkedLeafFormat |
+                          kCompressedPageFormat)) != 0) {
+    code = SaveErrorStatus(
+        Status(kCorrupt, FormatString("unknown page format %d", format)));
+  } else if ((format & kCompressedPageFormat) != 0 &&
+             !CompressionSupported(compression)) {
+    code = SaveErrorStatus(Status(
+        kInvalidArgument,
+        FormatString("compression %s of the file is not built in",
+                     CompressionName(compression))));
+  } else {
+    pageFormat_ = format;
+    if ((format & kCompressedPageFormat) != 0) {
+      pager_->SetCompression(compression);
+    }
+  }
+  pager_->ReleasePage(page);
+  return code;
+}
 
 Txn *DBImpl::Begin(bool write) {
-  int lockIndex = Lock(write);
-  return new TxnImpl(write, lockIndex);
+  int lockIndex;
+  uint64_t snapshot;
+
+  // The error is saved for GetErrorStatus, kBusy if all the reader slots
+  // are taken.
+  if (Lock(write, &lockIndex, &snapshot) != kOk) {
+    return nullptr;
+  }
+  return TxnImpl::New(write, lockIndex, snapshot);
 }
 
 Status DBImpl::Commit(Txn *txn) {
-  Status status;
-  return status;
+  TxnImpl *txnImpl = static_cast<TxnImpl *>(txn);
+  int lockIndex = txnImpl->LockIndex();
+  uint64_t snapshot = txnImpl->Snapshot();
+  bool write = txnImpl->write_;
+  uint64_t lsn = 0;
+  Code code = kOk;
+  MetricsTimer timer(kCommitMicros, write);
+
+  // A writer whose write failed may have changed only part of a page, it
+  // can only be rolled back.
+  if (write && !txnImpl->Error().Ok()) {
+    Status status = txnImpl->Error();
+    End(txnImpl, true);
+    return status;
+  }
+
+  // Unpin the pages before leaving the snapshot, and before the pages of
+  // a writer are committed.
+  txnImpl->End();
+  if (write) {
+    code = pager_->Commit(snapshot, txnImpl->Reads(), &lsn);
+    if (code != kOk) {
+      txnImpl->RolledBack();
+    }
+  }
+  Unlock(lockIndex);
+  TxnImpl::Free(txnImpl);
+
+  // Sync after the lock is released, so that the next writer can append
+  // its frames meanwhile and share the same fdatasync.
+  if (code == kOk && lsn > 0) {
+    code = pager_->Sync(lsn);
+  }
+  if (code != kOk) {
+    return GetErrorStatus();
+  }
+  if (write) {
+    RecordTick(kCommits);
+  }
+  return Status();
+}
+
+Status DBImpl::Abort(Txn *txn) {
+  TxnImpl *txnImpl = static_cast<TxnImpl *>(txn);
+  if (End(txnImpl, txnImpl->write_) != kOk) {
+    return GetErrorStatus();
+  }
+  return Status();
+}
+
+Code DBImpl::End(TxnImpl *txn, bool rollback) {
+  Code code = kOk;
+
+  txn->End();
+  if (rollback) {
+    code = pager_->Rollback(txn->Snapshot());
+    txn->RolledBack();
+  }
+  Unlock(txn->LockIndex());
+  TxnImpl::Free(txn);
+  return code;
 }
 
 Status DBImpl::Close(Database *) {
-  Status status;
-  return status;
+  if (pager_->Checkpoint() != kOk) {
+    return GetErrorStatus();
+  }
+  return Status();
+}
+
+Code DBImpl::Lock(bool write, int *lockIndex, uint64_t *snapshot) {
+  if (write) {
+    // Readers never take this lock, so they neither block the writers
+    // nor are blocked by them. Writers run together, each locking the
+    // pages it modifies, unless one of them runs alone.
+    std::unique_lock<std::mutex> lock(writerMutex_);
+    writerDone_.wait(lock, [this] { return !alone_; });
+    Code code = pager_->BeginWrite(snapshot);
+    if (code != kOk) {
+      return code;
+    }
+    ++writers_;
+    *lockIndex = kWriterLockIndex;
+    return kOk;
+  }
+  return pager_->BeginRead(lockIndex, snapshot);
 }
 
-int DBImpl::Lock(bool write) { return 0; }
+void DBImpl::Unlock(int lockIndex) {
+  if (lockIndex == kWriterLockIndex) {
+    std::lock_guard<std::mutex> lock(writerMutex_);
+    // Only the writer running alone can have set alone_.
+    --writers_;
+    alone_ = false;
+    writerDone_.notify_all();
+  } else {
+    pager_->EndRead(lockIndex);
+  }
+}
 
-void Unlock(int lockIndex) {}
+Code DBImpl::RunAlone() {
+  std::lock_guard<std::mutex> lock(writerMutex_);
+  if (writers_ > 1) {
+    return SaveErrorStatus(
+        Status(kBusy, "other write transactions are running"));
+  }
+  alone_ = true;
+  return kOk;
+}
 
 Database::~Database() = default;
 
+Txn::~Txn() = default;
+
+Status Txn::DeleteTree(const std::string &name) { return Status(); }
+
 Status Database::Open(const Options &options, const std::string &name,
                       Database **db) {
   *db = nullptr;
   DBImpl *tree = new DBImpl(options, name);
 
-  Status status;
+  Status status = tree->Open();
 
   if (status.Ok()) {
     *db = tree;
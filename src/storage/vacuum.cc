@@ -0,0 +1,216 @@
+#include "storage/vacuum.h"
+#include "buffer/buffer_manager.h"
+#include "buffer/mem_page.h"
+#include "common/debug.h"
+#include "common/string.h"
+#include "storage/catalog.h"
+#include "storage/cell.h"
+#include "storage/page_layout.h"
+#include "storage/txn_impl.h"
+
+#include <algorithm>
+
+namespace udb {
+Vacuum::Vacuum(TxnImpl *txn) : txn_(txn) {}
+
+Code Vacuum::Run(int maxPages, int *pages) {
+  PageNo count = Pager->PageCount();
+  Code code;
+
+  *pages = 0;
+  PageNo cut = std::min<PageNo>(maxPages, Pager->FreePageCount());
+  if (cut == 0) {
+    return kOk;
+  }
+  PageNo limit = count - cut;
+
+  // Pages after the limit in use need a new place.
+  bool inUse = false;
+  for (PageNo no = limit + 1; no <= count && !inUse; ++no) {
+    inUse = !Pager->IsFreePage(no);
+  }
+  if (inUse) {
+    std::vector<PageNo> roots;
+    Catalog catalog(txn_);
+    code = catalog.Roots(&roots);
+    if (code != kOk) {
+      return code;
+    }
+    for (PageNo root : roots) {
+      // A root never moves.
+      limit = std::max(limit, root);
+    }
+    for (PageNo root : roots) {
+      code = Walk(root, limit);
+      if (code != kOk) {
+        return code;
+      }
+    }
+  }
+
+  // A page in use but not referred to by any tree is kept where it is,
+  // the end is cut after it.
+  for (PageNo no = count; no > limit; --no) {
+    if (!Pager->IsFreePage(no) && refs_.count(no) == 0) {
+      limit = no;
+    }
+  }
+
+  for (PageNo no = limit + 1; no <= count; ++no) {
+    if (Pager->IsFreePage(no)) {
+      continue;
+    }
+    // The lowest free page, there are enough of them before limit.
+    PageNo to = Pager->AllocateRun(1, txn_->Snapshot());
+    Assert(to <= limit);
+    code = Move(no, to);
+    if (code != kOk) {
+      return code;
+    }
+  }
+
+  Pager->Truncate(limit, txn_->Snapshot());
+  *pages = count - limit;
+  return kOk;
+}
+
+Code Vacuum::Walk(PageNo root, PageNo limit) {
+  std::vector<PageNo> stack{root};
+  Code code;
+
+  while (!stack.empty()) {
+    MemPage *page;
+    PageNo no = stack.back();
+    stack.pop_back();
+    code = Pager->GetPage(no, txn_->Snapshot(), &page);
+    if (code != kOk) {
+      return code;
+    }
+
+    if (!page->IsLeaf()) {
+      for (int i = 0; i <= page->CellNumber() && code == kOk; ++i) {
+        PageNo child;
+        code = page->ChildPageNo(i, &child);
+        if (code == kOk) {
+          if (child > limit) {
+            refs_[child].push_back(Ref{no, kChildRef, i});
+          }
+          stack.push_back(child);
+        }
+      }
+    } else {
+      if (page->IsLinked() && page->Sibling() > limit) {
+        refs_[page->Sibling()].push_back(Ref{no, kSiblingRef, 0});
+      }
+      Cell cell;
+      for (int i = 0; i < page->CellNumber() && code == kOk; ++i) {
+        code = page->GetCell(i, &cell);
+        if (code == kOk && cell.Overflow() != kInvalidPageNo) {
+          code = WalkOverflow(no, i, cell.Overflow(),
+                              cell.PayloadSize() - cell.LocalSize(), limit);
+        }
+      }
+    }
+    Pager->ReleasePage(page);
+    if (code != kOk) {
+      return code;
+    }
+    if (stack.size() > static_cast<size_t>(Pager->PageCount())) {
+      return SaveErrorStatus(
+          Status(kCorrupt, FormatString("tree %u has a loop", root)));
+    }
+  }
+  return kOk;
+}
+
+Code Vacuum::WalkOverflow(PageNo leaf, int index, PageNo first, uint64_t size,
+                          PageNo limit) {
+  uint64_t chunk = Pager->PageSize() - kOverflowHeaderSize;
+  uint64_t n = (size + chunk - 1) / chunk;
+  Ref ref{leaf, kCellOverflowRef, index};
+  PageNo no = first;
+
+  for (uint64_t i = 0; i < n; ++i) {
+    MemPage *page;
+    if (no <= 1 || no > Pager->PageCount()) {
+      return SaveErrorStatus(
+          Status(kCorrupt, FormatString("invalid overflow page %u", no)));
+    }
+    if (no > limit) {
+      refs_[no].push_back(ref);
+    }
+    if (i + 1 == n) {
+      break;
+    }
+    Code code = Pager->GetOverflowPage(no, txn_->Snapshot(), &page);
+    if (code != kOk) {
+      return code;
+    }
+    ref = Ref{no, kNextOverflowRef, 0};
+    no = page->NextOverflow();
+    Pager->ReleasePage(page);
+  }
+  return kOk;
+}
+
+Code Vacuum::Move(PageNo from, PageNo to) {
+  const std::vector<Ref> &refs = refs_[from];
+  bool overflow = refs[0].type_ == kCellOverflowRef ||
+                  refs[0].type_ == kNextOverflowRef;
+  Code code = Pager->MovePage(from, to, txn_->Snapshot(), overflow);
+  if (code != kOk) {
+    return code;
+  }
+  moved_[from] = to;
+
+  // The holders may have been moved before. The page from is cut off
+  // with the end.
+  for (Ref ref : refs) {
+    auto iter = moved_.find(ref.holder_);
+    if (iter != moved_.end()) {
+      ref.holder_ = iter->second;
+    }
+    code = SetRef(ref, to);
+    if (code != kOk) {
+      return code;
+    }
+  }
+  return kOk;
+}
+
+Code Vacuum::SetRef(const Ref &ref, PageNo no) {
+  MemPage *page;
+  Code code;
+
+  if (ref.type_ == kNextOverflowRef) {
+    code = Pager->GetOverflowPage(ref.holder_, txn_->Snapshot(), &page);
+  } else {
+    code = Pager->GetPage(ref.holder_, txn_->Snapshot(), &page);
+  }
+  if (code != kOk) {
+    return code;
+  }
+  code = Pager->MarkDirty(&page, txn_->Snapshot());
+  if (code != kOk) {
+    Pager->ReleasePage(page);
+    return code;
+  }
+
+  switch (ref.type_) {
+  case kChildRef:
+    page->SetChildPageNo(ref.index_, no);
+    break;
+  case kCellOverflowRef:
+    page->SetCellOverflow(ref.index_, no);
+    break;
+  case kNextOverflowRef:
+    page->SetNextOverflow(no);
+    break;
+  case kSiblingRef:
+    page->SetSibling(no);
+    break;
+  }
+  Pager->ReleasePage(page);
+  return kOk;
+}
+} // namespace udb
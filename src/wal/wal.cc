@@ -0,0 +1,478 @@
+#include "wal/wal.h"
+#include "common/bytes.h"
+#include "common/compression.h"
+#include "common/metrics.h"
+#include "common/status.h"
+#include "common/string.h"
+#include "os/aio.h"
+#include "os/file.h"
+#include "udb.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string.h>
+#include <thread>
+
+namespace udb {
+// Pages copied back at once by a checkpoint.
+static const size_t kCheckpointBatch = 64;
+
+Wal::Wal(const Options &options, const std::string &dbPath)
+    : path_(dbPath + "-wal"), pageSize_(options.pageSize_),
+      commitWindowUs_(options.walCommitWindowUs_),
+      checkpointFrames_(options.walCheckpointFrames_),
+      compression_(kNoCompression), file_(new File(path_)),
+      dbFile_(nullptr), aio_(nullptr), base_(0), lastLsn_(0), backfilled_(0),
+      dbSize_(kInvalidPageNo),
+      checkpointSeq_(0), salt1_(0), syncedLsn_(0), syncing_(false) {
+  checksum_[0] = checksum_[1] = 0;
+  for (int i = 0; i < kWalReaderSlots; ++i) {
+    readers_[i].store(kFreeSlot, std::memory_order_relaxed);
+  }
+}
+
+Wal::~Wal() { delete file_; }
+
+uint64_t Wal::FrameOffset(uint64_t lsn) const {
+  return kWalHeaderSize +
+         (lsn - base_ - 1) * static_cast<uint64_t>(kWalFrameHeaderSize + pageSize_);
+}
+
+Code Wal::ReadPageSize(const std::string &dbPath, int *pageSize) {
+  File file(dbPath + "-wal");
+  char header[kWalHeaderSize];
+  uint64_t size;
+
+  *pageSize = 0;
+  Code code = file.Open(true);
+  if (code == kOk) {
+    code = file.Size(&size);
+  }
+  if (code != kOk || size < kWalHeaderSize) {
+    return code;
+  }
+  code = file.Read(0, header, kWalHeaderSize);
+  if (code != kOk) {
+    return code;
+  }
+  uint32_t sum[2] = {0, 0};
+  Checksum(header, 24, sum);
+  if (Get4Byte(&header[0]) == kWalMagic &&
+      Get4Byte(&header[4]) == kWalVersion && Get4Byte(&header[24]) == sum[0] &&
+      Get4Byte(&header[28]) == sum[1]) {
+    *pageSize = Get4Byte(&header[8]);
+  }
+  return kOk;
+}
+
+Code Wal::Open(File *dbFile, AsyncIo *aio) {
+  Code code;
+
+  dbFile_ = dbFile;
+  aio_ = aio;
+  code = file_->Open(true);
+  if (code != kOk) {
+    return code;
+  }
+
+  code = Recover();
+  if (code != kOk) {
+    return code;
+  }
+
+  // Replay the committed frames into the database file, nothing is
+  // cached yet so the backfilled pages can be ignored.
+  return Checkpoint([](PageNo, uint64_t) {});
+}
+
+Code Wal::Recover() {
+  char header[kWalHeaderSize];
+  uint64_t size;
+  Code code;
+
+  code = file_->Size(&size);
+  if (code != kOk) {
+    return code;
+  }
+  if (size < kWalHeaderSize) {
+    return Reset();
+  }
+
+  code = file_->Read(0, header, kWalHeaderSize);
+  if (code != kOk) {
+    return code;
+  }
+  uint32_t sum[2] = {0, 0};
+  Checksum(header, 24, sum);
+  if (Get4Byte(&header[0]) != kWalMagic ||
+      Get4Byte(&header[4]) != kWalVersion ||
+      static_cast<int>(Get4Byte(&header[8])) != pageSize_ ||
+      Get4Byte(&header[24]) != sum[0] || Get4Byte(&header[28]) != sum[1]) {
+    // The log has never been written completely, nothing to recover.
+    return Reset();
+  }
+  checkpointSeq_ = Get4Byte(&header[12]);
+  salt1_ = Get4Byte(&header[16]);
+  checksum_[0] = sum[0];
+  checksum_[1] = sum[1];
+
+  // Scan the frames, stop at the first invalid one.
+  const int frameSize = kWalFrameHeaderSize + pageSize_;
+  std::vector<char> frame(frameSize);
+  std::vector<std::pair<PageNo, uint64_t>> pending;
+  uint64_t frameNum = (size - kWalHeaderSize) / frameSize;
+
+  for (uint64_t lsn = 1; lsn <= frameNum; ++lsn) {
+    code = file_->Read(FrameOffset(lsn), frame.data(), frameSize);
+    if (code != kOk) {
+      return code;
+    }
+    if (Get4Byte(&frame[8]) != salt1_ ||
+        Get4Byte(&frame[12]) != checkpointSeq_) {
+      break;
+    }
+    Checksum(&frame[0], 8, sum);
+    Checksum(&frame[kWalFrameHeaderSize], pageSize_, sum);
+    if (Get4Byte(&frame[16]) != sum[0] || Get4Byte(&frame[20]) != sum[1]) {
+      break;
+    }
+
+    pending.push_back(std::make_pair(Get4Byte(&frame[0]), lsn));
+    if (Get4Byte(&frame[4]) != 0) {
+      // A commit frame, the transaction is complete.
+      for (auto &iter : pending) {
+        index_[iter.first].push_back(iter.second);
+      }
+      pending.clear();
+      lastLsn_ = lsn;
+      dbSize_ = Get4Byte(&frame[4]);
+      checksum_[0] = sum[0];
+      checksum_[1] = sum[1];
+    }
+  }
+  syncedLsn_ = lastLsn_;
+
+  return kOk;
+}
+
+Code Wal::Reset() {
+  char header[kWalHeaderSize];
+  Code code;
+
+  ++checkpointSeq_;
+  salt1_ = std::random_device()();
+
+  Put4Byte(&header[0], kWalMagic);
+  Put4Byte(&header[4], kWalVersion);
+  Put4Byte(&header[8], pageSize_);
+  Put4Byte(&header[12], checkpointSeq_);
+  Put4Byte(&header[16], salt1_);
+  Put4Byte(&header[20], checkpointSeq_);
+  checksum_[0] = checksum_[1] = 0;
+  Checksum(header, 24, checksum_);
+  Put4Byte(&header[24], checksum_[0]);
+  Put4Byte(&header[28], checksum_[1]);
+
+  code = file_->Truncate(0);
+  if (code != kOk) {
+    return code;
+  }
+  code = file_->Write(0, header, kWalHeaderSize);
+  if (code != kOk) {
+    return code;
+  }
+  code = file_->Sync();
+  if (code != kOk) {
+    return code;
+  }
+
+  index_.clear();
+  base_ = lastLsn_;
+  return kOk;
+}
+
+Code Wal::Append(const std::vector<WalPage> &pages, PageNo dbSize,
+                 uint64_t *commitLsn, const AppendHandler &appended) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  const int frameSize = kWalFrameHeaderSize + pageSize_;
+  uint32_t sum[2] = {checksum_[0], checksum_[1]};
+  Code code;
+
+  if (pages.empty()) {
+    *commitLsn = lastLsn_;
+    return kOk;
+  }
+
+  // Build all the frames and write them at once.
+  std::vector<char> frames(frameSize * pages.size());
+  for (size_t i = 0; i < pages.size(); ++i) {
+    char *frame = &frames[frameSize * i];
+    bool commit = (i == pages.size() - 1);
+
+    Put4Byte(&frame[0], pages[i].pageNo_);
+    Put4Byte(&frame[4], commit ? dbSize : 0);
+    Put4Byte(&frame[8], salt1_);
+    Put4Byte(&frame[12], checkpointSeq_);
+    memcpy(&frame[kWalFrameHeaderSize], pages[i].data_, pageSize_);
+    Checksum(&frame[0], 8, sum);
+    Checksum(&frame[kWalFrameHeaderSize], pageSize_, sum);
+    Put4Byte(&frame[16], sum[0]);
+    Put4Byte(&frame[20], sum[1]);
+  }
+
+  code = file_->Write(FrameOffset(lastLsn_ + 1), frames.data(), frames.size());
+  if (code != kOk) {
+    return code;
+  }
+  RecordTick(kWalBytes, frames.size());
+
+  for (auto &page : pages) {
+    index_[page.pageNo_].push_back(++lastLsn_);
+  }
+  checksum_[0] = sum[0];
+  checksum_[1] = sum[1];
+  dbSize_ = dbSize;
+  *commitLsn = lastLsn_;
+  appended(lastLsn_ - pages.size() + 1);
+
+  return kOk;
+}
+
+Code Wal::Sync(uint64_t lsn) {
+  std::unique_lock<std::mutex> lock(syncMutex_);
+  Code code;
+
+  while (syncedLsn_ < lsn) {
+    if (syncing_) {
+      // Follower, the leader's fdatasync may cover this lsn.
+      synced_.wait(lock);
+      continue;
+    }
+
+    // Leader, sync the log for all the committers so far.
+    syncing_ = true;
+    lock.unlock();
+
+    if (commitWindowUs_ > 0) {
+      // Give other committers a chance to append their frames.
+      std::this_thread::sleep_for(std::chrono::microseconds(commitWindowUs_));
+    }
+    uint64_t target;
+    {
+      std::shared_lock<std::shared_mutex> walLock(mutex_);
+      target = lastLsn_;
+    }
+    code = file_->Sync();
+
+    lock.lock();
+    syncing_ = false;
+    if (code == kOk) {
+      syncedLsn_ = std::max(syncedLsn_, target);
+    }
+    synced_.notify_all();
+    if (code != kOk) {
+      return code;
+    }
+  }
+
+  return kOk;
+}
+
+Code Wal::BeginRead(int *slot, uint64_t *snapshot) {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+
+  for (int i = 0; i < kWalReaderSlots; ++i) {
+    uint64_t expected = kFreeSlot;
+    if (readers_[i].compare_exchange_strong(expected, lastLsn_)) {
+      *slot = i;
+      *snapshot = lastLsn_;
+      return kOk;
+    }
+  }
+  return SaveErrorStatus(Status(
+      kBusy, FormatString("all %d reader slots are in use", kWalReaderSlots)));
+}
+
+void Wal::EndRead(int slot) {
+  readers_[slot].store(kFreeSlot, std::memory_order_release);
+}
+
+uint64_t Wal::Lookup(PageNo no, uint64_t snapshot) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+
+  auto iter = index_.find(no);
+  if (iter == index_.end()) {
+    return kDbFileVersion;
+  }
+
+  // The latest version not newer than the snapshot.
+  const std::vector<uint64_t> &versions = iter->second;
+  auto pos = std::upper_bound(versions.begin(), versions.end(), snapshot);
+  if (pos == versions.begin()) {
+    return kDbFileVersion;
+  }
+  return *(pos - 1);
+}
+
+Code Wal::ReadFrame(uint64_t lsn, char *buf, bool *found) {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+
+  // A frame before base_ has been checkpointed and the log reset.
+  if (lsn <= base_) {
+    *found = false;
+    return kOk;
+  }
+  *found = true;
+  return file_->Read(FrameOffset(lsn) + kWalFrameHeaderSize, buf, pageSize_);
+}
+
+uint64_t Wal::OldestSnapshot() const {
+  uint64_t oldest = lastLsn_;
+  for (int i = 0; i < kWalReaderSlots; ++i) {
+    oldest = std::min(oldest, readers_[i].load(std::memory_order_acquire));
+  }
+  return oldest;
+}
+
+Code Wal::Checkpoint(const BackfillHandler &backfilled) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  Code code;
+
+  // Versions newer than the oldest snapshot may not be seen by its reader,
+  // so they stay in the log.
+  uint64_t oldest = OldestSnapshot();
+  if (oldest > backfilled_) {
+    // Copy back the latest version not newer than oldest of each page,
+    // in page number order to write the database file sequentially.
+    std::vector<std::pair<PageNo, uint64_t>> pages;
+    for (auto &iter : index_) {
+      const std::vector<uint64_t> &versions = iter.second;
+      auto pos = std::upper_bound(versions.begin(), versions.end(), oldest);
+      if (pos != versions.begin()) {
+        pages.push_back(std::make_pair(iter.first, *(pos - 1)));
+      }
+    }
+    std::sort(pages.begin(), pages.end());
+
+    // Copy a batch of pages at a time, all the reads of a batch and then
+    // all the writes are in flight together.
+    size_t batch = std::min(pages.size(), kCheckpointBatch);
+    std::vector<char> buf(batch * pageSize_);
+    std::vector<char> packed(compression_ != kNoCompression ? buf.size() : 0);
+    std::vector<int> sizes(batch);
+    std::vector<IoRequest> requests(batch);
+    std::vector<IoRequest *> pointers(batch);
+    uint64_t end = 0;
+    for (size_t i = 0; i < pages.size(); i += batch) {
+      int n = std::min(batch, pages.size() - i);
+      for (int j = 0; j < n; ++j) {
+        requests[j] = IoRequest(
+            file_, false, FrameOffset(pages[i + j].second) + kWalFrameHeaderSize,
+            &buf[j * pageSize_], pageSize_);
+        pointers[j] = &requests[j];
+      }
+      code = aio_->Run(pointers.data(), n);
+      if (code != kOk) {
+        return code;
+      }
+      for (int j = 0; j < n; ++j) {
+        // A compressed page takes only the first blocks of its slot.
+        PageNo no = pages[i + j].first;
+        uint64_t offset = static_cast<uint64_t>(no - 1) * pageSize_;
+        char *image = &buf[j * pageSize_];
+        sizes[j] = 0;
+        if (compression_ != kNoCompression && no != 1) {
+          sizes[j] = CompressPage(compression_, image, pageSize_,
+                                  &packed[j * pageSize_]);
+        }
+        if (sizes[j] > 0) {
+          image = &packed[j * pageSize_];
+        }
+        requests[j] = IoRequest(dbFile_, true, offset, image,
+                                sizes[j] > 0 ? sizes[j] : pageSize_);
+        end = std::max(end, offset + pageSize_);
+      }
+      code = aio_->Run(pointers.data(), n);
+      if (code != kOk) {
+        return code;
+      }
+      for (int j = 0; j < n && code == kOk; ++j) {
+        if (sizes[j] > 0) {
+          code = dbFile_->PunchHole(requests[j].offset_ + sizes[j],
+                                    pageSize_ - sizes[j]);
+        }
+      }
+      if (code != kOk) {
+        return code;
+      }
+    }
+
+    // The file ends with a whole slot even if the last page is compressed,
+    // and covers the free pages after the last page written, which only
+    // the freelist refers to.
+    if (dbSize_ != kInvalidPageNo) {
+      end = std::max(end, static_cast<uint64_t>(dbSize_) * pageSize_);
+    }
+    uint64_t fileSize;
+    code = dbFile_->Size(&fileSize);
+    if (code == kOk && fileSize < end) {
+      code = dbFile_->Truncate(end);
+    }
+    if (code != kOk) {
+      return code;
+    }
+    code = dbFile_->Sync();
+    if (code != kOk) {
+      return code;
+    }
+
+    // Only now are the versions copied back durable, a failed checkpoint
+    // leaves them all to be read from the log.
+    for (auto &iter : pages) {
+      std::vector<uint64_t> &versions = index_[iter.first];
+      versions.erase(versions.begin(),
+                     std::upper_bound(versions.begin(), versions.end(),
+                                      iter.second));
+      if (versions.empty()) {
+        index_.erase(iter.first);
+      }
+      backfilled(iter.first, iter.second);
+    }
+    backfilled_ = oldest;
+  }
+
+  // Reset the log only when every reader sees all the frames, which are
+  // all in the database file now.
+  if (oldest < lastLsn_ || lastLsn_ == base_) {
+    return kOk;
+  }
+  code = Reset();
+  if (code != kOk) {
+    return code;
+  }
+
+  // All the frames are durable in the database file now.
+  std::lock_guard<std::mutex> syncLock(syncMutex_);
+  syncedLsn_ = std::max(syncedLsn_, lastLsn_);
+  synced_.notify_all();
+
+  return kOk;
+}
+
+bool Wal::IsEmpty() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return lastLsn_ == base_;
+}
+
+PageNo Wal::DbSize() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return dbSize_;
+}
+
+bool Wal::NeedCheckpoint() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return lastLsn_ - base_ >= static_cast<uint64_t>(checkpointFrames_) &&
+         OldestSnapshot() > backfilled_;
+}
+} // namespace udb
@@ -0,0 +1,122 @@
+#include "test_util.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace udb {
+// Long keys sharing a prefix and a tail, which only differ in the middle.
+// The separators of the pages are cut after the middle.
+static std::string LongKey(int i) {
+  return std::string(60, 'p') + Key(i) + std::string(120, 's');
+}
+
+static Stats GetStats(Database *db) {
+  Stats stats;
+  db->GetStats(&stats);
+  return stats;
+}
+
+// Check with a scan and point lookups that the tree has exactly the long
+// keys of present, in order.
+static void ExpectLongKeys(Database *db, const std::vector<bool> &present) {
+  std::vector<int> expected;
+  for (int i = 0; i < static_cast<int>(present.size()); ++i) {
+    if (present[i]) {
+      expected.push_back(i);
+    }
+  }
+
+  Txn *txn = db->Begin(false);
+  ASSERT_NE(txn, nullptr);
+  std::vector<std::string> keys;
+  Status status = txn->Scan(nullptr, Slice(), Slice(),
+                            [&](const Slice &key, const Slice &value) {
+                              keys.emplace_back(key.Data(), key.Size());
+                              return true;
+                            });
+  ASSERT_TRUE(status.Ok()) << status.Context();
+  ASSERT_EQ(keys.size(), expected.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    ASSERT_EQ(keys[i], LongKey(expected[i]));
+  }
+
+  for (int i = 0; i < static_cast<int>(present.size()); ++i) {
+    Slice value;
+    status = txn->Get(nullptr, LongKey(i), &value);
+    if (present[i]) {
+      ASSERT_TRUE(status.Ok()) << i << ": " << status.Context();
+      ASSERT_EQ(std::string(value.Data(), value.Size()), Value(i, 50));
+    } else {
+      ASSERT_EQ(status.ErrorCode(), kNotFound) << i;
+    }
+    // A key cut like a separator is not in the tree.
+    std::string cut = std::string(60, 'p') + Key(i);
+    ASSERT_EQ(txn->Get(nullptr, cut, &value).ErrorCode(), kNotFound) << i;
+  }
+  db->Commit(txn);
+}
+
+TEST(BTreeTest, SplitAndMergeLongKeys) {
+  TestDb db("split_merge");
+  ASSERT_TRUE(db.Open().Ok());
+  const int n = 20000;
+  std::vector<int> order(n);
+  for (int i = 0; i < n; ++i) {
+    order[i] = i;
+  }
+  std::shuffle(order.begin(), order.end(), std::mt19937(1));
+
+  Stats before = GetStats(db.Get());
+  Txn *txn = db->Begin(true);
+  for (int i : order) {
+    ASSERT_TRUE(txn->Write(nullptr, LongKey(i), Value(i, 50)).Ok());
+  }
+  ASSERT_TRUE(db->Commit(txn).Ok());
+  Stats split = GetStats(db.Get());
+  EXPECT_GT(split.pageSplits_, before.pageSplits_);
+  std::vector<bool> present(n, true);
+  ExpectLongKeys(db.Get(), present);
+
+  // Emptied pages are merged into their siblings.
+  txn = db->Begin(true);
+  for (int i = 0; i < n; ++i) {
+    if (i % 10 != 0) {
+      ASSERT_TRUE(txn->Delete(nullptr, LongKey(i)).Ok());
+      present[i] = false;
+    }
+  }
+  ASSERT_TRUE(db->Commit(txn).Ok());
+  EXPECT_GT(GetStats(db.Get()).pageMerges_, split.pageMerges_);
+  ExpectLongKeys(db.Get(), present);
+
+  ASSERT_TRUE(db.Reopen().Ok());
+  ExpectLongKeys(db.Get(), present);
+}
+
+// A scan from a key between two entries starts at the next one, also
+// when the key equals a cut separator.
+TEST(BTreeTest, ScanFromSeparator) {
+  TestDb db("scan_separator");
+  ASSERT_TRUE(db.Open().Ok());
+  Txn *txn = db->Begin(true);
+  for (int i = 0; i < 5000; i += 2) {
+    ASSERT_TRUE(txn->Write(nullptr, LongKey(i), Value(i, 50)).Ok());
+  }
+  ASSERT_TRUE(db->Commit(txn).Ok());
+
+  txn = db->Begin(false);
+  for (int i = 0; i < 4998; i += 7) {
+    std::string start = std::string(60, 'p') + Key(i);
+    std::string first;
+    Status status = txn->Scan(nullptr, start, Slice(),
+                              [&](const Slice &key, const Slice &value) {
+                                first.assign(key.Data(), key.Size());
+                                return false;
+                              });
+    ASSERT_TRUE(status.Ok()) << status.Context();
+    ASSERT_EQ(first, LongKey(i % 2 == 0 ? i : i + 1)) << i;
+  }
+  db->Commit(txn);
+}
+} // namespace udb
@@ -0,0 +1,117 @@
+#include "test_util.h"
+
+namespace udb {
+// A writer may dirty more pages than a shard of the buffer pool holds,
+// the commit still finds a frame for page 1 to write the freelist. Page 1
+// is the root of the default tree, so the writers use another one that
+// leaves it clean.
+TEST(CommitTest, DeleteMoreKeysThanOneShardHolds) {
+  TestDb db("delete_many");
+  ASSERT_TRUE(db.Open().Ok());
+  BTree *tree = OpenTree(db.Get(), "t");
+  ASSERT_NE(tree, nullptr);
+  ASSERT_TRUE(WriteKeys(db.Get(), 0, 20000, 100, 0, tree).Ok());
+
+  Status status = DeleteKeys(db.Get(), 0, 20000, tree);
+  ASSERT_TRUE(status.Ok()) << status.Context();
+  ExpectKeys(db.Get(), 0, 0, 20000, 100, 0, tree);
+}
+
+TEST(CommitTest, ReuseFreedPagesInOneLargeWriter) {
+  TestDb db("reuse_freed");
+  ASSERT_TRUE(db.Open().Ok());
+  BTree *tree = OpenTree(db.Get(), "t");
+  ASSERT_NE(tree, nullptr);
+  ASSERT_TRUE(WriteKeys(db.Get(), 0, 20000, 100, 0, tree).Ok());
+  ASSERT_TRUE(DeleteKeys(db.Get(), 0, 20000, tree).Ok());
+
+  // The inserts take the pages off the freelist.
+  Status status = WriteKeys(db.Get(), 0, 3000, 1024, 0, tree);
+  ASSERT_TRUE(status.Ok()) << status.Context();
+  ExpectKeys(db.Get(), 0, 3000, 3000, 1024, 0, tree);
+}
+
+TEST(CommitTest, VacuumWithSmallPages) {
+  Options options;
+  options.pageSize_ = 1024;
+  TestDb db("vacuum_small");
+  ASSERT_TRUE(db.Open(options).Ok());
+  BTree *tree = OpenTree(db.Get(), "t");
+  ASSERT_NE(tree, nullptr);
+  ASSERT_TRUE(WriteKeys(db.Get(), 0, 20000, 100, 0, tree).Ok());
+  ASSERT_TRUE(DeleteKeys(db.Get(), 0, 10000, tree).Ok());
+
+  Txn *txn = db->Begin(true);
+  int pages = 0;
+  Status status = txn->IncrementalVacuum(50, &pages);
+  ASSERT_TRUE(status.Ok()) << status.Context();
+  status = db->Commit(txn);
+  ASSERT_TRUE(status.Ok()) << status.Context();
+  EXPECT_GT(pages, 0);
+  ExpectKeys(db.Get(), 10000, 20000, 20000, 100, 0, tree);
+}
+
+// The dirty pages beyond the buffer pool are spilled and read back.
+TEST(CommitTest, WriterLargerThanTheCache) {
+  Options options;
+  options.cacheSize_ = 64 * options.pageSize_;
+  TestDb db("larger_than_cache");
+  ASSERT_TRUE(db.Open(options).Ok());
+
+  Status status = WriteKeys(db.Get(), 0, 30000, 100);
+  ASSERT_TRUE(status.Ok()) << status.Context();
+  ExpectKeys(db.Get(), 0, 30000, 30000, 100);
+
+  // The spill file is emptied once the writer is done.
+  EXPECT_EQ(std::filesystem::file_size(db.Path() + "-spill"), 0u);
+
+  ASSERT_TRUE(db.Reopen().Ok());
+  ExpectKeys(db.Get(), 0, 30000, 30000, 100);
+}
+
+// A reader never sees the spilled pages of a writer, before or after the
+// writer commits.
+TEST(CommitTest, ReaderOfWriterLargerThanTheCache) {
+  Options options;
+  options.cacheSize_ = 64 * options.pageSize_;
+  TestDb db("reader_larger_than_cache");
+  ASSERT_TRUE(db.Open(options).Ok());
+  ASSERT_TRUE(WriteKeys(db.Get(), 0, 10000, 100).Ok());
+
+  Txn *reader = db->Begin(false);
+  Txn *txn = db->Begin(true);
+  for (int i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(txn->Write(nullptr, Key(i), Value(i, 100, 1)).Ok());
+  }
+  for (int i = 0; i < 10000; i += 97) {
+    Slice value;
+    ASSERT_TRUE(reader->Get(nullptr, Key(i), &value).Ok());
+    ASSERT_EQ(std::string(value.Data(), value.Size()), Value(i, 100)) << i;
+  }
+  ASSERT_TRUE(db->Commit(txn).Ok());
+
+  for (int i = 0; i < 10000; i += 89) {
+    Slice value;
+    ASSERT_TRUE(reader->Get(nullptr, Key(i), &value).Ok());
+    ASSERT_EQ(std::string(value.Data(), value.Size()), Value(i, 100)) << i;
+  }
+  db->Commit(reader);
+  ExpectKeys(db.Get(), 0, 10000, 10000, 100, 1);
+}
+
+// A failed commit drops the spilled pages with the others.
+TEST(CommitTest, AbortLargerThanTheCache) {
+  Options options;
+  options.cacheSize_ = 64 * options.pageSize_;
+  TestDb db("abort_larger_than_cache");
+  ASSERT_TRUE(db.Open(options).Ok());
+  ASSERT_TRUE(WriteKeys(db.Get(), 0, 1000, 100).Ok());
+
+  Txn *txn = db->Begin(true);
+  for (int i = 1000; i < 30000; ++i) {
+    ASSERT_TRUE(txn->Write(nullptr, Key(i), Value(i, 100)).Ok());
+  }
+  ASSERT_TRUE(db->Abort(txn).Ok());
+  ExpectKeys(db.Get(), 0, 1000, 30000, 100);
+}
+} // namespace udb
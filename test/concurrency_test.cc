@@ -0,0 +1,152 @@
+#include "test_util.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace udb {
+// A writer fails with kConflict if a page it read has been committed by
+// another writer since, none of its changes are kept.
+TEST(ConcurrencyTest, ConflictOnChangedRead) {
+  TestDb db("conflict");
+  ASSERT_TRUE(db.Open().Ok());
+  ASSERT_TRUE(WriteKeys(db.Get(), 0, 10000, 100).Ok());
+
+  Txn *txn = db->Begin(true);
+  Slice value;
+  ASSERT_TRUE(txn->Get(nullptr, Key(0), &value).Ok());
+
+  std::thread other(
+      [&] { EXPECT_TRUE(WriteKeys(db.Get(), 0, 1, 100, 1).Ok()); });
+  other.join();
+
+  // The key written lives on another leaf than the one read.
+  ASSERT_TRUE(txn->Write(nullptr, Key(9999), Value(9999, 100, 2)).Ok());
+  Status status = db->Commit(txn);
+  EXPECT_EQ(status.ErrorCode(), kConflict) << status.Context();
+
+  txn = db->Begin(false);
+  ASSERT_TRUE(txn->Get(nullptr, Key(0), &value).Ok());
+  EXPECT_EQ(std::string(value.Data(), value.Size()), Value(0, 100, 1));
+  ASSERT_TRUE(txn->Get(nullptr, Key(9999), &value).Ok());
+  EXPECT_EQ(std::string(value.Data(), value.Size()), Value(9999, 100));
+  db->Commit(txn);
+}
+
+// A writer that needs to run alone gets kBusy while another writer runs,
+// and may go on once it is done.
+TEST(ConcurrencyTest, BusyWhileOthersWrite) {
+  TestDb db("busy");
+  ASSERT_TRUE(db.Open().Ok());
+  BTree *tree = OpenTree(db.Get(), "t");
+  ASSERT_NE(tree, nullptr);
+  ASSERT_TRUE(WriteKeys(db.Get(), 0, 1000, 100, 0, tree).Ok());
+
+  Txn *txn = db->Begin(true);
+  ASSERT_TRUE(txn->Write(nullptr, Key(0), Value(0, 100)).Ok());
+  std::thread other([&] {
+    Txn *deleter = db->Begin(true);
+    EXPECT_EQ(deleter->DeleteTree("t").ErrorCode(), kBusy);
+    EXPECT_TRUE(db->Abort(deleter).Ok());
+  });
+  other.join();
+  ASSERT_TRUE(db->Commit(txn).Ok());
+  ExpectKeys(db.Get(), 0, 1000, 1000, 100, 0, tree);
+
+  other = std::thread([&] {
+    Txn *deleter = db->Begin(true);
+    EXPECT_TRUE(deleter->DeleteTree("t").Ok());
+    EXPECT_TRUE(db->Commit(deleter).Ok());
+  });
+  other.join();
+  txn = db->Begin(false);
+  EXPECT_EQ(txn->OpenTree("t", &tree, false).ErrorCode(), kNotFound);
+  db->Commit(txn);
+}
+
+// Transactions beyond the reader slots of the log fail to begin with
+// kBusy, until one of the others ends.
+TEST(ConcurrencyTest, BusyWithoutReaderSlot) {
+  TestDb db("reader_slots");
+  ASSERT_TRUE(db.Open().Ok());
+  std::vector<Txn *> txns;
+  for (int i = 0; i < 64; ++i) {
+    Txn *txn = db->Begin(i % 8 == 0);
+    ASSERT_NE(txn, nullptr) << i;
+    txns.push_back(txn);
+  }
+  EXPECT_EQ(db->Begin(false), nullptr);
+  EXPECT_EQ(GetErrorStatus().ErrorCode(), kBusy);
+  EXPECT_EQ(db->Begin(true), nullptr);
+  EXPECT_EQ(GetErrorStatus().ErrorCode(), kBusy);
+
+  ASSERT_TRUE(db->Commit(txns.back()).Ok());
+  txns.back() = db->Begin(true);
+  ASSERT_NE(txns.back(), nullptr);
+  for (Txn *txn : txns) {
+    ASSERT_TRUE(db->Commit(txn).Ok());
+  }
+}
+
+// Writers add to shared counters at once, retrying on kConflict and
+// kBusy, no addition is lost.
+TEST(ConcurrencyTest, CountersOfConcurrentWriters) {
+  TestDb db("counters");
+  ASSERT_TRUE(db.Open().Ok());
+  const int kCounters = 8;
+  const int kThreads = 4;
+  const int kAdds = 300;
+
+  Txn *txn = db->Begin(true);
+  for (int i = 0; i < kCounters; ++i) {
+    ASSERT_TRUE(txn->Write(nullptr, Key(i), "0").Ok());
+  }
+  ASSERT_TRUE(db->Commit(txn).Ok());
+
+  std::atomic<int> failures(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kAdds; ++i) {
+        std::string key = Key((t + i) % kCounters);
+        while (true) {
+          Txn *adder = db->Begin(true);
+          Slice value;
+          Status status = adder->Get(nullptr, key, &value);
+          if (status.Ok()) {
+            int count = std::stoi(std::string(value.Data(), value.Size()));
+            status = adder->Write(nullptr, key, std::to_string(count + 1));
+          }
+          if (status.Ok()) {
+            status = db->Commit(adder);
+          } else {
+            db->Abort(adder);
+          }
+          if (status.Ok()) {
+            break;
+          }
+          if (status.ErrorCode() != kConflict &&
+              status.ErrorCode() != kBusy) {
+            ++failures;
+            return;
+          }
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(failures, 0);
+
+  int total = 0;
+  txn = db->Begin(false);
+  for (int i = 0; i < kCounters; ++i) {
+    Slice value;
+    ASSERT_TRUE(txn->Get(nullptr, Key(i), &value).Ok());
+    total += std::stoi(std::string(value.Data(), value.Size()));
+  }
+  db->Commit(txn);
+  EXPECT_EQ(total, kThreads * kAdds);
+}
+} // namespace udb
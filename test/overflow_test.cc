@@ -0,0 +1,89 @@
+#include "test_util.h"
+
+namespace udb {
+// Values of several overflow pages each.
+static const int kLargeSize = 20000;
+
+// Read the whole value of key i with a stream.
+static std::string StreamValue(Txn *txn, int i) {
+  ValueReader *reader;
+  if (!txn->GetStream(nullptr, Key(i), &reader).Ok()) {
+    return "";
+  }
+  std::string value;
+  Slice chunk;
+  while (reader->Next(&chunk).Ok() && chunk.Size() > 0) {
+    value.append(chunk.Data(), chunk.Size());
+  }
+  delete reader;
+  return value;
+}
+
+// The overflow pages moved by a vacuum keep their chains whole.
+TEST(OverflowTest, VacuumMovesOverflowChains) {
+  TestDb db("overflow_vacuum");
+  ASSERT_TRUE(db.Open().Ok());
+  ASSERT_TRUE(WriteKeys(db.Get(), 0, 200, kLargeSize).Ok());
+  ASSERT_TRUE(DeleteKeys(db.Get(), 0, 100).Ok());
+
+  Txn *txn = db->Begin(true);
+  int pages = 0;
+  Status status = txn->IncrementalVacuum(1000, &pages);
+  ASSERT_TRUE(status.Ok()) << status.Context();
+  ASSERT_TRUE(db->Commit(txn).Ok());
+  EXPECT_GT(pages, 0);
+  ExpectKeys(db.Get(), 100, 200, 200, kLargeSize);
+
+  txn = db->Begin(false);
+  for (int i = 100; i < 200; ++i) {
+    ASSERT_EQ(StreamValue(txn, i), Value(i, kLargeSize)) << i;
+  }
+  db->Commit(txn);
+
+  ASSERT_TRUE(db.Reopen().Ok());
+  ExpectKeys(db.Get(), 100, 200, 200, kLargeSize);
+}
+
+// A reader streaming a value keeps its chain while a vacuum moves the
+// pages and the log is checkpointed.
+TEST(OverflowTest, StreamDuringVacuum) {
+  Options options;
+  options.walCheckpointFrames_ = 100;
+  TestDb db("overflow_stream");
+  ASSERT_TRUE(db.Open(options).Ok());
+  ASSERT_TRUE(WriteKeys(db.Get(), 0, 200, kLargeSize).Ok());
+
+  Txn *reader = db->Begin(false);
+  ValueReader *stream;
+  ASSERT_TRUE(reader->GetStream(nullptr, Key(150), &stream).Ok());
+  EXPECT_EQ(stream->Size(), static_cast<uint64_t>(kLargeSize));
+  std::string value;
+  Slice chunk;
+  ASSERT_TRUE(stream->Next(&chunk).Ok());
+  value.append(chunk.Data(), chunk.Size());
+
+  ASSERT_TRUE(DeleteKeys(db.Get(), 0, 190).Ok());
+  Txn *txn = db->Begin(true);
+  int pages = 0;
+  ASSERT_TRUE(txn->IncrementalVacuum(1000, &pages).Ok());
+  ASSERT_TRUE(db->Commit(txn).Ok());
+  EXPECT_GT(pages, 0);
+  ASSERT_TRUE(WriteKeys(db.Get(), 300, 400, kLargeSize).Ok());
+
+  while (stream->Next(&chunk).Ok() && chunk.Size() > 0) {
+    value.append(chunk.Data(), chunk.Size());
+  }
+  delete stream;
+  EXPECT_EQ(value, Value(150, kLargeSize));
+  db->Commit(reader);
+
+  txn = db->Begin(false);
+  for (int i = 190; i < 200; ++i) {
+    ASSERT_EQ(StreamValue(txn, i), Value(i, kLargeSize)) << i;
+  }
+  for (int i = 300; i < 400; ++i) {
+    ASSERT_EQ(StreamValue(txn, i), Value(i, kLargeSize)) << i;
+  }
+  db->Commit(txn);
+}
+} // namespace udb
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "udb.h"
+
+#include <filesystem>
+#include <functional>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace udb {
+// A new database of the test, its files are removed when done.
+class TestDb {
+public:
+  explicit TestDb(const std::string &name) : db_(nullptr) {
+    path_ = ::testing::TempDir() + "udb_" + name + ".db";
+    Remove();
+  }
+
+  ~TestDb() {
+    Close();
+    Remove();
+  }
+
+  Status Open(const Options &options = Options()) {
+    options_ = options;
+    return Database::Open(options, path_, &db_);
+  }
+
+  // Open the database again, as after a restart of the process.
+  Status Reopen() {
+    Close();
+    return Database::Open(options_, path_, &db_);
+  }
+
+  void Close() {
+    if (db_) {
+      db_->Close(db_);
+      delete db_;
+      db_ = nullptr;
+    }
+  }
+
+  // Run work on the database in a child process that exits without
+  // closing it, as if the process crashed right after. Return false if the
+  // work failed. The database MUST NOT be open here.
+  bool RunAndCrash(const Options &options,
+                   const std::function<bool(Database *)> &work) {
+    options_ = options;
+    pid_t pid = fork();
+    if (pid == 0) {
+      Database *db;
+      bool ok = Database::Open(options, path_, &db).Ok() && work(db);
+      _exit(ok ? 0 : 1);
+    }
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+           WEXITSTATUS(status) == 0;
+  }
+
+  Database *Get() const { return db_; }
+  Database *operator->() const { return db_; }
+  const std::string &Path() const { return path_; }
+
+private:
+  void Remove() {
+    std::filesystem::remove(path_);
+    std::filesystem::remove(path_ + "-wal");
+    std::filesystem::remove(path_ + "-spill");
+  }
+
+  std::string path_;
+  Options options_;
+  Database *db_;
+};
+
+// The i-th key of a test, in the order of i.
+inline std::string Key(int i) {
+  char key[16];
+  snprintf(key, sizeof(key), "key%08d", i);
+  return key;
+}
+
+// A value of size bytes that tells the key i and the version it was
+// written with.
+inline std::string Value(int i, int size, int version = 0) {
+  std::string value = std::to_string(i) + "/" + std::to_string(version) + "/";
+  value.resize(size, static_cast<char>('a' + (i + version) % 26));
+  return value;
+}
+
+// Open the tree of the name, created if missing.
+inline BTree *OpenTree(Database *db, const std::string &name) {
+  BTree *tree = nullptr;
+  Txn *txn = db->Begin(true);
+  Status status = txn->OpenTree(name, &tree, true);
+  if (!status.Ok() || !db->Commit(txn).Ok()) {
+    return nullptr;
+  }
+  return tree;
+}
+
+// Write the values of keys [from, to) of the tree, the default one if
+// nullptr, in one transaction.
+inline Status WriteKeys(Database *db, int from, int to, int size,
+                        int version = 0, BTree *tree = nullptr) {
+  Txn *txn = db->Begin(true);
+  for (int i = from; i < to; ++i) {
+    Status status = txn->Write(tree, Key(i), Value(i, size, version));
+    if (!status.Ok()) {
+      db->Abort(txn);
+      return status;
+    }
+  }
+  return db->Commit(txn);
+}
+
+// Delete keys [from, to) of the tree in one transaction.
+inline Status DeleteKeys(Database *db, int from, int to,
+                         BTree *tree = nullptr) {
+  Txn *txn = db->Begin(true);
+  for (int i = from; i < to; ++i) {
+    Status status = txn->Delete(tree, Key(i));
+    if (!status.Ok()) {
+      db->Abort(txn);
+      return status;
+    }
+  }
+  return db->Commit(txn);
+}
+
+// Check that keys [from, to) of the tree have the values written with
+// version, and that the other keys up to end are gone.
+inline void ExpectKeys(Database *db, int from, int to, int end, int size,
+                       int version = 0, BTree *tree = nullptr) {
+  Txn *txn = db->Begin(false);
+  ASSERT_NE(txn, nullptr);
+  for (int i = 0; i < end; ++i) {
+    Slice value;
+    Status status = txn->Get(tree, Key(i), &value);
+    if (i >= from && i < to) {
+      ASSERT_TRUE(status.Ok()) << Key(i) << ": " << status.Context();
+      ASSERT_EQ(std::string(value.Data(), value.Size()),
+                Value(i, size, version))
+          << Key(i);
+    } else {
+      ASSERT_EQ(status.ErrorCode(), kNotFound) << Key(i);
+    }
+  }
+  db->Commit(txn);
+}
+} // namespace udb
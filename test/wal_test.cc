@@ -0,0 +1,96 @@
+#include "test_util.h"
+
+namespace udb {
+// The log is never checkpointed by the tests, the database file stays as
+// it was before the crash and recovery only has the log.
+static Options LogOnlyOptions() {
+  Options options;
+  options.walCheckpointFrames_ = 1000000;
+  return options;
+}
+
+// Keys [from, to) with their values of version 0, in key order.
+class KeyIterator : public KVIterator {
+public:
+  KeyIterator(int from, int to, int size)
+      : i_(from), to_(to), size_(size) {
+    Load();
+  }
+
+  bool Valid() const override { return i_ < to_; }
+  Slice Key() const override { return key_; }
+  Slice Value() const override { return value_; }
+  void Next() override {
+    ++i_;
+    Load();
+  }
+
+private:
+  void Load() {
+    key_ = udb::Key(i_);
+    value_ = udb::Value(i_, size_);
+  }
+
+  int i_;
+  int to_;
+  int size_;
+  std::string key_;
+  std::string value_;
+};
+
+TEST(WalTest, RecoverCommitsAfterCrash) {
+  TestDb db("wal_recover");
+  ASSERT_TRUE(db.RunAndCrash(LogOnlyOptions(), [](Database *crashed) {
+    return WriteKeys(crashed, 0, 2000, 100).Ok() &&
+           WriteKeys(crashed, 0, 2000, 100, 1).Ok() &&
+           DeleteKeys(crashed, 1500, 2000).Ok();
+  }));
+  EXPECT_GT(std::filesystem::file_size(db.Path() + "-wal"), 0u);
+
+  ASSERT_TRUE(db.Open(LogOnlyOptions()).Ok());
+  ExpectKeys(db.Get(), 0, 1500, 2000, 100, 1);
+}
+
+// A commit whose last frame did not reach the disk is dropped as a whole,
+// the commits before it are kept.
+TEST(WalTest, DropTornCommit) {
+  TestDb db("wal_torn");
+  ASSERT_TRUE(db.RunAndCrash(LogOnlyOptions(), [](Database *crashed) {
+    return WriteKeys(crashed, 0, 2000, 100).Ok() &&
+           WriteKeys(crashed, 0, 2000, 100, 1).Ok();
+  }));
+  std::string wal = db.Path() + "-wal";
+  std::filesystem::resize_file(wal, std::filesystem::file_size(wal) - 1);
+
+  ASSERT_TRUE(db.Open(LogOnlyOptions()).Ok());
+  ExpectKeys(db.Get(), 0, 2000, 2000, 100);
+}
+
+// A bulk load writes its pages to the log before it commits, they are
+// dropped if it never does, and the next commits go after the last
+// committed frame.
+TEST(WalTest, DropUncommittedBulkLoad) {
+  TestDb db("wal_bulk");
+  ASSERT_TRUE(db.RunAndCrash(LogOnlyOptions(), [](Database *crashed) {
+    if (!WriteKeys(crashed, 0, 100, 100).Ok()) {
+      return false;
+    }
+    Txn *txn = crashed->Begin(true);
+    BTree *tree;
+    KeyIterator iter(0, 50000, 100);
+    return txn->OpenTree("bulk", &tree, true).Ok() &&
+           txn->BulkLoad(tree, &iter, 100).Ok();
+  }));
+
+  ASSERT_TRUE(db.Open(LogOnlyOptions()).Ok());
+  ExpectKeys(db.Get(), 0, 100, 100, 100);
+  Txn *txn = db->Begin(false);
+  BTree *tree;
+  EXPECT_EQ(txn->OpenTree("bulk", &tree, false).ErrorCode(), kNotFound);
+  ASSERT_TRUE(db->Commit(txn).Ok());
+
+  ASSERT_TRUE(WriteKeys(db.Get(), 100, 200, 100).Ok());
+  ASSERT_TRUE(db.Reopen().Ok());
+  ExpectKeys(db.Get(), 0, 200, 200, 100);
+}
+} // namespace udb
@@ -0,0 +1,19 @@
+# Micro benchmarks of the internals and db_bench-style workloads, run
+# with --benchmark_filter to pick some. Numbers are only meaningful in an
+# optimised build, the default one.
+add_executable(udb_bench
+  bench/bench_main.cc
+  bench/db_bench.cc
+  bench/micro_bench.cc
+)
+target_link_libraries(udb_bench udb benchmark::benchmark)
+target_compile_definitions(udb_bench
+  PRIVATE UDB_BENCH_BUILD_TYPE="${CMAKE_BUILD_TYPE}")
+
+# The checkpoint stress workload fails a read if a page a reader holds is
+# lost under concurrent commits and checkpoints, it runs as a test.
+add_test(NAME checkpoint_stress
+  COMMAND udb_bench --benchmark_filter=db/checkpointstress
+          --num=20000 --reads=500000 --threads=6 --db=${PROJECT_BINARY_DIR}/stress)
+set_tests_properties(checkpoint_stress
+  PROPERTIES FAIL_REGULAR_EXPRESSION "ERROR OCCURRED")
@@ -0,0 +1,12 @@
+# Tests of the behaviour of whole databases, each test case runs as a
+# ctest test.
+add_executable(udb_test
+  test/btree_test.cc
+  test/commit_test.cc
+  test/concurrency_test.cc
+  test/overflow_test.cc
+  test/wal_test.cc
+)
+target_link_libraries(udb_test udb GTest::gtest_main)
+include(GoogleTest)
+gtest_discover_tests(udb_test)